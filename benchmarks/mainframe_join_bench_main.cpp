@@ -0,0 +1,101 @@
+//          Copyright Ted Middleton 2022.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#include <mainframe.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace mf;
+using namespace mf::placeholders;
+
+namespace
+{
+
+// Time the fastest of a few runs, in milliseconds
+template<typename Fn>
+double
+time_ms(Fn fn, size_t& rows_out)
+{
+    double best = 0.0;
+    for (int run = 0; run < 3; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        rows_out   = fn();
+        auto stop  = std::chrono::steady_clock::now();
+        double ms  = std::chrono::duration<double, std::milli>(stop - start).count();
+        if (run == 0 || ms < best) {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+// Probe a large frame against a small one where only a fraction (the
+// selectivity) of probe keys have a match. The bloom filter prefilter in
+// innerjoin() skips indexing the probe frame, so it's compared with the same
+// unindexed probe in left row order without the filter; the default join,
+// which indexes both frames, is shown for reference
+int
+main(int argc, char* argv[])
+{
+    size_t build_rows = 100000;
+    size_t probe_rows = 2000000;
+    if (argc > 1) {
+        probe_rows = static_cast<size_t>(std::atoll(argv[1]));
+    }
+
+    frame<int64_t, double> build;
+    build.set_column_names("key", "price");
+    for (size_t i = 0; i < build_rows; ++i) {
+        build.push_back(static_cast<int64_t>(i), static_cast<double>(i) * 0.5);
+    }
+
+    std::cout << "build rows " << build_rows << ", probe rows " << probe_rows << "\n";
+    std::cout << std::setw(12) << "selectivity" << std::setw(12) << "matches" << std::setw(16)
+              << "indexed (ms)" << std::setw(16) << "unfiltered (ms)" << std::setw(16)
+              << "bloom (ms)" << "\n";
+
+    std::mt19937_64 rng{ 42 };
+    for (double selectivity : { 0.01, 0.10, 0.50 }) {
+        std::uniform_real_distribution<double> coin{ 0.0, 1.0 };
+        std::uniform_int_distribution<int64_t> hit{ 0, static_cast<int64_t>(build_rows) - 1 };
+        std::uniform_int_distribution<int64_t> miss{ static_cast<int64_t>(build_rows),
+            std::numeric_limits<int64_t>::max() };
+
+        frame<int64_t, int32_t> probe;
+        probe.set_column_names("key", "qty");
+        for (size_t i = 0; i < probe_rows; ++i) {
+            int64_t key = coin(rng) < selectivity ? hit(rng) : miss(rng);
+            probe.push_back(key, static_cast<int32_t>(i));
+        }
+
+        const join_options unfiltered{ false, 10.0, true };
+        size_t indexed_rows    = 0;
+        size_t unfiltered_rows = 0;
+        size_t bloom_rows      = 0;
+        double indexed_ms      = time_ms(
+            [&]() { return innerjoin(probe, _0, build, _0).size(); }, indexed_rows);
+        double unfiltered_ms   = time_ms(
+            [&]() { return innerjoin(probe, _0, build, _0, unfiltered).size(); }, unfiltered_rows);
+        double bloom_ms        = time_ms(
+            [&]() { return innerjoin(probe, _0, build, _0, join_options{ true }).size(); },
+            bloom_rows);
+        if (indexed_rows != bloom_rows || unfiltered_rows != bloom_rows) {
+            std::cerr << "row count mismatch: " << indexed_rows << ", " << unfiltered_rows
+                      << " vs " << bloom_rows << "\n";
+            return 1;
+        }
+
+        std::cout << std::setw(11) << static_cast<int>(selectivity * 100.0) << "%" << std::setw(12)
+                  << bloom_rows << std::setw(16) << std::fixed << std::setprecision(1) << indexed_ms
+                  << std::setw(16) << unfiltered_ms << std::setw(16) << bloom_ms << "\n";
+    }
+    return 0;
+}
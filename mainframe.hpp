@@ -6,6 +6,7 @@
 #ifndef INCLUDED_mainframe_h
 #define INCLUDED_mainframe_h
 
+#include "mainframe/bloom_filter.hpp"
 #include "mainframe/columnindex.hpp"
 #include "mainframe/expression.hpp"
 #include "mainframe/frame.hpp"
@@ -14,6 +15,7 @@
 #include "mainframe/frame_row.hpp"
 #include "mainframe/group.hpp"
 #include "mainframe/join.hpp"
+#include "mainframe/lazy.hpp"
 #include "mainframe/missing.hpp"
 #include "mainframe/row_decl.hpp"
 #include "mainframe/series.hpp"
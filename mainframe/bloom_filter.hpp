@@ -0,0 +1,184 @@
+//          Copyright Ted Middleton 2022.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef INCLUDED_mainframe_bloom_filter_h
+#define INCLUDED_mainframe_bloom_filter_h
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "mainframe/detail/hash.hpp"
+#include "mainframe/frame.hpp"
+
+namespace mf
+{
+
+class bloom_filter;
+
+namespace detail
+{
+
+// Expression that's true for rows whose key columns may be in a bloom_filter
+template<size_t... Inds>
+struct bloom_expr
+{
+    using is_expr = void;
+
+    template<template<bool, bool, typename...> typename Iter, bool IsConst, bool IsReverse,
+        typename... Ts>
+    bool
+    operator()(const Iter<IsConst, IsReverse, Ts...>&, const Iter<IsConst, IsReverse, Ts...>& curr,
+        const Iter<IsConst, IsReverse, Ts...>&) const;
+
+    const bloom_filter* filter;
+};
+
+} // namespace detail
+
+template<size_t... Inds>
+struct is_complex_expression<detail::bloom_expr<Inds...>> : std::true_type
+{};
+
+///
+/// Blocked bloom filter over the key columns of a frame
+///
+/// A bloom_filter answers "is this key definitely not in the set?" with a
+/// single cache line read per key. It's used by innerjoin() to screen probe
+/// keys before they touch the hash table (see @ref join_options), but it's
+/// also useful on its own as a cheap prefilter for rows():
+///
+///     frame<int, std::string> allowed;
+///     frame<int, double> events;
+///     auto bf = make_bloom_filter(allowed, _0);
+///     // rows whose _0 may be in allowed - false positives are possible,
+///     // false negatives are not
+///     auto maybe = events.rows(bf.may_contain(_0));
+///
+/// The filter is split into 256 bit blocks. Each key sets 8 bits, one in each
+/// 32 bit word of a single block, so an insert or a lookup touches one block.
+/// With the default 10 bits per key the false positive rate is about 1%.
+///
+class bloom_filter
+{
+public:
+    // A single block, so a default filter can still be inserted into
+    bloom_filter()
+        : m_blocks(1)
+    {}
+
+    explicit bloom_filter(size_t expected_keys, double bits_per_key = 10.0)
+    {
+        double bits    = std::max(1.0, static_cast<double>(expected_keys) * bits_per_key);
+        size_t nblocks = static_cast<size_t>(std::ceil(bits / 256.0));
+        m_blocks.resize(nblocks);
+    }
+
+    void
+    insert_hash(uint64_t h)
+    {
+        block& b       = m_blocks[block_index(h)];
+        const auto key = static_cast<uint32_t>(h);
+        for (size_t i = 0; i < 8; ++i) {
+            b[i] |= bit(key, i);
+        }
+    }
+
+    bool
+    may_contain_hash(uint64_t h) const
+    {
+        if (m_blocks.empty()) {
+            return false;
+        }
+        const block& b = m_blocks[block_index(h)];
+        const auto key = static_cast<uint32_t>(h);
+        uint32_t miss  = 0;
+        for (size_t i = 0; i < 8; ++i) {
+            miss |= bit(key, i) & ~b[i];
+        }
+        return miss == 0;
+    }
+
+    /// Insert the key in columns Inds... of a row
+    template<typename Row, size_t Ind, size_t... Inds>
+    void
+    insert(const Row& row, columnindex<Ind>, columnindex<Inds>...)
+    {
+        insert_hash(detail::hash_row<Ind, Inds...>(row));
+    }
+
+    /// Could the key in columns Inds... of a row be in the filter?
+    template<typename Row, size_t Ind, size_t... Inds>
+    bool
+    may_contain(const Row& row, columnindex<Ind>, columnindex<Inds>...) const
+    {
+        return may_contain_hash(detail::hash_row<Ind, Inds...>(row));
+    }
+
+    /// An expression for rows() that's true when the key in columns Inds... may
+    /// be in the filter. The filter must outlive the expression.
+    template<size_t... Inds>
+    detail::bloom_expr<Inds...>
+    may_contain(columnindex<Inds>...) const
+    {
+        return detail::bloom_expr<Inds...>{ this };
+    }
+
+    size_t
+    size_in_bytes() const
+    {
+        return m_blocks.size() * sizeof(block);
+    }
+
+private:
+    using block = std::array<uint32_t, 8>;
+
+    size_t
+    block_index(uint64_t h) const
+    {
+        // Multiply-shift instead of modulo to map the high bits onto the blocks
+        return static_cast<size_t>(((h >> 32) * m_blocks.size()) >> 32);
+    }
+
+    static uint32_t
+    bit(uint32_t key, size_t i)
+    {
+        static constexpr uint32_t salts[8] = { 0x47b6137bU, 0x44974d91U, 0x8824ad5bU,
+            0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U };
+        return uint32_t{ 1 } << ((key * salts[i]) >> 27);
+    }
+
+    std::vector<block> m_blocks;
+};
+
+template<size_t... Inds>
+template<template<bool, bool, typename...> typename Iter, bool IsConst, bool IsReverse,
+    typename... Ts>
+bool
+detail::bloom_expr<Inds...>::operator()(const Iter<IsConst, IsReverse, Ts...>&,
+    const Iter<IsConst, IsReverse, Ts...>& curr, const Iter<IsConst, IsReverse, Ts...>&) const
+{
+    return filter->may_contain_hash(detail::hash_row<Inds...>(*curr));
+}
+
+///
+/// Build a bloom_filter from the key columns Inds... of every row of a frame
+///
+template<typename... Ts, size_t... Inds>
+bloom_filter
+make_bloom_filter(const frame<Ts...>& f, columnindex<Inds>... cols)
+{
+    bloom_filter bf{ f.size() };
+    for (size_t i = 0; i < f.size(); ++i) {
+        bf.insert(f.row(i), cols...);
+    }
+    return bf;
+}
+
+} // namespace mf
+
+#endif // INCLUDED_mainframe_bloom_filter_h
@@ -0,0 +1,466 @@
+//          Copyright Ted Middleton 2022.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef INCLUDED_mainframe_detail_aggregate_h
+#define INCLUDED_mainframe_detail_aggregate_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "mainframe/detail/flat_index.hpp"
+#include "mainframe/detail/hash.hpp"
+#include "mainframe/detail/simd.hpp"
+#include "mainframe/missing.hpp"
+
+// Grouped aggregation kernels. Each one takes a raw column, the group id of
+// every row (as produced by flat_index) and writes one accumulator per group,
+// in a single pass over the column - rows are scattered into their group's
+// accumulator rather than gathered group by group.
+
+namespace mf::detail
+{
+
+// With only a few groups, consecutive rows mostly hit the same accumulator and
+// every update waits on the previous one. Below this many groups the kernels
+// keep scatter_lanes interleaved copies of each accumulator and fold them at
+// the end.
+inline constexpr size_t scatter_lanes            = 4;
+inline constexpr size_t scatter_lanes_max_groups = 1 << 12;
+
+// out[g] = op(out[g], data[i]) for every row i in group g. out must hold one
+// initialized accumulator per group
+template<typename T, typename Op>
+void
+scatter_reduce(const T* data, const uint32_t* gids, size_t num, size_t ngroups, T* out, Op op)
+{
+    constexpr size_t L = scatter_lanes;
+    if (ngroups == 0) {
+        return;
+    }
+    if (ngroups > scatter_lanes_max_groups || num < ngroups * L * 4) {
+        for (size_t i = 0; i < num; ++i) {
+            T& acc = out[gids[i]];
+            acc    = op(acc, data[i]);
+        }
+        return;
+    }
+
+    std::vector<T> lanes(ngroups * L);
+    for (size_t g = 0; g < ngroups; ++g) {
+        std::fill_n(lanes.data() + g * L, L, out[g]);
+    }
+    size_t i = 0;
+    for (; i + L <= num; i += L) {
+        for (size_t l = 0; l < L; ++l) {
+            T& acc = lanes[gids[i + l] * L + l];
+            acc    = op(acc, data[i + l]);
+        }
+    }
+    for (; i < num; ++i) {
+        T& acc = lanes[gids[i] * L];
+        acc    = op(acc, data[i]);
+    }
+    for (size_t g = 0; g < ngroups; ++g) {
+        T acc = lanes[g * L];
+        for (size_t l = 1; l < L; ++l) {
+            acc = op(acc, lanes[g * L + l]);
+        }
+        out[g] = acc;
+    }
+}
+
+template<typename T>
+void
+group_sum(const T* data, const uint32_t* gids, size_t num, size_t ngroups, T* out)
+{
+    std::fill_n(out, ngroups, static_cast<T>(0));
+    scatter_reduce(data, gids, num, ngroups, out, [](const T& a, const T& b) { return a + b; });
+}
+
+template<typename T>
+void
+group_min(const T* data, const uint32_t* gids, size_t num, size_t ngroups, T* out)
+{
+    std::fill_n(out, ngroups, std::numeric_limits<T>::max());
+    scatter_reduce(data, gids, num, ngroups, out, [](const T& a, const T& b) {
+        using std::min;
+        return min(a, b);
+    });
+}
+
+template<typename T>
+void
+group_max(const T* data, const uint32_t* gids, size_t num, size_t ngroups, T* out)
+{
+    std::fill_n(out, ngroups, std::numeric_limits<T>::lowest());
+    scatter_reduce(data, gids, num, ngroups, out, [](const T& a, const T& b) {
+        using std::max;
+        return max(a, b);
+    });
+}
+
+// counts[g] is the number of rows in group g
+template<typename T>
+void
+group_mean(const T* data, const uint32_t* gids, size_t num, size_t ngroups, const size_t* counts,
+    T* out)
+{
+    group_sum(data, gids, num, ngroups, out);
+    for (size_t g = 0; g < ngroups; ++g) {
+        if constexpr (std::is_arithmetic_v<T>) {
+            out[g] /= static_cast<T>(counts[g]);
+        }
+        else {
+            out[g] /= counts[g];
+        }
+    }
+}
+
+// One pass of Welford updates per group, with interleaved lanes for few
+// groups the same way as scatter_reduce()
+template<typename T>
+void
+group_moments(const T* data, const uint32_t* gids, size_t num, size_t ngroups, moments* out)
+{
+    constexpr size_t L = scatter_lanes;
+    std::fill_n(out, ngroups, moments{});
+    if (ngroups > scatter_lanes_max_groups || num < ngroups * L * 4) {
+        for (size_t i = 0; i < num; ++i) {
+            out[gids[i]].add(static_cast<double>(data[i]));
+        }
+        return;
+    }
+
+    std::vector<moments> lanes(ngroups * L);
+    size_t i = 0;
+    for (; i + L <= num; i += L) {
+        for (size_t l = 0; l < L; ++l) {
+            lanes[gids[i + l] * L + l].add(static_cast<double>(data[i + l]));
+        }
+    }
+    for (; i < num; ++i) {
+        lanes[gids[i] * L].add(static_cast<double>(data[i]));
+    }
+    for (size_t g = 0; g < ngroups; ++g) {
+        for (size_t l = 0; l < L; ++l) {
+            out[g].merge(lanes[g * L + l]);
+        }
+    }
+}
+
+// Population standard deviation. Arithmetic columns take a single Welford
+// pass in double; anything else two passes in T: means, then squared
+// distances
+template<typename T>
+void
+group_stddev(const T* data, const uint32_t* gids, size_t num, size_t ngroups,
+    const size_t* counts, T* out)
+{
+    if constexpr (std::is_arithmetic_v<T>) {
+        std::vector<moments> m(ngroups);
+        group_moments(data, gids, num, ngroups, m.data());
+        for (size_t g = 0; g < ngroups; ++g) {
+            out[g] = static_cast<T>(m[g].stddev());
+        }
+    }
+    else {
+        std::vector<T> means(ngroups);
+        group_mean(data, gids, num, ngroups, counts, means.data());
+        std::fill_n(out, ngroups, static_cast<T>(0));
+        for (size_t i = 0; i < num; ++i) {
+            const uint32_t g = gids[i];
+            T dist           = data[i] - means[g];
+            out[g] += dist * dist;
+        }
+        for (size_t g = 0; g < ngroups; ++g) {
+            out[g] = static_cast<T>(std::sqrt(out[g] / counts[g]));
+        }
+    }
+}
+
+// Run kernels, for when the rows of each group are contiguous: group r is
+// rows starts[r] .. starts[r + 1] - 1, so each group reduces over a
+// contiguous slice of the column with no group ids at all.
+
+template<typename T>
+void
+run_sum(const T* data, const size_t* starts, size_t nruns, T* out)
+{
+    for (size_t r = 0; r < nruns; ++r) {
+        T acc = static_cast<T>(0);
+        for (size_t i = starts[r]; i < starts[r + 1]; ++i) {
+            acc += data[i];
+        }
+        out[r] = acc;
+    }
+}
+
+template<typename T>
+void
+run_min(const T* data, const size_t* starts, size_t nruns, T* out)
+{
+    using std::min;
+    for (size_t r = 0; r < nruns; ++r) {
+        T acc = std::numeric_limits<T>::max();
+        for (size_t i = starts[r]; i < starts[r + 1]; ++i) {
+            acc = min(acc, data[i]);
+        }
+        out[r] = acc;
+    }
+}
+
+template<typename T>
+void
+run_max(const T* data, const size_t* starts, size_t nruns, T* out)
+{
+    using std::max;
+    for (size_t r = 0; r < nruns; ++r) {
+        T acc = std::numeric_limits<T>::lowest();
+        for (size_t i = starts[r]; i < starts[r + 1]; ++i) {
+            acc = max(acc, data[i]);
+        }
+        out[r] = acc;
+    }
+}
+
+template<typename T>
+void
+run_mean(const T* data, const size_t* starts, size_t nruns, T* out)
+{
+    run_sum(data, starts, nruns, out);
+    for (size_t r = 0; r < nruns; ++r) {
+        const size_t count = starts[r + 1] - starts[r];
+        if constexpr (std::is_arithmetic_v<T>) {
+            out[r] /= static_cast<T>(count);
+        }
+        else {
+            out[r] /= count;
+        }
+    }
+}
+
+template<typename T>
+void
+run_stddev(const T* data, const size_t* starts, size_t nruns, T* out)
+{
+    if constexpr (std::is_arithmetic_v<T>) {
+        for (size_t r = 0; r < nruns; ++r) {
+            const size_t count = starts[r + 1] - starts[r];
+            out[r] = static_cast<T>(column_moments(data + starts[r], count).stddev());
+        }
+    }
+    else {
+        run_mean(data, starts, nruns, out);
+        for (size_t r = 0; r < nruns; ++r) {
+            const T mean = out[r];
+            T sqdist     = static_cast<T>(0);
+            for (size_t i = starts[r]; i < starts[r + 1]; ++i) {
+                T dist = data[i] - mean;
+                sqdist += dist * dist;
+            }
+            const size_t count = starts[r + 1] - starts[r];
+            out[r]             = static_cast<T>(std::sqrt(sqdist / count));
+        }
+    }
+}
+
+// The q-quantile of values[0] .. values[num - 1], interpolated linearly
+// between the two nearest ranks. The values are partially reordered, not
+// sorted: nth_element() finds the lower rank and the upper one is the
+// smallest value above it.
+template<typename T>
+double
+select_quantile(T* values, size_t num, double q)
+{
+    const double pos  = q * static_cast<double>(num - 1);
+    const size_t lo   = static_cast<size_t>(pos);
+    const double frac = pos - static_cast<double>(lo);
+    std::nth_element(values, values + lo, values + num);
+    double v = static_cast<double>(values[lo]);
+    if (frac > 0.0 && lo + 1 < num) {
+        double next = static_cast<double>(*std::min_element(values + lo + 1, values + num));
+        v += (next - v) * frac;
+    }
+    return v;
+}
+
+// The type of a quantile of values of type T: quantiles of integers fall
+// between them, so they're doubles, as from series::quantile()
+template<typename T>
+struct quantile_result
+{
+    using type = std::conditional_t<std::is_integral_v<T>, double, T>;
+};
+
+template<typename T>
+struct quantile_result<mi<T>>
+{
+    using type = mi<typename quantile_result<T>::type>;
+};
+
+// out[g] is the q-quantile of values[offsets[g]] .. values[offsets[g + 1] - 1].
+// Empty slices are left alone
+template<typename T, typename U>
+void
+slice_quantile(T* values, const size_t* offsets, size_t ngroups, double q, U* out)
+{
+    for (size_t g = 0; g < ngroups; ++g) {
+        const size_t num = offsets[g + 1] - offsets[g];
+        if (num > 0) {
+            out[g] = static_cast<U>(select_quantile(values + offsets[g], num, q));
+        }
+    }
+}
+
+// Selection needs each group's values together, so the column is partitioned
+// into group order in one counting pass first
+template<typename T, typename U>
+void
+group_quantile(const T* data, const uint32_t* gids, size_t num, size_t ngroups,
+    const size_t* counts, double q, U* out)
+{
+    std::vector<size_t> offsets(ngroups + 1, 0);
+    for (size_t g = 0; g < ngroups; ++g) {
+        offsets[g + 1] = offsets[g] + counts[g];
+    }
+    std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+    std::vector<T> values(num);
+    for (size_t i = 0; i < num; ++i) {
+        values[cursor[gids[i]]++] = data[i];
+    }
+    slice_quantile(values.data(), offsets.data(), ngroups, q, out);
+}
+
+template<typename T, typename U>
+void
+run_quantile(const T* data, const size_t* starts, size_t nruns, double q, U* out)
+{
+    std::vector<T> values(data, data + starts[nruns]);
+    slice_quantile(values.data(), starts, nruns, q, out);
+}
+
+// The value from each group's first row. The rows are walked backwards so the
+// last write to each group is its first row, and only row numbers are written
+// until the end. Groups with no rows are left alone
+template<typename T>
+void
+group_first(const T* data, const uint32_t* gids, size_t num, size_t ngroups, T* out)
+{
+    std::vector<size_t> rows(ngroups, num);
+    for (size_t i = num; i-- > 0;) {
+        rows[gids[i]] = i;
+    }
+    for (size_t g = 0; g < ngroups; ++g) {
+        if (rows[g] < num) {
+            out[g] = data[rows[g]];
+        }
+    }
+}
+
+template<typename T>
+void
+group_last(const T* data, const uint32_t* gids, size_t num, size_t ngroups, T* out)
+{
+    std::vector<size_t> rows(ngroups, num);
+    for (size_t i = 0; i < num; ++i) {
+        rows[gids[i]] = i;
+    }
+    for (size_t g = 0; g < ngroups; ++g) {
+        if (rows[g] < num) {
+            out[g] = data[rows[g]];
+        }
+    }
+}
+
+// rows[g] is the first row holding group g's smallest value
+template<typename T>
+void
+group_argmin(const T* data, const uint32_t* gids, size_t num, size_t ngroups, size_t* rows)
+{
+    std::vector<bool> seen(ngroups, false);
+    for (size_t i = 0; i < num; ++i) {
+        const uint32_t g = gids[i];
+        if (!seen[g] || data[i] < data[rows[g]]) {
+            rows[g] = i;
+            seen[g] = true;
+        }
+    }
+}
+
+// rows[g] is the first row holding group g's largest value
+template<typename T>
+void
+group_argmax(const T* data, const uint32_t* gids, size_t num, size_t ngroups, size_t* rows)
+{
+    std::vector<bool> seen(ngroups, false);
+    for (size_t i = 0; i < num; ++i) {
+        const uint32_t g = gids[i];
+        if (!seen[g] || data[rows[g]] < data[i]) {
+            rows[g] = i;
+            seen[g] = true;
+        }
+    }
+}
+
+// The number of distinct values in each group, in one pass: every
+// (group, value) pair is numbered with a flat_index, and each pair's first
+// row counts towards its group
+template<typename T>
+void
+group_count_distinct(const T* data, const uint32_t* gids, size_t num, size_t ngroups, size_t* out)
+{
+    std::vector<uint64_t> hashes(num);
+    for (size_t i = 0; i < num; ++i) {
+        hashes[i] = hash_combine(hash_combine(hash_seed, gids[i]), hash_bits(data[i]));
+    }
+    flat_index pairs;
+    pairs.build(hashes.data(), num,
+        [&](size_t a, size_t b) { return gids[a] == gids[b] && data[a] == data[b]; });
+    std::fill_n(out, ngroups, size_t{ 0 });
+    for (uint32_t p = 0; p < pairs.num_groups(); ++p) {
+        out[gids[pairs.first_row(p)]]++;
+    }
+}
+
+// Copy the present values of a column of mi<T> to values, and their group ids
+// to vgids (and their row numbers to vrows, if it isn't null), returning how
+// many there were. Every row is written and the write position only moves on
+// past a present value, so there's no branch on the data and the kernels
+// above can then run over the plain values. The outputs must have room for
+// num rows
+template<typename T>
+size_t
+compact_present(const mi<T>* data, const uint32_t* gids, size_t num, T* values,
+    uint32_t* vgids, size_t* vrows)
+{
+    size_t k = 0;
+    for (size_t i = 0; i < num; ++i) {
+        const bool present = data[i].has_value();
+        values[k]          = present ? *data[i] : T{};
+        vgids[k]           = gids[i];
+        if (vrows != nullptr) {
+            vrows[k] = i;
+        }
+        k += present ? 1 : 0;
+    }
+    return k;
+}
+
+inline void
+group_count(const uint32_t* gids, size_t num, size_t ngroups, size_t* out)
+{
+    std::fill_n(out, ngroups, size_t{ 0 });
+    for (size_t i = 0; i < num; ++i) {
+        out[gids[i]]++;
+    }
+}
+
+} // namespace mf::detail
+
+#endif // INCLUDED_mainframe_detail_aggregate_h
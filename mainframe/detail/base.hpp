@@ -306,6 +306,18 @@ struct is_equality_comparable<T, U, std::void_t<equality_comparison_t<T, U>>>
     : std::is_same<equality_comparison_t<T, U>, bool>
 {};
 
+template<typename T, typename U>
+using less_comparison_t = decltype(std::declval<T&>() < std::declval<U&>());
+
+template<typename T, typename U = T, typename = void>
+struct is_less_comparable : std::false_type
+{};
+
+template<typename T, typename U>
+struct is_less_comparable<T, U, std::void_t<less_comparison_t<T, U>>>
+    : std::is_convertible<less_comparison_t<T, U>, bool>
+{};
+
 template<typename Func>
 struct get_return_type;
 
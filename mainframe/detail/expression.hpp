@@ -6,9 +6,17 @@
 #ifndef INCLUDED_mainframe_detail_expression_hpp
 #define INCLUDED_mainframe_detail_expression_hpp
 
+#include <algorithm>
+#include <array>
 #include <complex>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
+#include "mainframe/detail/window.hpp"
 #include "mainframe/frame_iterator.hpp"
 #include "mainframe/series.hpp"
 
@@ -179,6 +187,9 @@ struct binary_expr;
 template<typename Func, typename... As>
 struct func_expr;
 
+template<typename Kernel, typename A>
+struct window_expr;
+
 template<typename T>
 struct is_complex_expression : std::false_type
 {};
@@ -195,6 +206,10 @@ template<typename Func, typename... As>
 struct is_complex_expression<func_expr<Func, As...>> : std::true_type
 {};
 
+template<typename Kernel, typename A>
+struct is_complex_expression<window_expr<Kernel, A>> : std::true_type
+{};
+
 template<size_t Ind>
 struct indexed_expr_column;
 
@@ -239,6 +254,25 @@ struct expr_column
     _empty_byte _eb;
 };
 
+// A frame iterator for evaluating an expression at rows where every offset
+// column reference (_1[-1] and the like) is known to land inside the frame,
+// so they can read straight from the column with no bounds check and no
+// mi<T> wrapping. Nothing else treats it differently. See evaluate_rows()
+template<bool IsConst, bool IsReverse, typename... Ts>
+class unguarded_frame_iterator : public base_frame_iterator<IsConst, IsReverse, Ts...>
+{
+public:
+    explicit unguarded_frame_iterator(const base_frame_iterator<IsConst, IsReverse, Ts...>& it)
+        : base_frame_iterator<IsConst, IsReverse, Ts...>(it)
+    {}
+
+    const base_frame_iterator<IsConst, IsReverse, Ts...>&
+    guarded() const
+    {
+        return *this;
+    }
+};
+
 template<size_t Ind>
 struct indexed_expr_column
 {
@@ -275,6 +309,16 @@ struct indexed_expr_column
         }
     }
 
+    template<bool IsConst, bool IsReverse, typename... Ts>
+    typename detail::pack_element<Ind, Ts...>::type
+    operator()(const unguarded_frame_iterator<IsConst, IsReverse, Ts...>&,
+        const unguarded_frame_iterator<IsConst, IsReverse, Ts...>& curr,
+        const unguarded_frame_iterator<IsConst, IsReverse, Ts...>&) const
+    {
+        columnindex<Ind> ci;
+        return curr->data(ci)[IsReverse ? -offset : offset];
+    }
+
     ptrdiff_t offset{ 0 };
 };
 
@@ -312,7 +356,7 @@ struct terminal<indexed_expr_column<Ind>>
 
     template<template<bool, bool, typename...> typename Iter, bool IsConst, bool IsReverse,
         typename... Ts>
-    typename detail::ensure_missing<typename detail::pack_element<Ind, Ts...>::type>::type
+    auto
     operator()(const Iter<IsConst, IsReverse, Ts...>& begin,
         const Iter<IsConst, IsReverse, Ts...>& curr,
         const Iter<IsConst, IsReverse, Ts...>& end) const
@@ -513,6 +557,68 @@ struct func_expr
     std::tuple<As...> args;
 };
 
+// A statistic over the values of an expression in row order, with Kernel one
+// of the whole-column kernels in window.hpp - a rolling window or an
+// exponentially weighted mean, say. Expressions are evaluated a row at a time,
+// but these depend on the rows before, so the first row evaluates the argument
+// over the whole frame, runs the kernel once and keeps the results; every row
+// is then a lookup. The results are made again when evaluation starts over
+// from the first row or the frame's length changes
+template<typename Kernel, typename A>
+struct window_expr
+{
+    using is_expr = void;
+    static_assert(is_expression<A>::value, "rolling expression must contain expression");
+
+    window_expr(A _arg, Kernel _kernel)
+        : arg(_arg)
+        , kernel(_kernel)
+    {}
+
+    template<typename Iter>
+    using value_type = std::decay_t<decltype(std::declval<const A&>()(
+        std::declval<const Iter&>(), std::declval<const Iter&>(), std::declval<const Iter&>()))>;
+
+    template<typename Iter>
+    using result_type = typename Kernel::template result_type<value_type<Iter>>;
+
+    template<template<bool, bool, typename...> typename Iter, bool IsConst, bool IsReverse,
+        typename... Ts>
+    result_type<Iter<IsConst, IsReverse, Ts...>>
+    operator()(const Iter<IsConst, IsReverse, Ts...>& begin,
+        const Iter<IsConst, IsReverse, Ts...>& curr,
+        const Iter<IsConst, IsReverse, Ts...>& end) const
+    {
+        using R         = result_type<Iter<IsConst, IsReverse, Ts...>>;
+        const auto num  = static_cast<size_t>(end - begin);
+        auto results    = std::static_pointer_cast<std::vector<R>>(cache);
+        if (curr == begin || !results || results->size() != num) {
+            std::vector<value_type<Iter<IsConst, IsReverse, Ts...>>> values(num);
+            for (size_t i = 0; i < num; ++i) {
+                values[i] = arg(begin, begin + i, end);
+            }
+            results = std::make_shared<std::vector<R>>(num);
+            kernel(values.data(), num, results->data());
+            cache = results;
+        }
+        return (*results)[static_cast<size_t>(curr - begin)];
+    }
+
+    // The argument is evaluated over the whole frame, ends included
+    template<bool IsConst, bool IsReverse, typename... Ts>
+    auto
+    operator()(const unguarded_frame_iterator<IsConst, IsReverse, Ts...>& begin,
+        const unguarded_frame_iterator<IsConst, IsReverse, Ts...>& curr,
+        const unguarded_frame_iterator<IsConst, IsReverse, Ts...>& end) const
+    {
+        return operator()(begin.guarded(), curr.guarded(), end.guarded());
+    }
+
+    A arg;
+    Kernel kernel;
+    mutable std::shared_ptr<void> cache;
+};
+
 // If T is terminal<U>, unary_expr<Op,U> or binary_expr<Op,L,R>, just return T.
 // If T is any other type, return terminal<T>
 template<typename T>
@@ -576,6 +682,296 @@ struct maybe_wrap<func_expr<Func, As...>>
     }
 };
 
+template<typename Kernel, typename A>
+struct maybe_wrap<window_expr<Kernel, A>>
+{
+    maybe_wrap() = delete;
+    using type   = window_expr<Kernel, A>;
+    static type
+    wrap(const window_expr<Kernel, A>& t)
+    {
+        return t;
+    }
+};
+
+// The rows an expression reads, relative to the row it's evaluated at:
+// lo <= 0 <= hi, widened by each offset column reference in it
+struct expr_reach
+{
+    ptrdiff_t lo{ 0 };
+    ptrdiff_t hi{ 0 };
+};
+
+template<typename T>
+void
+find_reach(const T&, expr_reach&)
+{}
+
+template<size_t Ind>
+void
+find_reach(const terminal<indexed_expr_column<Ind>>& ex, expr_reach& reach)
+{
+    reach.lo = std::min(reach.lo, ex.t.offset);
+    reach.hi = std::max(reach.hi, ex.t.offset);
+}
+
+template<typename Op, typename T>
+void
+find_reach(const unary_expr<Op, T>& ex, expr_reach& reach)
+{
+    find_reach(ex.t, reach);
+}
+
+template<typename Op, typename L, typename R>
+void
+find_reach(const binary_expr<Op, L, R>& ex, expr_reach& reach)
+{
+    find_reach(ex.l, reach);
+    find_reach(ex.r, reach);
+}
+
+template<typename Func, typename... As>
+void
+find_reach(const func_expr<Func, As...>& ex, expr_reach& reach)
+{
+    std::apply([&reach](const As&... args) { (find_reach(args, reach), ...); }, ex.args);
+}
+
+// Whether an expression's value at a row depends on that row alone, so it can
+// be evaluated over any subset of a frame's rows: no offset column references,
+// row numbers, frame lengths or windows. Anything that isn't one of the
+// expression types here (a lambda, say) might not be
+template<typename T>
+struct is_row_local : std::false_type
+{};
+
+template<typename T>
+struct is_row_local<terminal<T>> : std::true_type
+{};
+
+template<size_t Ind>
+struct is_row_local<terminal<indexed_expr_column<Ind>>> : std::false_type
+{};
+
+template<>
+struct is_row_local<terminal<row_number>> : std::false_type
+{};
+
+template<>
+struct is_row_local<terminal<frame_length>> : std::false_type
+{};
+
+template<typename Op, typename T>
+struct is_row_local<unary_expr<Op, T>> : is_row_local<T>
+{};
+
+template<typename Op, typename L, typename R>
+struct is_row_local<binary_expr<Op, L, R>> : std::conjunction<is_row_local<L>, is_row_local<R>>
+{};
+
+template<typename Func, typename... As>
+struct is_row_local<func_expr<Func, As...>> : std::conjunction<is_row_local<As>...>
+{};
+
+// Sets used[I] for every column I that an expression reads
+template<typename T>
+struct expr_columns
+{
+    template<size_t N>
+    static constexpr void
+    mark(std::array<bool, N>&)
+    {}
+};
+
+template<size_t Ind>
+struct expr_columns<terminal<expr_column<Ind>>>
+{
+    template<size_t N>
+    static constexpr void
+    mark(std::array<bool, N>& used)
+    {
+        used[Ind] = true;
+    }
+};
+
+template<size_t Ind>
+struct expr_columns<terminal<indexed_expr_column<Ind>>>
+    : expr_columns<terminal<expr_column<Ind>>>
+{};
+
+template<typename Op, typename T>
+struct expr_columns<unary_expr<Op, T>> : expr_columns<T>
+{};
+
+template<typename Op, typename L, typename R>
+struct expr_columns<binary_expr<Op, L, R>>
+{
+    template<size_t N>
+    static constexpr void
+    mark(std::array<bool, N>& used)
+    {
+        expr_columns<L>::mark(used);
+        expr_columns<R>::mark(used);
+    }
+};
+
+template<typename Func, typename... As>
+struct expr_columns<func_expr<Func, As...>>
+{
+    template<size_t N>
+    static constexpr void
+    mark(std::array<bool, N>& used)
+    {
+        (expr_columns<As>::mark(used), ...);
+    }
+};
+
+template<typename Kernel, typename A>
+struct expr_columns<window_expr<Kernel, A>> : expr_columns<A>
+{};
+
+// Where column Ind is among columns Cols, which must include it
+template<size_t Ind, size_t... Cols>
+constexpr size_t
+column_position()
+{
+    constexpr std::array<size_t, sizeof...(Cols)> cols{ Cols... };
+    size_t pos = 0;
+    while (cols[pos] != Ind) {
+        ++pos;
+    }
+    return pos;
+}
+
+// The same expression over a frame made of just the columns Cols, in that
+// order - each column reference I becomes column_position<I, Cols...>()
+template<typename T, size_t... Cols>
+terminal<T>
+relabel_columns(const terminal<T>& ex, std::index_sequence<Cols...>)
+{
+    return ex;
+}
+
+template<size_t Ind, size_t... Cols>
+terminal<expr_column<column_position<Ind, Cols...>()>>
+relabel_columns(const terminal<expr_column<Ind>>&, std::index_sequence<Cols...>)
+{
+    return {};
+}
+
+template<size_t Ind, size_t... Cols>
+terminal<indexed_expr_column<column_position<Ind, Cols...>()>>
+relabel_columns(const terminal<indexed_expr_column<Ind>>& ex, std::index_sequence<Cols...>)
+{
+    constexpr size_t pos = column_position<Ind, Cols...>();
+    return terminal<indexed_expr_column<pos>>{ indexed_expr_column<pos>{ ex.t.offset } };
+}
+
+template<typename Op, typename T, size_t... Cols>
+auto
+relabel_columns(const unary_expr<Op, T>& ex, std::index_sequence<Cols...> cols)
+{
+    auto t = relabel_columns(ex.t, cols);
+    return unary_expr<Op, decltype(t)>{ t };
+}
+
+template<typename Op, typename L, typename R, size_t... Cols>
+auto
+relabel_columns(const binary_expr<Op, L, R>& ex, std::index_sequence<Cols...> cols)
+{
+    auto l = relabel_columns(ex.l, cols);
+    auto r = relabel_columns(ex.r, cols);
+    return binary_expr<Op, decltype(l), decltype(r)>{ l, r };
+}
+
+template<typename Func, typename... As, size_t... Cols>
+auto
+relabel_columns(const func_expr<Func, As...>& ex, std::index_sequence<Cols...> cols)
+{
+    return std::apply(
+        [&ex, cols](const As&... args) {
+            return func_expr<Func, decltype(relabel_columns(args, cols))...>(
+                *ex.func, relabel_columns(args, cols)...);
+        },
+        ex.args);
+}
+
+template<typename Kernel, typename A, size_t... Cols>
+auto
+relabel_columns(const window_expr<Kernel, A>& ex, std::index_sequence<Cols...> cols)
+{
+    auto arg = relabel_columns(ex.arg, cols);
+    return window_expr<Kernel, decltype(arg)>{ arg, ex.kernel };
+}
+
+// Whether find_reach() sees every row an expression can read: true for trees
+// made only of the expression types here. Anything else - a lambda, say -
+// could read any row, and is never given an unguarded_frame_iterator
+template<typename T>
+struct has_known_reach : std::false_type
+{};
+
+template<typename T>
+struct has_known_reach<terminal<T>> : std::true_type
+{};
+
+template<typename Op, typename T>
+struct has_known_reach<unary_expr<Op, T>> : has_known_reach<T>
+{};
+
+template<typename Op, typename L, typename R>
+struct has_known_reach<binary_expr<Op, L, R>>
+    : std::conjunction<has_known_reach<L>, has_known_reach<R>>
+{};
+
+template<typename Func, typename... As>
+struct has_known_reach<func_expr<Func, As...>> : std::conjunction<has_known_reach<As>...>
+{};
+
+// A window_expr evaluates its argument with guarded iterators itself
+template<typename Kernel, typename A>
+struct has_known_reach<window_expr<Kernel, A>> : std::true_type
+{};
+
+// Evaluate expr at each row from begin to end in order, passing each value to
+// fn. The rows at either end where an offset column reference could fall
+// outside the frame are evaluated as usual, and the rows between them with
+// unguarded_frame_iterator. An expr without a known reach is evaluated as
+// usual at every row
+template<typename Ex, typename Fn, bool IsConst, bool IsReverse, typename... Ts>
+void
+evaluate_rows(const Ex& expr, const base_frame_iterator<IsConst, IsReverse, Ts...>& begin,
+    const base_frame_iterator<IsConst, IsReverse, Ts...>& end, Fn fn)
+{
+    if constexpr (!has_known_reach<Ex>::value) {
+        for (auto it = begin; it != end; ++it) {
+            fn(expr(begin, it, end));
+        }
+    }
+    else {
+        expr_reach reach;
+        find_reach(expr, reach);
+        const ptrdiff_t num  = end - begin;
+        const ptrdiff_t head = std::min(-reach.lo, num);
+        const ptrdiff_t tail = std::max(head, num - reach.hi);
+
+        auto it = begin;
+        for (ptrdiff_t i = 0; i < head; ++i, ++it) {
+            fn(expr(begin, it, end));
+        }
+        unguarded_frame_iterator<IsConst, IsReverse, Ts...> ubegin{ begin };
+        unguarded_frame_iterator<IsConst, IsReverse, Ts...> uend{ end };
+        unguarded_frame_iterator<IsConst, IsReverse, Ts...> uit{ it };
+        for (ptrdiff_t i = head; i < tail; ++i, ++uit) {
+            fn(expr(ubegin, uit, uend));
+        }
+        it += tail - head;
+        for (ptrdiff_t i = tail; i < num; ++i, ++it) {
+            fn(expr(begin, it, end));
+        }
+    }
+}
+
 template<typename Op, typename T>
 struct make_unary_expr
 {
@@ -604,6 +1000,28 @@ struct make_binary_expr
     }
 };
 
+template<typename Kernel, typename Arg>
+struct make_window_expr
+{
+    make_window_expr() = delete;
+    using type         = window_expr<Kernel, typename maybe_wrap<Arg>::type>;
+
+    static type
+    create(const Arg& arg, Kernel kernel)
+    {
+        type out{ maybe_wrap<Arg>::wrap(arg), kernel };
+        return out;
+    }
+};
+
+inline void
+check_window(size_t window)
+{
+    if (window == 0) {
+        throw std::invalid_argument{ "window must be at least 1" };
+    }
+}
+
 template<typename Func, typename... Args>
 struct make_func_expr
 {
@@ -715,6 +1133,116 @@ typename make_func_expr<std::complex<T>(const T&, const T&), Arg1, Arg2>::type c
     return make_func_expr<std::complex<T>(const T&, const T&), Arg1, Arg2>::create( mkcomplex, r, i );
 }
 
+///
+/// rolling window functions
+///
+/// rolling_sum, rolling_mean, rolling_std, rolling_min and rolling_max give,
+/// for each row, the sum, mean, population standard deviation, smallest or
+/// largest value of an expression over that row and up to window - 1 rows
+/// before it. The first few windows are short, and the mean and standard
+/// deviation of integers are doubles. A window holding a missing value or a
+/// NaN gives missing or NaN, until that value leaves it. Each takes constant
+/// time per row, so the window can be as wide as the frame. For example:
+///
+///     frame<double> f1;
+///     f1.set_column_names("price");
+///     f1.push_back(1.0);
+///     f1.push_back(2.0);
+///     f1.push_back(6.0);
+///     f1.push_back(3.0);
+///     auto f2 = f1.append_column<double>("avg", rolling_mean(_0, 2));
+///     auto f3 = f1.append_column<double>("dev", _0 - rolling_mean(_0, 3));
+///
+///     // f2 is now
+///     //   | price | avg
+///     // __|_______|_____
+///     //  0|     1 |   1
+///     //  1|     2 | 1.5
+///     //  2|     6 |   4
+///     //  3|     3 | 4.5
+///
+template<typename Arg>
+typename make_window_expr<detail::rolling_sum_kernel, Arg>::type
+rolling_sum(Arg arg, size_t window)
+{
+    check_window(window);
+    return make_window_expr<detail::rolling_sum_kernel, Arg>::create(arg, { window });
+}
+
+template<typename Arg>
+typename make_window_expr<detail::rolling_mean_kernel, Arg>::type
+rolling_mean(Arg arg, size_t window)
+{
+    check_window(window);
+    return make_window_expr<detail::rolling_mean_kernel, Arg>::create(arg, { window });
+}
+
+template<typename Arg>
+typename make_window_expr<detail::rolling_std_kernel, Arg>::type
+rolling_std(Arg arg, size_t window)
+{
+    check_window(window);
+    return make_window_expr<detail::rolling_std_kernel, Arg>::create(arg, { window });
+}
+
+template<typename Arg>
+typename make_window_expr<detail::rolling_min_kernel, Arg>::type
+rolling_min(Arg arg, size_t window)
+{
+    check_window(window);
+    return make_window_expr<detail::rolling_min_kernel, Arg>::create(arg, { window });
+}
+
+template<typename Arg>
+typename make_window_expr<detail::rolling_max_kernel, Arg>::type
+rolling_max(Arg arg, size_t window)
+{
+    check_window(window);
+    return make_window_expr<detail::rolling_max_kernel, Arg>::create(arg, { window });
+}
+
+///
+/// exponentially weighted functions
+///
+/// ewm_mean and ewm_var give, for each row, the mean and (bias-corrected)
+/// variance of an expression over that row and all the rows before it, with
+/// each row weighted by (1 - alpha)^age. alpha is the smoothing factor,
+/// 0 < alpha <= 1. With adjust set (the default) the weights are normalized
+/// over the rows seen so far; with it cleared the mean is the recursion
+/// y = (1 - alpha) * y' + alpha * x. Missing values are skipped but still age
+/// the rows before them; rows where the statistic isn't defined yet are
+/// missing. Both take a single pass over the frame. For example:
+///
+///     frame<double> f1;
+///     f1.set_column_names("price");
+///     f1.push_back(1.0);
+///     f1.push_back(2.0);
+///     f1.push_back(4.0);
+///     auto f2 = f1.append_column<double>("ewma", ewm_mean(_0, 0.5, false));
+///
+///     // f2 is now
+///     //   | price | ewma
+///     // __|_______|______
+///     //  0|     1 |    1
+///     //  1|     2 |  1.5
+///     //  2|     4 | 2.75
+///
+template<typename Arg>
+typename make_window_expr<detail::ewm_mean_kernel, Arg>::type
+ewm_mean(Arg arg, double alpha, bool adjust = true)
+{
+    detail::check_ewm_alpha(alpha);
+    return make_window_expr<detail::ewm_mean_kernel, Arg>::create(arg, { alpha, adjust });
+}
+
+template<typename Arg>
+typename make_window_expr<detail::ewm_var_kernel, Arg>::type
+ewm_var(Arg arg, double alpha, bool adjust = true)
+{
+    detail::check_ewm_alpha(alpha);
+    return make_window_expr<detail::ewm_var_kernel, Arg>::create(arg, { alpha, adjust });
+}
+
 } // namespace function
 
 
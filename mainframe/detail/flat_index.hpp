@@ -0,0 +1,276 @@
+//          Copyright Ted Middleton 2022.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef INCLUDED_mainframe_detail_flat_index_h
+#define INCLUDED_mainframe_detail_flat_index_h
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace mf::detail
+{
+
+// A contiguous run of row indices - the rows of one group in a flat_index
+struct row_range
+{
+    const size_t*
+    begin() const
+    {
+        return b;
+    }
+
+    const size_t*
+    end() const
+    {
+        return e;
+    }
+
+    size_t
+    size() const
+    {
+        return static_cast<size_t>(e - b);
+    }
+
+    const size_t* b;
+    const size_t* e;
+};
+
+// Maps the rows of a frame to dense group ids by key, and the group ids back
+// to their rows.
+//
+// The hash table is open-addressed with linear probing and holds only group
+// ids; the hash and first row of each group live in arrays indexed by group
+// id, so growing the table never touches the keys. Key equality is left to
+// the caller, which compares rows by index. Once every row has a group id,
+// build_rows() lays the row lists out CSR-style: the rows of group g are
+// rows()[offsets[g]] .. rows()[offsets[g + 1]], in ascending row order, built
+// with one counting pass and one fill pass.
+//
+// Group ids are handed out in first-seen order.
+class flat_index
+{
+public:
+    static constexpr uint32_t npos_group = std::numeric_limits<uint32_t>::max();
+
+    // Give each of num rows a group id. hashes[i] is the hash of row i's key
+    // and eq(a, b) compares the keys of rows a and b
+    template<typename Eq>
+    void
+    build(const uint64_t* hashes, size_t num, Eq eq)
+    {
+        clear();
+        m_built = true;
+        m_slots.assign(16, 0);
+        m_row_group.resize(num);
+
+        for (size_t i = 0; i < num; ++i) {
+            m_row_group[i] =
+                find_or_add(hashes[i], i, [&](size_t first) { return eq(first, i); });
+        }
+    }
+
+    // The group whose key has hash h and for which eq(first_row) is true. If
+    // there isn't one, a new group is added with row as its first row. Unlike
+    // build(), this doesn't record any row's group, so it can keep a set of
+    // keys up to date one key at a time
+    template<typename Eq>
+    uint32_t
+    find_or_add(uint64_t h, size_t row, Eq eq)
+    {
+        if (m_slots.empty()) {
+            m_built = true;
+            m_slots.assign(16, 0);
+        }
+        size_t mask = m_slots.size() - 1;
+        size_t slot = static_cast<size_t>(h) & mask;
+        for (;;) {
+            uint32_t s = m_slots[slot];
+            if (s == 0) {
+                const auto g = static_cast<uint32_t>(m_group_hash.size());
+                m_group_hash.push_back(h);
+                m_group_first.push_back(row);
+                m_slots[slot] = g + 1;
+                if (m_group_hash.size() * 2 > m_slots.size()) {
+                    grow();
+                }
+                return g;
+            }
+            uint32_t g = s - 1;
+            if (m_group_hash[g] == h && eq(m_group_first[g])) {
+                return g;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    // Take group ids that were worked out elsewhere: codes[i] is row i's group,
+    // firsts[g] the first row of group g and hashes[g] its key's hash
+    void
+    assign(std::vector<uint32_t> codes, std::vector<size_t> firsts, std::vector<uint64_t> hashes)
+    {
+        clear();
+        m_built = true;
+        size_t cap = 16;
+        while (cap < hashes.size() * 2) {
+            cap *= 2;
+        }
+        m_slots.assign(cap, 0);
+        m_row_group.swap(codes);
+        m_group_first.swap(firsts);
+        m_group_hash.swap(hashes);
+        size_t mask = m_slots.size() - 1;
+        for (size_t g = 0; g < m_group_hash.size(); ++g) {
+            size_t slot = static_cast<size_t>(m_group_hash[g]) & mask;
+            while (m_slots[slot] != 0) {
+                slot = (slot + 1) & mask;
+            }
+            m_slots[slot] = static_cast<uint32_t>(g + 1);
+        }
+    }
+
+    // Lay out the row lists, CSR-style. This is needed before rows() and
+    // offsets() can be used
+    void
+    build_rows()
+    {
+        const size_t num = m_row_group.size();
+        m_offsets.assign(m_group_hash.size() + 1, 0);
+        for (uint32_t g : m_row_group) {
+            m_offsets[g + 1]++;
+        }
+        for (size_t g = 0; g < m_group_hash.size(); ++g) {
+            m_offsets[g + 1] += m_offsets[g];
+        }
+        m_rows.resize(num);
+        std::vector<size_t> cursor(m_offsets.begin(), m_offsets.end() - 1);
+        for (size_t i = 0; i < num; ++i) {
+            m_rows[cursor[m_row_group[i]]++] = i;
+        }
+    }
+
+    // The group whose key has hash h and for which eq(first_row) is true, or
+    // npos_group
+    template<typename Eq>
+    uint32_t
+    find(uint64_t h, Eq eq) const
+    {
+        if (m_slots.empty()) {
+            return npos_group;
+        }
+        size_t mask = m_slots.size() - 1;
+        size_t slot = static_cast<size_t>(h) & mask;
+        for (;;) {
+            uint32_t s = m_slots[slot];
+            if (s == 0) {
+                return npos_group;
+            }
+            uint32_t g = s - 1;
+            if (m_group_hash[g] == h && eq(m_group_first[g])) {
+                return g;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    bool
+    built() const
+    {
+        return m_built;
+    }
+
+    void
+    clear()
+    {
+        m_built = false;
+        m_slots.clear();
+        m_group_hash.clear();
+        m_group_first.clear();
+        m_row_group.clear();
+        m_offsets.clear();
+        m_rows.clear();
+    }
+
+    size_t
+    num_groups() const
+    {
+        return m_group_hash.size();
+    }
+
+    size_t
+    num_rows() const
+    {
+        return m_row_group.size();
+    }
+
+    size_t
+    first_row(uint32_t g) const
+    {
+        return m_group_first[g];
+    }
+
+    uint64_t
+    group_hash(uint32_t g) const
+    {
+        return m_group_hash[g];
+    }
+
+    row_range
+    rows(uint32_t g) const
+    {
+        return row_range{ m_rows.data() + m_offsets[g], m_rows.data() + m_offsets[g + 1] };
+    }
+
+    // Group id of every row
+    const std::vector<uint32_t>&
+    row_groups() const
+    {
+        return m_row_group;
+    }
+
+    std::vector<uint32_t>
+    release_row_groups()
+    {
+        std::vector<uint32_t> out;
+        out.swap(m_row_group);
+        clear();
+        return out;
+    }
+
+    // CSR offsets, num_groups() + 1 of them
+    const std::vector<size_t>&
+    offsets() const
+    {
+        return m_offsets;
+    }
+
+private:
+    void
+    grow()
+    {
+        std::vector<uint32_t> slots(m_slots.size() * 2, 0);
+        size_t mask = slots.size() - 1;
+        for (size_t g = 0; g < m_group_hash.size(); ++g) {
+            size_t slot = static_cast<size_t>(m_group_hash[g]) & mask;
+            while (slots[slot] != 0) {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot] = static_cast<uint32_t>(g + 1);
+        }
+        m_slots.swap(slots);
+    }
+
+    bool m_built{ false };
+    std::vector<uint32_t> m_slots;
+    std::vector<uint64_t> m_group_hash;
+    std::vector<size_t> m_group_first;
+    std::vector<uint32_t> m_row_group;
+    std::vector<size_t> m_offsets;
+    std::vector<size_t> m_rows;
+};
+
+} // namespace mf::detail
+
+#endif // INCLUDED_mainframe_detail_flat_index_h
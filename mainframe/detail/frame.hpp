@@ -10,8 +10,10 @@
 #include <array>
 #include <cmath>
 #include <iomanip>
+#include <limits>
 #include <list>
 #include <memory>
+#include <numeric>
 #include <ostream>
 #include <sstream>
 #include <stdexcept>
@@ -22,6 +24,8 @@
 #include <vector>
 
 #include "mainframe/detail/base.hpp"
+#include "mainframe/detail/flat_index.hpp"
+#include "mainframe/detail/hash.hpp"
 #include "mainframe/expression.hpp"
 #include "mainframe/frame_iterator.hpp"
 #include "mainframe/missing.hpp"
@@ -253,6 +257,193 @@ struct build_gt<Row, Ind>
     };
 };
 
+// Row index that take_rows() turns into a default-constructed row. Joins use
+// this for rows without a match on the other side.
+inline constexpr size_t npos_row = std::numeric_limits<size_t>::max();
+
+template<size_t Ind, typename... Ts>
+void
+take_rows_impl(const frame<Ts...>& in, const std::vector<size_t>& inds, frame<Ts...>& out)
+{
+    using T = typename pack_element<Ind, Ts...>::type;
+    columnindex<Ind> ci;
+    const T* src = in.column(ci).data();
+    series<T>& s = out.column(ci);
+    s.reserve(inds.size());
+    for (size_t ind : inds) {
+        if (ind == npos_row) {
+            s.push_back(T{});
+        }
+        else {
+            s.push_back(src[ind]);
+        }
+    }
+    if constexpr (Ind + 1 < sizeof...(Ts)) {
+        take_rows_impl<Ind + 1>(in, inds, out);
+    }
+}
+
+// Gather rows of a frame by row index, column at a time, into a new frame
+//   take_rows(f, { 3, 0, npos_row }) == frame of rows f[3], f[0] and a default row
+template<typename... Ts>
+frame<Ts...>
+take_rows(const frame<Ts...>& in, const std::vector<size_t>& inds)
+{
+    frame<Ts...> out;
+    out.set_column_names(in.column_names());
+    take_rows_impl<0>(in, inds, out);
+    return out;
+}
+
+template<size_t Ind, size_t... Inds, typename... Ts>
+void
+hash_columns_impl(
+    const frame<Ts...>& f, size_t begin, size_t num, uint64_t* hashes, bool first)
+{
+    columnindex<Ind> ci;
+    hash_column(f.column(ci).data() + begin, num, hashes, first);
+    if constexpr (sizeof...(Inds) > 0) {
+        hash_columns_impl<Inds...>(f, begin, num, hashes, false);
+    }
+}
+
+// Hash the key columns Inds... of rows [begin, begin + num) of a frame into
+// hashes[0] .. hashes[num - 1]
+template<typename... Ts, size_t... Inds>
+void
+hash_columns(
+    const frame<Ts...>& f, size_t begin, size_t num, uint64_t* hashes, columnindex<Inds>...)
+{
+    hash_columns_impl<Inds...>(f, begin, num, hashes, true);
+}
+
+// Hash the key columns Inds... of every row of a frame, column at a time.
+// hash_columns(f, _2, _0)[i] == hash_row<2, 0>(f.row(i))
+template<typename... Ts, size_t... Inds>
+std::vector<uint64_t>
+hash_columns(const frame<Ts...>& f, columnindex<Inds>...)
+{
+    std::vector<uint64_t> hashes(f.size());
+    hash_columns_impl<Inds...>(f, 0, f.size(), hashes.data(), true);
+    return hashes;
+}
+
+// Are the key columns Ind, Inds... of rows a and b of a frame equal?
+template<size_t Ind, size_t... Inds, typename... Ts>
+bool
+rows_equal(const frame<Ts...>& f, size_t a, size_t b)
+{
+    const auto* data = f.column(columnindex<Ind>{}).data();
+    if (!(data[a] == data[b])) {
+        return false;
+    }
+    if constexpr (sizeof...(Inds) > 0) {
+        return rows_equal<Inds...>(f, a, b);
+    }
+    return true;
+}
+
+// Compare the key columns Ind, Inds... of rows a and b of a frame: -1, 0 or 1
+// as row a's key sorts before, the same as or after row b's
+template<size_t Ind, size_t... Inds, typename... Ts>
+int
+compare_rows(const frame<Ts...>& f, size_t a, size_t b)
+{
+    const auto* data = f.column(columnindex<Ind>{}).data();
+    if (data[a] < data[b]) {
+        return -1;
+    }
+    if (data[b] < data[a]) {
+        return 1;
+    }
+    if constexpr (sizeof...(Inds) > 0) {
+        return compare_rows<Inds...>(f, a, b);
+    }
+    return 0;
+}
+
+// Code a single integral column through a lookup table indexed by value - min
+// when its values span a small enough range. Codes are in first-seen order.
+template<typename T>
+bool
+direct_codes(const T* data, size_t num, std::vector<uint32_t>& codes, std::vector<size_t>& firsts)
+{
+    if constexpr (std::is_integral_v<T>) {
+        if (num == 0) {
+            return false;
+        }
+        auto [mnit, mxit] = std::minmax_element(data, data + num);
+        const uint64_t mn = static_cast<uint64_t>(*mnit);
+        const uint64_t range = static_cast<uint64_t>(*mxit) - mn;
+        if (range >= 2 * num + 1024 || range >= (uint64_t{ 1 } << 24)) {
+            return false;
+        }
+        std::vector<uint32_t> table(static_cast<size_t>(range) + 1, flat_index::npos_group);
+        codes.resize(num);
+        for (size_t i = 0; i < num; ++i) {
+            uint32_t& code = table[static_cast<size_t>(static_cast<uint64_t>(data[i]) - mn)];
+            if (code == flat_index::npos_group) {
+                code = static_cast<uint32_t>(firsts.size());
+                firsts.push_back(i);
+            }
+            codes[i] = code;
+        }
+        return true;
+    }
+    else {
+        (void)data;
+        (void)num;
+        (void)codes;
+        (void)firsts;
+        return false;
+    }
+}
+
+// Give every row of f a dense group id by its key columns, in first-seen
+// order. idx gets the group ids and can find keys, but build_rows() hasn't
+// been called on it
+template<typename... Ts, size_t Ind, size_t... Inds>
+void
+factorize_rows(const frame<Ts...>& f, flat_index& idx, columnindex<Ind>, columnindex<Inds>...)
+{
+    if constexpr (sizeof...(Inds) == 0) {
+        const auto* data = f.column(columnindex<Ind>{}).data();
+        std::vector<uint32_t> codes;
+        std::vector<size_t> firsts;
+        if (direct_codes(data, f.size(), codes, firsts)) {
+            std::vector<uint64_t> hashes(firsts.size());
+            for (size_t g = 0; g < firsts.size(); ++g) {
+                hashes[g] = hash_value(data[firsts[g]]);
+            }
+            idx.assign(std::move(codes), std::move(firsts), std::move(hashes));
+            return;
+        }
+    }
+    const std::vector<uint64_t> hashes =
+        hash_columns(f, columnindex<Ind>{}, columnindex<Inds>{}...);
+    idx.build(hashes.data(), hashes.size(),
+        [&f](size_t a, size_t b) { return rows_equal<Ind, Inds...>(f, a, b); });
+}
+
+// Renumber a factorization so that codes follow the sort order of the keys
+template<typename... Ts>
+void
+sort_factorization(std::vector<uint32_t>& codes, frame<Ts...>& uniques)
+{
+    std::vector<size_t> perm(uniques.size());
+    std::iota(perm.begin(), perm.end(), 0);
+    std::sort(perm.begin(), perm.end(),
+        [&uniques](size_t a, size_t b) { return uniques.row(a) < uniques.row(b); });
+    std::vector<uint32_t> remap(perm.size());
+    for (size_t i = 0; i < perm.size(); ++i) {
+        remap[perm[i]] = static_cast<uint32_t>(i);
+    }
+    for (uint32_t& code : codes) {
+        code = remap[code];
+    }
+    uniques = take_rows(uniques, perm);
+}
+
 } // namespace mf::detail
 
 #endif // INCLUDED_mainframe_detail_frame_h
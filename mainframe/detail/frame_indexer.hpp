@@ -6,6 +6,9 @@
 #ifndef INCLUDED_mainframe_detail_frame_indexer_h
 #define INCLUDED_mainframe_detail_frame_indexer_h
 
+#include <utility>
+
+#include "mainframe/detail/flat_index.hpp"
 #include "mainframe/frame.hpp"
 
 namespace mf
@@ -179,21 +182,107 @@ protected:
     using get_index_frame = detail::get_index_frame<index_defn<GroupInds...>, frame<Ts...>>;
     using index_frame     = typename get_index_frame::type;
 
-    using key_type       = typename index_frame::const_value_type; // _row_proxy
-    using map_value_type = std::vector<size_t>;
-    using map_type       = std::unordered_map<key_type, map_value_type>;
+    using key_type = typename index_frame::const_value_type; // _row_proxy
 
 public:
     frame_indexer(frame<Ts...> f)
-        : m_frame(f)
+        : m_frame(std::move(f))
     {}
 
+    ///
+    /// What an index iterator points at: the key (a _row_proxy into the
+    /// indexed columns) and the rows that have that key, in row order
+    ///
+    struct index_entry
+    {
+        key_type first;
+        detail::row_range second;
+    };
+
+    ///
+    /// Iterates the distinct keys of the index in first-seen order
+    ///
+    class const_index_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = index_entry;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const index_entry*;
+        using reference         = index_entry;
+
+        struct arrow_proxy
+        {
+            const index_entry*
+            operator->() const
+            {
+                return &entry;
+            }
+
+            index_entry entry;
+        };
+
+        const_index_iterator(const frame_indexer* indexer, uint32_t group)
+            : m_indexer(indexer)
+            , m_group(group)
+        {}
+
+        index_entry
+        operator*() const
+        {
+            return m_indexer->group_entry(m_group);
+        }
+
+        arrow_proxy
+        operator->() const
+        {
+            return arrow_proxy{ m_indexer->group_entry(m_group) };
+        }
+
+        const_index_iterator&
+        operator++()
+        {
+            ++m_group;
+            return *this;
+        }
+
+        const_index_iterator
+        operator++(int)
+        {
+            const_index_iterator out = *this;
+            ++m_group;
+            return out;
+        }
+
+        bool
+        operator==(const const_index_iterator& other) const
+        {
+            return m_group == other.m_group;
+        }
+
+        bool
+        operator!=(const const_index_iterator& other) const
+        {
+            return m_group != other.m_group;
+        }
+
+        // The dense id of the group this iterator points at
+        uint32_t
+        group_id() const
+        {
+            return m_group;
+        }
+
+    private:
+        const frame_indexer* m_indexer;
+        uint32_t m_group;
+    };
+
     using iterator                 = typename frame<Ts...>::iterator;
     using const_iterator           = typename frame<Ts...>::const_iterator;
-    using index_iterator           = typename map_type::iterator;
-    using const_index_iterator     = typename map_type::const_iterator;
-    using index_row_iterator       = typename map_value_type::iterator;
-    using const_index_row_iterator = typename map_value_type::const_iterator;
+    using index_iterator           = const_index_iterator;
+    using index_row_iterator       = const size_t*;
+    using const_index_row_iterator = const size_t*;
 
     iterator
     begin()
@@ -231,127 +320,101 @@ public:
         return m_frame.cend();
     }
 
-    index_iterator
-    begin_index()
-    {
-        return m_idx.begin();
-    }
-
-    index_iterator
-    end_index()
-    {
-        return m_idx.end();
-    }
-
     const_index_iterator
     begin_index() const
     {
-        return m_idx.begin();
+        return const_index_iterator{ this, 0 };
     }
 
     const_index_iterator
     end_index() const
     {
-        return m_idx.end();
+        return const_index_iterator{ this, static_cast<uint32_t>(m_idx.num_groups()) };
     }
 
     const_index_iterator
     cbegin_index() const
     {
-        return m_idx.cbegin();
+        return begin_index();
     }
 
     const_index_iterator
     cend_index() const
     {
-        return m_idx.cend();
-    }
-
-    index_row_iterator
-    begin_index_row(index_iterator it)
-    {
-        return it->second.begin();
-    }
-
-    index_row_iterator
-    end_index_row(index_iterator it)
-    {
-        return it->second.end();
+        return end_index();
     }
 
     const_index_row_iterator
     begin_index_row(const_index_iterator it) const
     {
-        return it->second.begin();
+        return m_idx.rows(it.group_id()).begin();
     }
 
     const_index_row_iterator
     end_index_row(const_index_iterator it) const
     {
-        return it->second.end();
+        return m_idx.rows(it.group_id()).end();
     }
 
     const_index_row_iterator
     cbegin_index_row(const_index_iterator it) const
     {
-        return it->second.cbegin();
+        return begin_index_row(it);
     }
 
     const_index_row_iterator
     cend_index_row(const_index_iterator it) const
     {
-        return it->second.cend();
+        return end_index_row(it);
     }
 
-    index_iterator
-    find_index(const key_type& key)
+    /// Find a key - any row (_row_proxy or frame_row) with the index column types
+    template<typename Row>
+    const_index_iterator
+    find_index(const Row& key) const
     {
-        return m_idx.find(key);
+        const uint64_t h =
+            detail::hash_row(key, std::make_index_sequence<sizeof...(GroupInds)>{});
+        const index_frame& ifr = m_ifr;
+        uint32_t g = m_idx.find(h, [&](size_t row) { return ifr.row(row) == key; });
+        return g == detail::flat_index::npos_group ? end_index() : const_index_iterator{ this, g };
     }
 
-    const_index_iterator
-    find_index(const key_type& key) const
+    /// Number of distinct keys
+    size_t
+    num_groups() const
     {
-        return m_idx.find(key);
+        return m_idx.num_groups();
+    }
+
+    /// Dense group id (0 .. num_groups() - 1, in first-seen order) of every row
+    const std::vector<uint32_t>&
+    group_ids() const
+    {
+        return m_idx.row_groups();
     }
 
     void
     build_index() const
     {
-        if (m_idx.size() != 0) {
+        if (m_idx.built()) {
             return;
         }
 
-        const index_frame ifr{ get_index_frame::op(m_frame) };
-        m_idx.reserve(ifr.size());
-
-        for (size_t i = 0; i < ifr.size(); ++i) {
-            auto row    = ifr.row(i);
-            auto findit = m_idx.find(row);
-            if (findit == m_idx.end()) {
-                map_value_type arr;
-                arr.push_back(i);
-                m_idx[row] = arr;
-            }
-            else {
-                findit->second.push_back(i);
-            }
-        }
-        for (auto& kv : m_idx)  {
-            map_value_type& arr = kv.second;
-            std::sort(arr.begin(), arr.end());
-        }
+        m_ifr = get_index_frame::op(m_frame);
+        detail::factorize_rows(m_frame, m_idx, columnindex<GroupInds>{}...);
+        m_idx.build_rows();
     }
 
     void
     debug_index() const
     {
         std::cout << "Index:\n";
-        for (auto& [key, val] : m_idx) {
-            std::cout << "key " << key << ": ";
+        for (auto it = begin_index(); it != end_index(); ++it) {
+            std::cout << "key " << it->first << ": ";
             std::cout << "[ ";
             int i = 0;
-            for (auto& ind : val) {
+            for (auto& ind : it->second) {
                 if (i++ != 0) {
                     std::cout << ", ";
                 }
@@ -362,11 +425,18 @@ public:
     }
 
 protected:
-    mutable map_type m_idx;
+    index_entry
+    group_entry(uint32_t g) const
+    {
+        const index_frame& ifr = m_ifr;
+        return index_entry{ ifr.row(m_idx.first_row(g)), m_idx.rows(g) };
+    }
+
+    mutable detail::flat_index m_idx;
+    mutable index_frame m_ifr;
     frame<Ts...> m_frame;
 };
 
 } // namespace mf
 
 #endif // INCLUDED_mainframe_detail_frame_indexer_h
- 
@@ -9,7 +9,10 @@
 #include <map>
 
 #include "mainframe/frame.hpp"
+#include "mainframe/detail/aggregate.hpp"
 #include "mainframe/detail/frame_indexer.hpp"
+#include "mainframe/detail/hash.hpp"
+#include "mainframe/detail/sketch.hpp"
 
 namespace mf
 {
@@ -81,69 +84,158 @@ template<size_t Ind>
 struct stddev_op : std::integral_constant<size_t, Ind>
 {};
 
+template<size_t Ind>
+struct median_op : std::integral_constant<size_t, Ind>
+{};
+
+template<size_t Ind>
+struct quantile_op : std::integral_constant<size_t, Ind>
+{
+    double q{ 0.5 };
+};
+
+template<size_t Ind>
+struct approx_quantile_op : std::integral_constant<size_t, Ind>
+{
+    double q{ 0.5 };
+};
+
+template<size_t Ind>
+struct approx_count_distinct_op : std::integral_constant<size_t, Ind>
+{};
+
+template<size_t Ind>
+struct count_distinct_op : std::integral_constant<size_t, Ind>
+{};
+
+template<size_t Ind>
+struct first_op : std::integral_constant<size_t, Ind>
+{};
+
+template<size_t Ind>
+struct last_op : std::integral_constant<size_t, Ind>
+{};
+
+template<size_t Ind>
+struct argmin_op : std::integral_constant<size_t, Ind>
+{};
+
+template<size_t Ind>
+struct argmax_op : std::integral_constant<size_t, Ind>
+{};
+
+// The number of present values in a column, as opposed to count_op's number
+// of rows
+template<size_t Ind>
+struct count_values_op : std::integral_constant<size_t, Ind>
+{};
+
 struct count_op
 {};
 
-template<typename Frame, typename... Ops>
-struct get_result_columns_from_args;
+// The column an op reads - count_op doesn't read one
+template<typename Op, typename Frame>
+struct op_column_type
+{
+    using type = size_t;
+};
 
-template<typename... Ts, template<size_t> typename Op, size_t Ind, typename... Ops>
-struct get_result_columns_from_args<frame<Ts...>, Op<Ind>, Ops...>
+template<template<size_t> typename Op, size_t Ind, typename... Ts>
+struct op_column_type<Op<Ind>, frame<Ts...>>
 {
-    using ind_type          = typename detail::pack_element<Ind, Ts...>::type;
-    using remaining_columns = typename get_result_columns_from_args<frame<Ts...>, Ops...>::type;
-    using type              = typename detail::prepend<series<ind_type>, remaining_columns>::type;
+    using type = typename pack_element<Ind, Ts...>::type;
+};
+
+// The type of the column an op produces. Mostly that's the type of the column
+// it reads, but counts and row numbers are size_t - or mi<size_t> for row
+// numbers from a column of mi<T>, since a group might have no values at all -
+// and quantiles of integers are doubles
+template<typename Op, typename Frame>
+struct op_result_type : op_column_type<Op, Frame>
+{};
+
+template<size_t Ind, typename Frame>
+struct op_result_type<median_op<Ind>, Frame>
+    : quantile_result<typename op_column_type<median_op<Ind>, Frame>::type>
+{};
+
+template<size_t Ind, typename Frame>
+struct op_result_type<quantile_op<Ind>, Frame>
+    : quantile_result<typename op_column_type<quantile_op<Ind>, Frame>::type>
+{};
+
+template<size_t Ind, typename Frame>
+struct op_result_type<approx_quantile_op<Ind>, Frame>
+    : quantile_result<typename op_column_type<approx_quantile_op<Ind>, Frame>::type>
+{};
+
+template<size_t Ind, typename Frame>
+struct op_result_type<count_values_op<Ind>, Frame>
+{
+    using type = size_t;
 };
 
-template<typename... Ts, typename... Ops>
-struct get_result_columns_from_args<frame<Ts...>, count_op, Ops...>
+template<size_t Ind, typename Frame>
+struct op_result_type<approx_count_distinct_op<Ind>, Frame>
 {
-    using remaining_columns = typename get_result_columns_from_args<frame<Ts...>, Ops...>::type;
-    using type              = typename detail::prepend<series<size_t>, remaining_columns>::type;
+    using type = size_t;
 };
 
-template<typename... Ts, template<size_t> typename Op, size_t Ind>
-struct get_result_columns_from_args<frame<Ts...>, Op<Ind>>
+template<size_t Ind, typename Frame>
+struct op_result_type<count_distinct_op<Ind>, Frame>
 {
-    using ind_type = typename detail::pack_element<Ind, Ts...>::type;
-    using type     = std::tuple<series<ind_type>>;
+    using type = size_t;
 };
 
-template<typename... Ts>
-struct get_result_columns_from_args<frame<Ts...>, count_op>
+template<size_t Ind, typename Frame>
+struct op_result_type<argmin_op<Ind>, Frame>
 {
-    using type = std::tuple<series<size_t>>;
+    using type = std::conditional_t<is_missing<typename op_column_type<argmin_op<Ind>,
+                                        Frame>::type>::value,
+        mi<size_t>, size_t>;
+};
+
+template<size_t Ind, typename Frame>
+struct op_result_type<argmax_op<Ind>, Frame>
+{
+    using type = std::conditional_t<is_missing<typename op_column_type<argmax_op<Ind>,
+                                        Frame>::type>::value,
+        mi<size_t>, size_t>;
 };
 
 template<typename Frame, typename... Ops>
-struct get_frame_from_args;
+struct get_result_columns_from_args;
 
-template<typename... Ts, template<size_t> typename Op, size_t Ind, typename... Ops>
-struct get_frame_from_args<frame<Ts...>, Op<Ind>, Ops...>
+template<typename... Ts, typename Op, typename... Ops>
+struct get_result_columns_from_args<frame<Ts...>, Op, Ops...>
 {
-    using ind_type             = typename detail::pack_element<Ind, Ts...>::type;
-    using remaining_frame_type = typename get_frame_from_args<frame<Ts...>, Ops...>::type;
-    using type                 = typename detail::prepend<ind_type, remaining_frame_type>::type;
+    using op_type           = typename op_result_type<Op, frame<Ts...>>::type;
+    using remaining_columns = typename get_result_columns_from_args<frame<Ts...>, Ops...>::type;
+    using type              = typename detail::prepend<series<op_type>, remaining_columns>::type;
 };
 
-template<typename... Ts, typename... Ops>
-struct get_frame_from_args<frame<Ts...>, count_op, Ops...>
+template<typename... Ts, typename Op>
+struct get_result_columns_from_args<frame<Ts...>, Op>
 {
-    using remaining_frame_type = typename get_frame_from_args<frame<Ts...>, Ops...>::type;
-    using type                 = typename detail::prepend<size_t, remaining_frame_type>::type;
+    using op_type = typename op_result_type<Op, frame<Ts...>>::type;
+    using type    = std::tuple<series<op_type>>;
 };
 
-template<typename... Ts, template<size_t> typename Op, size_t Ind>
-struct get_frame_from_args<frame<Ts...>, Op<Ind>>
+template<typename Frame, typename... Ops>
+struct get_frame_from_args;
+
+template<typename... Ts, typename Op, typename... Ops>
+struct get_frame_from_args<frame<Ts...>, Op, Ops...>
 {
-    using ind_type = typename detail::pack_element<Ind, Ts...>::type;
-    using type     = frame<ind_type>;
+    using op_type              = typename op_result_type<Op, frame<Ts...>>::type;
+    using remaining_frame_type = typename get_frame_from_args<frame<Ts...>, Ops...>::type;
+    using type                 = typename detail::prepend<op_type, remaining_frame_type>::type;
 };
 
-template<typename... Ts>
-struct get_frame_from_args<frame<Ts...>, count_op>
+template<typename... Ts, typename Op>
+struct get_frame_from_args<frame<Ts...>, Op>
 {
-    using type = frame<size_t>;
+    using type = frame<typename op_result_type<Op, frame<Ts...>>::type>;
 };
 
 template<size_t QColInd, size_t ArgInd, typename OpsTpl>
@@ -167,6 +259,699 @@ template<size_t QColInd, typename... Ops>
 struct is_colind_at_argind<QColInd, 0, std::tuple<count_op, Ops...>> : std::false_type
 {};
 
+// Per-group partial state for an op, so that groups can be aggregated in
+// pieces (one per thread, say) and the pieces merged. scatter() fills one
+// state per group from rows begin .. begin + num - 1, with data and gids
+// pointing at row begin. merge() folds a later piece's state for a group into
+// an earlier one's, and finish() turns a state into the op's result (it gets
+// the op too, for ops with parameters).
+template<typename Op, typename T>
+struct partial_agg;
+
+template<size_t Ind, typename T>
+struct partial_agg<sum_op<Ind>, T>
+{
+    using state = T;
+
+    static void
+    scatter(const T* data, const uint32_t* gids, size_t, size_t num, size_t ngroups, state* out)
+    {
+        group_sum(data, gids, num, ngroups, out);
+    }
+
+    static void
+    merge(state& into, const state& from)
+    {
+        into += from;
+    }
+
+    static T
+    finish(sum_op<Ind>, const state& s, size_t)
+    {
+        return s;
+    }
+};
+
+template<size_t Ind, typename T>
+struct partial_agg<min_op<Ind>, T>
+{
+    using state = T;
+
+    static void
+    scatter(const T* data, const uint32_t* gids, size_t, size_t num, size_t ngroups, state* out)
+    {
+        group_min(data, gids, num, ngroups, out);
+    }
+
+    static void
+    merge(state& into, const state& from)
+    {
+        using std::min;
+        into = min(into, from);
+    }
+
+    static T
+    finish(min_op<Ind>, const state& s, size_t)
+    {
+        return s;
+    }
+};
+
+template<size_t Ind, typename T>
+struct partial_agg<max_op<Ind>, T>
+{
+    using state = T;
+
+    static void
+    scatter(const T* data, const uint32_t* gids, size_t, size_t num, size_t ngroups, state* out)
+    {
+        group_max(data, gids, num, ngroups, out);
+    }
+
+    static void
+    merge(state& into, const state& from)
+    {
+        using std::max;
+        into = max(into, from);
+    }
+
+    static T
+    finish(max_op<Ind>, const state& s, size_t)
+    {
+        return s;
+    }
+};
+
+template<size_t Ind, typename T>
+struct partial_agg<mean_op<Ind>, T>
+{
+    using state = T;
+
+    static void
+    scatter(const T* data, const uint32_t* gids, size_t, size_t num, size_t ngroups, state* out)
+    {
+        group_sum(data, gids, num, ngroups, out);
+    }
+
+    static void
+    merge(state& into, const state& from)
+    {
+        into += from;
+    }
+
+    static T
+    finish(mean_op<Ind>, const state& s, size_t count)
+    {
+        T out = s;
+        if constexpr (std::is_arithmetic_v<T>) {
+            out /= static_cast<T>(count);
+        }
+        else {
+            out /= count;
+        }
+        return out;
+    }
+};
+
+template<size_t Ind, typename T>
+struct partial_agg<stddev_op<Ind>, T>
+{
+    using state = moments;
+
+    static void
+    scatter(const T* data, const uint32_t* gids, size_t, size_t num, size_t ngroups, state* out)
+    {
+        group_moments(data, gids, num, ngroups, out);
+    }
+
+    static void
+    merge(state& into, const state& from)
+    {
+        into.merge(from);
+    }
+
+    static T
+    finish(stddev_op<Ind>, const state& s, size_t)
+    {
+        return static_cast<T>(s.stddev());
+    }
+};
+
+// Ops that have a partial_agg. The others - median, quantile and exact
+// distinct counts - depend on all of a group's values at once
+template<typename Op>
+struct is_mergeable_op : std::true_type
+{};
+
+template<size_t Ind>
+struct is_mergeable_op<count_distinct_op<Ind>> : std::false_type
+{};
+
+template<size_t Ind>
+struct is_mergeable_op<median_op<Ind>> : std::false_type
+{};
+
+template<size_t Ind>
+struct is_mergeable_op<quantile_op<Ind>> : std::false_type
+{};
+
+// Quantiles from a t-digest, so a few KB per group however big the group
+template<size_t Ind, typename T>
+struct partial_agg<approx_quantile_op<Ind>, T>
+{
+    using state = tdigest;
+
+    static void
+    scatter(const T* data, const uint32_t* gids, size_t, size_t num, size_t, state* out)
+    {
+        for (size_t i = 0; i < num; ++i) {
+            out[gids[i]].add(static_cast<double>(data[i]));
+        }
+    }
+
+    static void
+    merge(state& into, const state& from)
+    {
+        into.merge(from);
+    }
+
+    static typename quantile_result<T>::type
+    finish(approx_quantile_op<Ind> op, const state& s, size_t)
+    {
+        return static_cast<typename quantile_result<T>::type>(s.quantile(op.q));
+    }
+};
+
+// Distinct counts from a HyperLogLog of each value's hash
+template<size_t Ind, typename T>
+struct partial_agg<approx_count_distinct_op<Ind>, T>
+{
+    using state = hyperloglog;
+
+    static void
+    scatter(const T* data, const uint32_t* gids, size_t, size_t num, size_t, state* out)
+    {
+        for (size_t i = 0; i < num; ++i) {
+            out[gids[i]].add_hash(hash_value(data[i]));
+        }
+    }
+
+    static void
+    merge(state& into, const state& from)
+    {
+        into.merge(from);
+    }
+
+    static size_t
+    finish(approx_count_distinct_op<Ind>, const state& s, size_t)
+    {
+        return static_cast<size_t>(std::llround(s.estimate()));
+    }
+};
+
+template<size_t Ind, typename T>
+struct partial_agg<first_op<Ind>, T>
+{
+    using state = T;
+
+    static void
+    scatter(const T* data, const uint32_t* gids, size_t, size_t num, size_t ngroups, state* out)
+    {
+        group_first(data, gids, num, ngroups, out);
+    }
+
+    static void
+    merge(state&, const state&)
+    {}
+
+    static T
+    finish(first_op<Ind>, const state& s, size_t)
+    {
+        return s;
+    }
+};
+
+template<size_t Ind, typename T>
+struct partial_agg<last_op<Ind>, T>
+{
+    using state = T;
+
+    static void
+    scatter(const T* data, const uint32_t* gids, size_t, size_t num, size_t ngroups, state* out)
+    {
+        group_last(data, gids, num, ngroups, out);
+    }
+
+    static void
+    merge(state& into, const state& from)
+    {
+        into = from;
+    }
+
+    static T
+    finish(last_op<Ind>, const state& s, size_t)
+    {
+        return s;
+    }
+};
+
+// The best value so far and the row it's in
+template<typename T>
+struct arg_state
+{
+    T value{};
+    size_t row{ 0 };
+};
+
+template<size_t Ind, typename T>
+struct partial_agg<argmin_op<Ind>, T>
+{
+    using state = arg_state<T>;
+
+    static void
+    scatter(const T* data, const uint32_t* gids, size_t begin, size_t num, size_t ngroups,
+        state* out)
+    {
+        std::vector<size_t> rows(ngroups, num);
+        group_argmin(data, gids, num, ngroups, rows.data());
+        for (size_t g = 0; g < ngroups; ++g) {
+            if (rows[g] < num) {
+                out[g] = state{ data[rows[g]], begin + rows[g] };
+            }
+        }
+    }
+
+    static void
+    merge(state& into, const state& from)
+    {
+        if (from.value < into.value) {
+            into = from;
+        }
+    }
+
+    static size_t
+    finish(argmin_op<Ind>, const state& s, size_t)
+    {
+        return s.row;
+    }
+};
+
+template<size_t Ind, typename T>
+struct partial_agg<argmax_op<Ind>, T>
+{
+    using state = arg_state<T>;
+
+    static void
+    scatter(const T* data, const uint32_t* gids, size_t begin, size_t num, size_t ngroups,
+        state* out)
+    {
+        std::vector<size_t> rows(ngroups, num);
+        group_argmax(data, gids, num, ngroups, rows.data());
+        for (size_t g = 0; g < ngroups; ++g) {
+            if (rows[g] < num) {
+                out[g] = state{ data[rows[g]], begin + rows[g] };
+            }
+        }
+    }
+
+    static void
+    merge(state& into, const state& from)
+    {
+        if (into.value < from.value) {
+            into = from;
+        }
+    }
+
+    static size_t
+    finish(argmax_op<Ind>, const state& s, size_t)
+    {
+        return s.row;
+    }
+};
+
+template<typename T>
+struct partial_agg<count_op, T>
+{
+    using state = size_t;
+
+    static void
+    scatter(const T*, const uint32_t* gids, size_t, size_t num, size_t ngroups, state* out)
+    {
+        group_count(gids, num, ngroups, out);
+    }
+
+    static void
+    merge(state& into, const state& from)
+    {
+        into += from;
+    }
+
+    static size_t
+    finish(count_op, const state& s, size_t)
+    {
+        return s;
+    }
+};
+
+// Outside of columns of mi<T>, every value is present
+template<size_t Ind, typename T>
+struct partial_agg<count_values_op<Ind>, T>
+{
+    using state = size_t;
+
+    static void
+    scatter(const T*, const uint32_t* gids, size_t, size_t num, size_t ngroups, state* out)
+    {
+        group_count(gids, num, ngroups, out);
+    }
+
+    static void
+    merge(state& into, const state& from)
+    {
+        into += from;
+    }
+
+    static size_t
+    finish(count_values_op<Ind>, const state& s, size_t)
+    {
+        return s;
+    }
+};
+
+// Whether an op over a column of mi<T> gives a missing result for a group
+// with no present values. Counts give zero instead
+template<typename Op>
+struct is_missing_when_empty : std::true_type
+{};
+
+template<size_t Ind>
+struct is_missing_when_empty<count_values_op<Ind>> : std::false_type
+{};
+
+template<size_t Ind>
+struct is_missing_when_empty<count_distinct_op<Ind>> : std::false_type
+{};
+
+template<size_t Ind>
+struct is_missing_when_empty<approx_count_distinct_op<Ind>> : std::false_type
+{};
+
+// An op over a column of mi<T> only sees the present values. scatter()
+// compacts those (and their group ids) and hands them to the op's partial_agg
+// for plain T, so the same kernels run whether or not a column can have
+// missing values. Each state also counts its group's present values: a piece
+// with none for a group has nothing to merge, and finish() gets the present
+// count, so that a mean is over the present values only.
+template<typename Op, typename T>
+struct masked_partial_agg
+{
+    using inner = partial_agg<Op, T>;
+
+    struct state
+    {
+        typename inner::state value{};
+        size_t present{ 0 };
+    };
+
+    static void
+    scatter(const mi<T>* data, const uint32_t* gids, size_t begin, size_t num, size_t ngroups,
+        state* out)
+    {
+        std::vector<T> values(num);
+        std::vector<uint32_t> vgids(num);
+        std::vector<size_t> vrows(num);
+        const size_t k =
+            compact_present(data, gids, num, values.data(), vgids.data(), vrows.data());
+
+        std::vector<typename inner::state> states(ngroups);
+        std::vector<size_t> present(ngroups);
+        inner::scatter(values.data(), vgids.data(), 0, k, ngroups, states.data());
+        group_count(vgids.data(), k, ngroups, present.data());
+        for (size_t g = 0; g < ngroups; ++g) {
+            out[g].value   = states[g];
+            out[g].present = present[g];
+            if constexpr (std::is_same_v<typename inner::state, arg_state<T>>) {
+                // Row numbers among the present values back to row numbers
+                if (present[g] > 0) {
+                    out[g].value.row = begin + vrows[states[g].row];
+                }
+            }
+        }
+    }
+
+    static void
+    merge(state& into, const state& from)
+    {
+        if (from.present == 0) {
+            return;
+        }
+        if (into.present == 0) {
+            into = from;
+            return;
+        }
+        inner::merge(into.value, from.value);
+        into.present += from.present;
+    }
+
+    static auto
+    finish(Op op, const state& s, size_t)
+    {
+        using R = decltype(inner::finish(op, s.value, s.present));
+        if constexpr (is_missing_when_empty<Op>::value) {
+            return s.present > 0 ? mi<R>{ inner::finish(op, s.value, s.present) } : mi<R>{};
+        }
+        else {
+            return inner::finish(op, s.value, s.present);
+        }
+    }
+};
+
+// The partial_agg for an op over a column of T
+template<typename Op, typename T>
+struct partial_agg_for
+{
+    using type = partial_agg<Op, T>;
+};
+
+template<typename Op, typename T>
+struct partial_agg_for<Op, mi<T>>
+{
+    using type = masked_partial_agg<Op, T>;
+};
+
+template<size_t Ind>
+double
+quantile_of(median_op<Ind>)
+{
+    return 0.5;
+}
+
+template<size_t Ind>
+double
+quantile_of(quantile_op<Ind> op)
+{
+    return op.q;
+}
+
+// Aggregate an op over the present values of a column of mi<T>, with gids
+// numbering ngroups groups
+template<typename Op, typename T, typename R>
+void
+aggregate_present(
+    Op op, const mi<T>* data, const uint32_t* gids, size_t num, size_t ngroups, R* out)
+{
+    if constexpr (is_mergeable_op<Op>::value) {
+        using agg = masked_partial_agg<Op, T>;
+        std::vector<typename agg::state> states(ngroups);
+        agg::scatter(data, gids, 0, num, ngroups, states.data());
+        for (size_t g = 0; g < ngroups; ++g) {
+            out[g] = agg::finish(op, states[g], 0);
+        }
+    }
+    else {
+        std::vector<T> values(num);
+        std::vector<uint32_t> vgids(num);
+        const size_t k = compact_present(data, gids, num, values.data(), vgids.data(), nullptr);
+        if constexpr (std::is_same_v<Op, count_distinct_op<Op::value>>) {
+            group_count_distinct(values.data(), vgids.data(), k, ngroups, out);
+        }
+        else {
+            std::vector<size_t> present(ngroups);
+            std::vector<typename quantile_result<T>::type> result(ngroups);
+            group_count(vgids.data(), k, ngroups, present.data());
+            group_quantile(values.data(), vgids.data(), k, ngroups, present.data(),
+                quantile_of(op), result.data());
+            for (size_t g = 0; g < ngroups; ++g) {
+                out[g] = present[g] > 0 ? R{ result[g] } : R{};
+            }
+        }
+    }
+}
+
+// Aggregate an op over groups that are contiguous runs of rows
+template<typename Op, typename T>
+struct run_agg;
+
+template<size_t Ind, typename T>
+struct run_agg<sum_op<Ind>, T>
+{
+    static void
+    apply(sum_op<Ind>, const T* data, const size_t* starts, size_t nruns, T* out)
+    {
+        run_sum(data, starts, nruns, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct run_agg<min_op<Ind>, T>
+{
+    static void
+    apply(min_op<Ind>, const T* data, const size_t* starts, size_t nruns, T* out)
+    {
+        run_min(data, starts, nruns, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct run_agg<max_op<Ind>, T>
+{
+    static void
+    apply(max_op<Ind>, const T* data, const size_t* starts, size_t nruns, T* out)
+    {
+        run_max(data, starts, nruns, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct run_agg<mean_op<Ind>, T>
+{
+    static void
+    apply(mean_op<Ind>, const T* data, const size_t* starts, size_t nruns, T* out)
+    {
+        run_mean(data, starts, nruns, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct run_agg<stddev_op<Ind>, T>
+{
+    static void
+    apply(stddev_op<Ind>, const T* data, const size_t* starts, size_t nruns, T* out)
+    {
+        run_stddev(data, starts, nruns, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct run_agg<median_op<Ind>, T>
+{
+    template<typename U>
+    static void
+    apply(median_op<Ind>, const T* data, const size_t* starts, size_t nruns, U* out)
+    {
+        run_quantile(data, starts, nruns, 0.5, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct run_agg<quantile_op<Ind>, T>
+{
+    template<typename U>
+    static void
+    apply(quantile_op<Ind> op, const T* data, const size_t* starts, size_t nruns, U* out)
+    {
+        run_quantile(data, starts, nruns, op.q, out);
+    }
+};
+
+// Ops that only have a partial_agg run over each run's rows as one group
+template<typename Op, typename T>
+struct run_agg_partial
+{
+    template<typename U>
+    static void
+    apply(Op op, const T* data, const size_t* starts, size_t nruns, U* out)
+    {
+        using agg = partial_agg<Op, T>;
+        for (size_t r = 0; r < nruns; ++r) {
+            const size_t num = starts[r + 1] - starts[r];
+            std::vector<uint32_t> gids(num, 0);
+            typename agg::state state;
+            agg::scatter(data + starts[r], gids.data(), starts[r], num, 1, &state);
+            out[r] = agg::finish(op, state, num);
+        }
+    }
+};
+
+template<size_t Ind, typename T>
+struct run_agg<approx_quantile_op<Ind>, T> : run_agg_partial<approx_quantile_op<Ind>, T>
+{};
+
+template<size_t Ind, typename T>
+struct run_agg<approx_count_distinct_op<Ind>, T>
+    : run_agg_partial<approx_count_distinct_op<Ind>, T>
+{};
+
+template<size_t Ind, typename T>
+struct run_agg<argmin_op<Ind>, T> : run_agg_partial<argmin_op<Ind>, T>
+{};
+
+template<size_t Ind, typename T>
+struct run_agg<argmax_op<Ind>, T> : run_agg_partial<argmax_op<Ind>, T>
+{};
+
+template<size_t Ind, typename T>
+struct run_agg<count_values_op<Ind>, T>
+{
+    static void
+    apply(count_values_op<Ind>, const T*, const size_t* starts, size_t nruns, size_t* out)
+    {
+        for (size_t r = 0; r < nruns; ++r) {
+            out[r] = starts[r + 1] - starts[r];
+        }
+    }
+};
+
+template<size_t Ind, typename T>
+struct run_agg<first_op<Ind>, T>
+{
+    static void
+    apply(first_op<Ind>, const T* data, const size_t* starts, size_t nruns, T* out)
+    {
+        for (size_t r = 0; r < nruns; ++r) {
+            out[r] = data[starts[r]];
+        }
+    }
+};
+
+template<size_t Ind, typename T>
+struct run_agg<last_op<Ind>, T>
+{
+    static void
+    apply(last_op<Ind>, const T* data, const size_t* starts, size_t nruns, T* out)
+    {
+        for (size_t r = 0; r < nruns; ++r) {
+            out[r] = data[starts[r + 1] - 1];
+        }
+    }
+};
+
+// Give every row its run's number as a group id and count as for hashed groups
+template<size_t Ind, typename T>
+struct run_agg<count_distinct_op<Ind>, T>
+{
+    static void
+    apply(count_distinct_op<Ind>, const T* data, const size_t* starts, size_t nruns, size_t* out)
+    {
+        std::vector<uint32_t> gids(starts[nruns]);
+        for (size_t r = 0; r < nruns; ++r) {
+            std::fill(gids.begin() + starts[r], gids.begin() + starts[r + 1],
+                static_cast<uint32_t>(r));
+        }
+        group_count_distinct(data, gids.data(), gids.size(), nruns, out);
+    }
+};
+
 template<typename Frame, typename IndexDefn, typename... Ops>
 struct get_aggregate_frame;
 
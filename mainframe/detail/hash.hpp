@@ -0,0 +1,234 @@
+//          Copyright Ted Middleton 2022.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef INCLUDED_mainframe_detail_hash_h
+#define INCLUDED_mainframe_detail_hash_h
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+
+#if __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "mainframe/columnindex.hpp"
+#include "mainframe/detail/base.hpp"
+#include "mainframe/missing.hpp"
+
+// Hashing for row keys. Everything that hashes keys - frame_indexer, group,
+// the joins, bloom_filter - goes through here so that a key hashes to the same
+// value whether it's hashed a row at a time (std::hash<_row_proxy>) or a column
+// at a time (hash_column()).
+//
+// A key's hash is a fold over its columns:
+//   h = hash_seed
+//   for each column c: h = hash_combine(h, hash_bits(c))
+// hash_bits() is the raw bit pattern of a value (or std::hash for
+// non-arithmetic types); hash_combine() multiplies the running hash before
+// adding, so column order matters and equal columns don't cancel, and then
+// runs the sum through the MurmurHash3 finalizer so that identity-like
+// std::hash implementations still spread over all 64 bits.
+
+namespace mf::detail
+{
+
+inline constexpr uint64_t hash_seed    = 0x243f6a8885a308d3ULL;
+inline constexpr uint64_t hash_missing = 0x13198a2e03707344ULL;
+inline constexpr uint64_t hash_mul     = 0x9e3779b97f4a7c15ULL;
+inline constexpr uint64_t hash_fmix1   = 0xff51afd7ed558ccdULL;
+inline constexpr uint64_t hash_fmix2   = 0xc4ceb9fe1a85ec53ULL;
+
+inline uint64_t
+hash_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= hash_fmix1;
+    h ^= h >> 33;
+    h *= hash_fmix2;
+    h ^= h >> 33;
+    return h;
+}
+
+inline uint64_t
+hash_combine(uint64_t h, uint64_t bits)
+{
+    return hash_mix(h * hash_mul + bits);
+}
+
+template<typename T>
+uint64_t
+hash_bits(const T& t)
+{
+    if constexpr (std::is_same_v<T, bool>) {
+        return t ? 1 : 0;
+    }
+    else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+        return static_cast<uint64_t>(static_cast<int64_t>(t));
+    }
+    else if constexpr (std::is_integral_v<T>) {
+        return static_cast<uint64_t>(t);
+    }
+    else if constexpr (std::is_floating_point_v<T>) {
+        // -0.0 == 0.0, so they have to hash the same
+        if (t == T{ 0 }) {
+            return 0;
+        }
+        double d = static_cast<double>(t);
+        uint64_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        return bits;
+    }
+    else if constexpr (is_missing<T>::value) {
+        return t.has_value() ? hash_bits(*t) : hash_missing;
+    }
+    else {
+        return static_cast<uint64_t>(std::hash<T>{}(t));
+    }
+}
+
+template<typename T>
+uint64_t
+hash_value(const T& t)
+{
+    return hash_combine(hash_seed, hash_bits(t));
+}
+
+// Hash columns Ind, Inds... of a row (a _row_proxy or a frame_row)
+template<size_t Ind, size_t... Inds, typename Row>
+uint64_t
+hash_row(const Row& row, uint64_t h = hash_seed)
+{
+    h = hash_combine(h, hash_bits(row.at(columnindex<Ind>{})));
+    if constexpr (sizeof...(Inds) > 0) {
+        return hash_row<Inds...>(row, h);
+    }
+    return h;
+}
+
+template<size_t... Inds, typename Row>
+uint64_t
+hash_row(const Row& row, std::index_sequence<Inds...>)
+{
+    return hash_row<Inds...>(row);
+}
+
+#if __AVX2__
+// There's no 64 bit multiply in AVX2, so build one from 32x32->64 multiplies
+inline __m256i
+hash_mul64(__m256i a, __m256i b)
+{
+    __m256i lo    = _mm256_mul_epu32(a, b);
+    __m256i hi1   = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b);
+    __m256i hi2   = _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32));
+    __m256i cross = _mm256_slli_epi64(_mm256_add_epi64(hi1, hi2), 32);
+    return _mm256_add_epi64(lo, cross);
+}
+
+inline __m256i
+hash_combine4(__m256i h, __m256i bits)
+{
+    static const __m256i mul = _mm256_set1_epi64x(static_cast<int64_t>(hash_mul));
+    static const __m256i f1  = _mm256_set1_epi64x(static_cast<int64_t>(hash_fmix1));
+    static const __m256i f2  = _mm256_set1_epi64x(static_cast<int64_t>(hash_fmix2));
+    h = _mm256_add_epi64(hash_mul64(h, mul), bits);
+    h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 33));
+    h = hash_mul64(h, f1);
+    h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 33));
+    h = hash_mul64(h, f2);
+    h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 33));
+    return h;
+}
+
+// hash_bits() of four values at a time, for the types that have a cheap
+// vectorized equivalent
+template<typename T>
+struct hash_bits4 : std::false_type
+{};
+
+template<typename T>
+struct hash_bits4_int64 : std::true_type
+{
+    static __m256i
+    load(const T* p)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    }
+};
+
+template<>
+struct hash_bits4<long> : hash_bits4_int64<long>
+{};
+template<>
+struct hash_bits4<long long> : hash_bits4_int64<long long>
+{};
+template<>
+struct hash_bits4<unsigned long> : hash_bits4_int64<unsigned long>
+{};
+template<>
+struct hash_bits4<unsigned long long> : hash_bits4_int64<unsigned long long>
+{};
+
+template<>
+struct hash_bits4<int> : std::true_type
+{
+    static __m256i
+    load(const int* p)
+    {
+        return _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    }
+};
+
+template<>
+struct hash_bits4<unsigned int> : std::true_type
+{
+    static __m256i
+    load(const unsigned int* p)
+    {
+        return _mm256_cvtepu32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    }
+};
+
+template<>
+struct hash_bits4<double> : std::true_type
+{
+    static __m256i
+    load(const double* p)
+    {
+        __m256d v    = _mm256_loadu_pd(p);
+        __m256d zero = _mm256_cmp_pd(v, _mm256_setzero_pd(), _CMP_EQ_OQ);
+        return _mm256_castpd_si256(_mm256_andnot_pd(zero, v));
+    }
+};
+#endif
+
+// Fold one key column into a vector of row hashes. With first set the hashes
+// are started from hash_seed, otherwise the running hashes in hashes[] are
+// combined with this column.
+template<typename T>
+void
+hash_column(const T* data, size_t num, uint64_t* hashes, bool first)
+{
+    size_t i = 0;
+#if __AVX2__
+    if constexpr (hash_bits4<T>::value) {
+        const __m256i seed = _mm256_set1_epi64x(static_cast<int64_t>(hash_seed));
+        for (; i + 4 <= num; i += 4) {
+            __m256i* out = reinterpret_cast<__m256i*>(hashes + i);
+            __m256i h    = first ? seed : _mm256_loadu_si256(out);
+            _mm256_storeu_si256(out, hash_combine4(h, hash_bits4<T>::load(data + i)));
+        }
+    }
+#endif
+    for (; i < num; ++i) {
+        uint64_t h = first ? hash_seed : hashes[i];
+        hashes[i]  = hash_combine(h, hash_bits(data[i]));
+    }
+}
+
+} // namespace mf::detail
+
+#endif // INCLUDED_mainframe_detail_hash_h
@@ -0,0 +1,81 @@
+//          Copyright Ted Middleton 2022.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef INCLUDED_mainframe_detail_parallel_h
+#define INCLUDED_mainframe_detail_parallel_h
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mf::detail
+{
+
+// Resolve a user-supplied thread count. 0 means "one per hardware thread"
+inline size_t
+resolve_num_threads(size_t num_threads)
+{
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return num_threads;
+}
+
+// Run fn(i) for every i in [0, num_tasks) on up to num_threads threads. Tasks
+// are handed out one at a time so tasks of very different sizes (partitions of
+// a frame, for example) still balance. The calling thread does work too, and
+// with num_threads == 1 everything runs on the calling thread. The first
+// exception thrown by any task is rethrown here after all threads have joined.
+template<typename Fn>
+void
+parallel_for(size_t num_tasks, size_t num_threads, Fn fn)
+{
+    num_threads = std::min(resolve_num_threads(num_threads), num_tasks);
+    if (num_threads <= 1) {
+        for (size_t i = 0; i < num_tasks; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next{ 0 };
+    std::exception_ptr err;
+    std::mutex errmutex;
+    auto worker = [&]() {
+        try {
+            for (size_t i = next++; i < num_tasks; i = next++) {
+                fn(i);
+            }
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(errmutex);
+            if (!err) {
+                err = std::current_exception();
+            }
+            // Make the other workers run out of tasks
+            next = num_tasks;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    for (size_t t = 1; t < num_threads; ++t) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& th : threads) {
+        th.join();
+    }
+    if (err) {
+        std::rethrow_exception(err);
+    }
+}
+
+} // namespace mf::detail
+
+#endif // INCLUDED_mainframe_detail_parallel_h
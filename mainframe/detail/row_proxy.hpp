@@ -8,6 +8,7 @@
 
 #include "mainframe/series.hpp"
 #include "mainframe/columnindex.hpp"
+#include "mainframe/detail/hash.hpp"
 #include "mainframe/row_decl.hpp"
 #include <iterator>
 
@@ -467,18 +468,10 @@ namespace std
 template<bool IsConst, typename... Ts>
 struct hash<mf::_row_proxy<IsConst, Ts...>>
 {
-    template<size_t Ind = 0>
     size_t
     operator()(const mf::_row_proxy<IsConst, Ts...>& fr) const
     {
-        using T = typename mf::detail::pack_element<Ind, Ts...>::type;
-        std::hash<T> hasher;
-        mf::columnindex<Ind> ci;
-        size_t out = hasher(fr.at(ci));
-        if constexpr (Ind + 1 < sizeof...(Ts)) {
-            out ^= operator()<Ind + 1>(fr);
-        }
-        return out;
+        return static_cast<size_t>(mf::detail::hash_row(fr, std::index_sequence_for<Ts...>{}));
     }
 };
 } // namespace std
@@ -6,14 +6,20 @@
 #ifndef INCLUDED_mainframe_detail_simd_h
 #define INCLUDED_mainframe_detail_simd_h
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <limits>
+#include <type_traits>
+#include <vector>
 
 #if __AVX__
 #include <immintrin.h>
 #endif
 
 #include "mainframe/detail/base.hpp"
+#include "mainframe/detail/parallel.hpp"
+#include "mainframe/missing.hpp"
 
 #if !defined(__AVX__) && !defined(__ARM_NEON)
 #ifdef _MSC_VER
@@ -38,19 +44,72 @@ mean(const T* t, size_t num)
     return m / num;
 }
 
-template<typename T>
-double
-stddev(const T* t, size_t num)
+// Count, mean and sum of squared distances from the mean of a set of values,
+// updated one value at a time (Welford) and mergeable (Chan et al), so a
+// column can be summarized in one pass, in pieces, or in parallel lanes
+struct moments
 {
-    double m = mean(t, num);
-    const T* e = t + num;
-    double sqdist = 0.0;
-    for (const T* c = t; c != e; c++) {
-        double dist = *c - m;
-        sqdist += (dist * dist);
+    void
+    add(double x)
+    {
+        n += 1.0;
+        double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+    }
+
+    void
+    merge(const moments& other)
+    {
+        if (other.n == 0.0) {
+            return;
+        }
+        double total = n + other.n;
+        double delta = other.mean - mean;
+        mean += delta * other.n / total;
+        m2 += other.m2 + delta * delta * n * other.n / total;
+        n = total;
+    }
+
+    // Population variance and standard deviation
+    double
+    variance() const
+    {
+        return m2 / n;
     }
 
-    return sqrt(sqdist / num);
+    double
+    stddev() const
+    {
+        return std::sqrt(variance());
+    }
+
+    double n{ 0.0 };
+    double mean{ 0.0 };
+    double m2{ 0.0 };
+};
+
+// Each update divides by the running count and depends on the previous one,
+// so the values are spread over independent lanes that are merged at the end
+template<typename T>
+moments
+column_moments(const T* t, size_t num)
+{
+    constexpr size_t L = 4;
+    moments lanes[L];
+    size_t i = 0;
+    for (; i + L <= num; i += L) {
+        for (size_t l = 0; l < L; ++l) {
+            lanes[l].add(static_cast<double>(t[i + l]));
+        }
+    }
+    for (; i < num; ++i) {
+        lanes[0].add(static_cast<double>(t[i]));
+    }
+    for (size_t l = 1; l < L; ++l) {
+        lanes[0].merge(lanes[l]);
+    }
+    return lanes[0];
 }
 
 #if defined(__AVX__)
@@ -89,9 +148,70 @@ mean(const double* t, size_t num)
     }
     return m / num;
 }
+// Welford over two vectors of four lanes. Every lane has seen the same number
+// of values, so the division by the count is one scalar reciprocal per step.
+// load(i) returns values i .. i + 3 as doubles
+template<typename T, typename Load>
+moments
+column_moments4(const T* t, size_t num, Load load)
+{
+    __m256d mean0 = _mm256_setzero_pd();
+    __m256d mean1 = _mm256_setzero_pd();
+    __m256d m20   = _mm256_setzero_pd();
+    __m256d m21   = _mm256_setzero_pd();
+    double n      = 0.0;
+    size_t i      = 0;
+    for (; i + 8 <= num; i += 8) {
+        n += 1.0;
+        __m256d inv    = _mm256_set1_pd(1.0 / n);
+        __m256d x0     = load(i);
+        __m256d x1     = load(i + 4);
+        __m256d delta0 = _mm256_sub_pd(x0, mean0);
+        __m256d delta1 = _mm256_sub_pd(x1, mean1);
+        mean0          = _mm256_add_pd(mean0, _mm256_mul_pd(delta0, inv));
+        mean1          = _mm256_add_pd(mean1, _mm256_mul_pd(delta1, inv));
+        m20            = _mm256_add_pd(m20, _mm256_mul_pd(delta0, _mm256_sub_pd(x0, mean0)));
+        m21            = _mm256_add_pd(m21, _mm256_mul_pd(delta1, _mm256_sub_pd(x1, mean1)));
+    }
+    double means[8];
+    double m2s[8];
+    _mm256_storeu_pd(means, mean0);
+    _mm256_storeu_pd(means + 4, mean1);
+    _mm256_storeu_pd(m2s, m20);
+    _mm256_storeu_pd(m2s + 4, m21);
+    moments m;
+    for (size_t l = 0; l < 8; ++l) {
+        m.merge(moments{ n, means[l], m2s[l] });
+    }
+    for (; i < num; ++i) {
+        m.add(static_cast<double>(t[i]));
+    }
+    return m;
+}
+
+inline moments
+column_moments(const double* t, size_t num)
+{
+    return column_moments4(t, num, [t](size_t i) { return _mm256_loadu_pd(t + i); });
+}
+
+inline moments
+column_moments(const float* t, size_t num)
+{
+    return column_moments4(
+        t, num, [t](size_t i) { return _mm256_cvtps_pd(_mm_loadu_ps(t + i)); });
+}
 #elif defined(__ARM_NEON)
 #endif
 
+// Population standard deviation, in one pass
+template<typename T>
+double
+stddev(const T* t, size_t num)
+{
+    return column_moments(t, num).stddev();
+}
+
 template<typename A, typename B>
 double
 correlate_pearson(const A* a, const B* b, size_t num)
@@ -230,6 +350,398 @@ correlate_pearson(const float* a, const float* b, size_t num)
 #elif defined(__ARM_NEON)
 #endif
 
+// Operations for inclusive scans: out[i] = op(out[i - 1], in[i])
+struct scan_add
+{
+    template<typename T>
+    T
+    operator()(const T& acc, const T& x) const
+    {
+        return acc + x;
+    }
+};
+
+struct scan_mul
+{
+    template<typename T>
+    T
+    operator()(const T& acc, const T& x) const
+    {
+        return acc * x;
+    }
+};
+
+// A NaN is smaller and larger than everything, so the minimum or maximum is
+// NaN from the first NaN on, as a sum is
+struct scan_min
+{
+    template<typename T>
+    T
+    operator()(const T& acc, const T& x) const
+    {
+        if constexpr (std::is_floating_point_v<T>) {
+            if (std::isnan(x)) {
+                return x;
+            }
+        }
+        return x < acc ? x : acc;
+    }
+};
+
+struct scan_max
+{
+    template<typename T>
+    T
+    operator()(const T& acc, const T& x) const
+    {
+        if constexpr (std::is_floating_point_v<T>) {
+            if (std::isnan(x)) {
+                return x;
+            }
+        }
+        return acc < x ? x : acc;
+    }
+};
+
+// Scan num values on from carry, the result for the value before in[0], and
+// return the last result
+template<typename T, typename Op>
+T
+scan_block(const T* in, size_t num, T* out, Op op, T carry)
+{
+    for (size_t i = 0; i < num; ++i) {
+        carry  = op(carry, in[i]);
+        out[i] = carry;
+    }
+    return carry;
+}
+
+#if defined(__AVX__)
+
+// The vector forms of the scan operations, and the value each leaves alone
+template<typename Op>
+struct simd_scan;
+
+template<>
+struct simd_scan<scan_add>
+{
+    static __m256d
+    apply(__m256d a, __m256d b)
+    {
+        return _mm256_add_pd(a, b);
+    }
+    static __m256
+    apply(__m256 a, __m256 b)
+    {
+        return _mm256_add_ps(a, b);
+    }
+    template<typename T>
+    static T
+    identity()
+    {
+        return T{ 0 };
+    }
+};
+
+template<>
+struct simd_scan<scan_mul>
+{
+    static __m256d
+    apply(__m256d a, __m256d b)
+    {
+        return _mm256_mul_pd(a, b);
+    }
+    static __m256
+    apply(__m256 a, __m256 b)
+    {
+        return _mm256_mul_ps(a, b);
+    }
+    template<typename T>
+    static T
+    identity()
+    {
+        return T{ 1 };
+    }
+};
+
+template<>
+struct simd_scan<scan_min>
+{
+    // _mm256_min_pd() gives b when either is NaN; the sum is NaN instead
+    static __m256d
+    apply(__m256d a, __m256d b)
+    {
+        return _mm256_blendv_pd(
+            _mm256_min_pd(a, b), _mm256_add_pd(a, b), _mm256_cmp_pd(a, b, _CMP_UNORD_Q));
+    }
+    static __m256
+    apply(__m256 a, __m256 b)
+    {
+        return _mm256_blendv_ps(
+            _mm256_min_ps(a, b), _mm256_add_ps(a, b), _mm256_cmp_ps(a, b, _CMP_UNORD_Q));
+    }
+    template<typename T>
+    static T
+    identity()
+    {
+        return std::numeric_limits<T>::infinity();
+    }
+};
+
+template<>
+struct simd_scan<scan_max>
+{
+    static __m256d
+    apply(__m256d a, __m256d b)
+    {
+        return _mm256_blendv_pd(
+            _mm256_max_pd(a, b), _mm256_add_pd(a, b), _mm256_cmp_pd(a, b, _CMP_UNORD_Q));
+    }
+    static __m256
+    apply(__m256 a, __m256 b)
+    {
+        return _mm256_blendv_ps(
+            _mm256_max_ps(a, b), _mm256_add_ps(a, b), _mm256_cmp_ps(a, b, _CMP_UNORD_Q));
+    }
+    template<typename T>
+    static T
+    identity()
+    {
+        return -std::numeric_limits<T>::infinity();
+    }
+};
+
+// Each vector is scanned in registers - combined with itself shifted up one
+// lane, then two (then four), with the identity shifted in - and then
+// combined with the last result of the vector before, broadcast to every lane
+template<typename Op>
+double
+scan_block(const double* in, size_t num, double* out, Op op, double carry)
+{
+    using V          = simd_scan<Op>;
+    const __m256d id = _mm256_set1_pd(V::template identity<double>());
+    __m256d acc      = _mm256_set1_pd(carry);
+    size_t i         = 0;
+    for (; i + 4 <= num; i += 4) {
+        __m256d x = _mm256_loadu_pd(in + i);
+        __m256d t = _mm256_permute2f128_pd(id, x, 0x20);
+        x         = V::apply(x, _mm256_shuffle_pd(t, x, 0x5));
+        x         = V::apply(x, _mm256_permute2f128_pd(id, x, 0x20));
+        x         = V::apply(acc, x);
+        _mm256_storeu_pd(out + i, x);
+        acc = _mm256_permute_pd(_mm256_permute2f128_pd(x, x, 0x11), 0xf);
+    }
+    return scan_block<double>(in + i, num - i, out + i, op, _mm256_cvtsd_f64(acc));
+}
+
+template<typename Op>
+float
+scan_block(const float* in, size_t num, float* out, Op op, float carry)
+{
+    using V         = simd_scan<Op>;
+    const __m256 id = _mm256_set1_ps(V::template identity<float>());
+    __m256 acc      = _mm256_set1_ps(carry);
+    size_t i        = 0;
+    for (; i + 8 <= num; i += 8) {
+        __m256 x = _mm256_loadu_ps(in + i);
+        x        = V::apply(x, _mm256_blend_ps(_mm256_permute_ps(x, 0x90), id, 0x11));
+        x        = V::apply(x, _mm256_blend_ps(_mm256_permute_ps(x, 0x40), id, 0x33));
+        x        = V::apply(x, _mm256_permute2f128_ps(id, _mm256_permute_ps(x, 0xff), 0x20));
+        x        = V::apply(acc, x);
+        _mm256_storeu_ps(out + i, x);
+        acc = _mm256_permute2f128_ps(_mm256_permute_ps(x, 0xff), x, 0x11);
+    }
+    return scan_block<float>(in + i, num - i, out + i, op, _mm256_cvtss_f32(acc));
+}
+
+#if defined(__AVX2__)
+// Integer sums wrap the same whichever order they're added in, so they can
+// be scanned in registers too. Integer products, minimums and maximums are
+// left to the scalar loop
+inline int64_t
+scan_block(const int64_t* in, size_t num, int64_t* out, scan_add op, int64_t carry)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc        = _mm256_set1_epi64x(carry);
+    size_t i           = 0;
+    for (; i + 4 <= num; i += 4) {
+        auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        auto t = _mm256_blend_epi32(_mm256_permute4x64_epi64(x, 0x90), zero, 0x03);
+        x      = _mm256_add_epi64(x, t);
+        t      = _mm256_blend_epi32(_mm256_permute4x64_epi64(x, 0x40), zero, 0x0f);
+        x      = _mm256_add_epi64(x, t);
+        x      = _mm256_add_epi64(acc, x);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), x);
+        acc = _mm256_permute4x64_epi64(x, 0xff);
+    }
+    return scan_block<int64_t>(in + i, num - i, out + i, op, _mm256_extract_epi64(acc, 0));
+}
+
+inline int32_t
+scan_block(const int32_t* in, size_t num, int32_t* out, scan_add op, int32_t carry)
+{
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i lane3 = _mm256_set1_epi32(3);
+    const __m256i lane7 = _mm256_set1_epi32(7);
+    __m256i acc         = _mm256_set1_epi32(carry);
+    size_t i            = 0;
+    for (; i + 8 <= num; i += 8) {
+        auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        x      = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+        x      = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+        x      = _mm256_add_epi32(
+            x, _mm256_blend_epi32(zero, _mm256_permutevar8x32_epi32(x, lane3), 0xf0));
+        x = _mm256_add_epi32(acc, x);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), x);
+        acc = _mm256_permutevar8x32_epi32(x, lane7);
+    }
+    return scan_block<int32_t>(in + i, num - i, out + i, op, _mm256_extract_epi32(acc, 0));
+}
+#endif
+
+#elif defined(__ARM_NEON)
+#endif
+
+// Below this many values a block isn't worth a thread
+constexpr size_t min_scan_block = 1 << 16;
+
+// out[i] = op(in[0], ..., in[i]). A long column can be scanned on up to
+// num_threads threads (0 means one per hardware thread) in two passes: each
+// block is scanned on its own, then every block but the first is combined
+// with the result of the blocks before it, which is a scan of the blocks'
+// last results
+template<typename T, typename Op>
+void
+inclusive_scan(const T* in, size_t num, T* out, Op op, size_t num_threads = 1)
+{
+    if (num == 0) {
+        return;
+    }
+    num_threads          = resolve_num_threads(num_threads);
+    const size_t nblocks = std::min(num_threads, num / min_scan_block);
+    if (nblocks <= 1) {
+        out[0] = in[0];
+        scan_block(in + 1, num - 1, out + 1, op, in[0]);
+        return;
+    }
+
+    const size_t block = (num + nblocks - 1) / nblocks;
+    std::vector<T> lasts(nblocks);
+    parallel_for(nblocks, num_threads, [&](size_t b) {
+        const size_t first = b * block;
+        const size_t n     = std::min(block, num - first);
+        out[first]         = in[first];
+        lasts[b]           = scan_block(in + first + 1, n - 1, out + first + 1, op, in[first]);
+    });
+    for (size_t b = 1; b < nblocks; ++b) {
+        lasts[b] = op(lasts[b - 1], lasts[b]);
+    }
+    parallel_for(nblocks - 1, num_threads, [&](size_t b) {
+        const T carry      = lasts[b];
+        const size_t first = (b + 1) * block;
+        const size_t last  = std::min(first + block, num);
+        for (size_t i = first; i < last; ++i) {
+            out[i] = op(carry, out[i]);
+        }
+    });
+}
+
+// The scan of a column of mi<T>: missing values stay missing and are passed
+// over, so each result is the scan of the values present up to there
+template<typename T, typename Op>
+void
+inclusive_scan(const mi<T>* in, size_t num, mi<T>* out, Op op, size_t /*num_threads*/ = 1)
+{
+    mi<T> carry;
+    for (size_t i = 0; i < num; ++i) {
+        if (in[i].has_value()) {
+            carry  = carry.has_value() ? op(*carry, *in[i]) : *in[i];
+            out[i] = carry;
+        }
+        else {
+            out[i] = missing;
+        }
+    }
+}
+
+// diff() of a column of T gives NaN where there's no value n rows back if T is
+// floating point, or mi<T> otherwise
+template<typename T>
+struct diff_result
+{
+    using type = std::conditional_t<std::is_floating_point_v<T>, T, mi<T>>;
+};
+
+template<typename T>
+struct diff_result<mi<T>>
+{
+    using type = mi<T>;
+};
+
+// pct_change() gives float for float, double for everything else
+template<typename T>
+struct pct_change_result
+{
+    using type = std::conditional_t<std::is_same_v<T, float>, float, double>;
+};
+
+template<typename T>
+struct pct_change_result<mi<T>>
+{
+    using type = mi<typename pct_change_result<T>::type>;
+};
+
+// out[i] = in[i] - in[i - n]. Once the first n are written the loop has
+// no branches and no carried dependencies, so it vectorizes
+template<typename T, typename U>
+void
+difference(const T* in, size_t num, size_t n, U* out)
+{
+    const size_t head = std::min(n, num);
+    if constexpr (is_missing<T>::value) {
+        std::fill(out, out + head, U{});
+        for (size_t i = head; i < num; ++i) {
+            out[i] = in[i].has_value() && in[i - n].has_value() ? U{ *in[i] - *in[i - n] } : U{};
+        }
+    }
+    else if constexpr (is_missing<U>::value) {
+        std::fill(out, out + head, U{});
+        for (size_t i = head; i < num; ++i) {
+            out[i] = U{ in[i] - in[i - n] };
+        }
+    }
+    else {
+        std::fill(out, out + head, std::numeric_limits<U>::quiet_NaN());
+        for (size_t i = head; i < num; ++i) {
+            out[i] = in[i] - in[i - n];
+        }
+    }
+}
+
+// out[i] = in[i] / in[i - n] - 1, with NaN (or missing, for mi<T>) where
+// there's no value n rows back
+template<typename T, typename U>
+void
+percent_change(const T* in, size_t num, size_t n, U* out)
+{
+    const size_t head = std::min(n, num);
+    if constexpr (is_missing<T>::value) {
+        using R = typename U::value_type;
+        std::fill(out, out + head, U{});
+        for (size_t i = head; i < num; ++i) {
+            out[i] = in[i].has_value() && in[i - n].has_value()
+                ? U{ static_cast<R>(*in[i]) / static_cast<R>(*in[i - n]) - R{ 1 } }
+                : U{};
+        }
+    }
+    else {
+        std::fill(out, out + head, std::numeric_limits<U>::quiet_NaN());
+        for (size_t i = head; i < num; ++i) {
+            out[i] = static_cast<U>(in[i]) / static_cast<U>(in[i - n]) - U{ 1 };
+        }
+    }
+}
+
 } // namespace mf::detail
 
 #endif // INCLUDED_mainframe_detail_simd_h
@@ -0,0 +1,267 @@
+//          Copyright Ted Middleton 2022.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef INCLUDED_mainframe_detail_sketch_h
+#define INCLUDED_mainframe_detail_sketch_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Fixed-size, mergeable summaries of a stream of values, for aggregations
+// whose exact answer would need every value: t-digest for quantiles and
+// HyperLogLog for distinct counts. Both can be filled in pieces (one per
+// thread, say) and the pieces merged, and neither grows with the number of
+// values it has seen.
+
+namespace mf::detail
+{
+
+// A t-digest (Dunning) of the merging kind: incoming values are buffered and
+// every so often sorted together with the existing centroids and merged
+// greedily, so that centroids near the median can hold many values but
+// centroids near the tails stay small. That keeps extreme quantiles accurate.
+// With the default compression of 100 there are at most about 100 centroids,
+// plus a buffer of up to buffer_size values - about 4KB all told.
+class tdigest
+{
+public:
+    static constexpr size_t buffer_size = 128;
+
+    explicit tdigest(double compression = 100.0)
+        : m_compression(compression)
+    {}
+
+    void
+    add(double x, double weight = 1.0)
+    {
+        if (m_buffer.empty()) {
+            m_buffer.reserve(buffer_size);
+        }
+        m_buffer.push_back(centroid{ x, weight });
+        m_total += weight;
+        m_min = std::min(m_min, x);
+        m_max = std::max(m_max, x);
+        if (m_buffer.size() >= buffer_size) {
+            compress();
+        }
+    }
+
+    void
+    merge(const tdigest& other)
+    {
+        for (const auto& c : other.m_centroids) {
+            add(c.mean, c.weight);
+        }
+        for (const auto& c : other.m_buffer) {
+            add(c.mean, c.weight);
+        }
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    // Fold the buffered values into the centroids
+    void
+    compress()
+    {
+        if (m_buffer.empty()) {
+            return;
+        }
+        std::vector<centroid> all;
+        all.reserve(m_centroids.size() + m_buffer.size());
+        all.insert(all.end(), m_centroids.begin(), m_centroids.end());
+        all.insert(all.end(), m_buffer.begin(), m_buffer.end());
+        std::sort(all.begin(), all.end(),
+            [](const centroid& a, const centroid& b) { return a.mean < b.mean; });
+        m_buffer.clear();
+        m_centroids.clear();
+
+        // A centroid can grow until the scale function k() has moved by one
+        // across it
+        centroid cur  = all[0];
+        double so_far = 0.0;
+        double limit  = m_total * k_inverse(k(0.0) + 1.0);
+        for (size_t i = 1; i < all.size(); ++i) {
+            const centroid& c = all[i];
+            if (so_far + cur.weight + c.weight <= limit) {
+                cur.weight += c.weight;
+                cur.mean += (c.mean - cur.mean) * c.weight / cur.weight;
+            }
+            else {
+                so_far += cur.weight;
+                m_centroids.push_back(cur);
+                cur   = c;
+                limit = m_total * k_inverse(k(so_far / m_total) + 1.0);
+            }
+        }
+        m_centroids.push_back(cur);
+    }
+
+    // The approximate q-quantile, or NaN if nothing has been added
+    double
+    quantile(double q) const
+    {
+        if (!m_buffer.empty()) {
+            tdigest t = *this;
+            t.compress();
+            return t.quantile(q);
+        }
+        if (m_centroids.empty()) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        if (m_centroids.size() == 1) {
+            return m_centroids[0].mean;
+        }
+
+        // Each centroid's mean sits at the middle of its weight; in between,
+        // and out to the min and max at the ends, interpolate linearly
+        const double target  = q * m_total;
+        const centroid& head = m_centroids.front();
+        const centroid& tail = m_centroids.back();
+        if (target < head.weight / 2.0) {
+            return m_min + (head.mean - m_min) * target / (head.weight / 2.0);
+        }
+        if (target > m_total - tail.weight / 2.0) {
+            double into = target - (m_total - tail.weight / 2.0);
+            return tail.mean + (m_max - tail.mean) * into / (tail.weight / 2.0);
+        }
+        double center = head.weight / 2.0;
+        for (size_t i = 1; i < m_centroids.size(); ++i) {
+            const centroid& a = m_centroids[i - 1];
+            const centroid& b = m_centroids[i];
+            double next       = center + (a.weight + b.weight) / 2.0;
+            if (target <= next) {
+                return a.mean + (b.mean - a.mean) * (target - center) / (next - center);
+            }
+            center = next;
+        }
+        return tail.mean;
+    }
+
+    double
+    count() const
+    {
+        return m_total;
+    }
+
+    size_t
+    num_centroids() const
+    {
+        return m_centroids.size();
+    }
+
+private:
+    struct centroid
+    {
+        double mean;
+        double weight;
+    };
+
+    static constexpr double pi = 3.14159265358979323846;
+
+    double
+    k(double q) const
+    {
+        return m_compression / (2.0 * pi) * std::asin(2.0 * q - 1.0);
+    }
+
+    double
+    k_inverse(double kv) const
+    {
+        double a = std::min(kv * 2.0 * pi / m_compression, pi / 2.0);
+        return (std::sin(a) + 1.0) / 2.0;
+    }
+
+    double m_compression;
+    double m_total{ 0.0 };
+    double m_min{ std::numeric_limits<double>::infinity() };
+    double m_max{ -std::numeric_limits<double>::infinity() };
+    std::vector<centroid> m_centroids;
+    std::vector<centroid> m_buffer;
+};
+
+// HyperLogLog (Flajolet et al) over 64 bit hashes, with 2^precision one-byte
+// registers - 4KB at the default precision of 12, for a standard error of
+// about 1.6%. Small counts are estimated by linear counting instead.
+class hyperloglog
+{
+public:
+    explicit hyperloglog(unsigned precision = 12)
+        : m_precision(precision)
+    {}
+
+    void
+    add_hash(uint64_t h)
+    {
+        if (m_registers.empty()) {
+            m_registers.assign(size_t{ 1 } << m_precision, 0);
+        }
+        const size_t reg = static_cast<size_t>(h >> (64 - m_precision));
+        // The guard bit stops the count at 64 - precision + 1
+        const uint64_t rest = (h << m_precision) | (uint64_t{ 1 } << (m_precision - 1));
+        const auto rank     = static_cast<uint8_t>(leading_zeros(rest) + 1);
+        m_registers[reg]    = std::max(m_registers[reg], rank);
+    }
+
+    void
+    merge(const hyperloglog& other)
+    {
+        if (other.m_registers.empty()) {
+            return;
+        }
+        if (m_registers.empty()) {
+            m_registers = other.m_registers;
+            return;
+        }
+        for (size_t i = 0; i < m_registers.size(); ++i) {
+            m_registers[i] = std::max(m_registers[i], other.m_registers[i]);
+        }
+    }
+
+    double
+    estimate() const
+    {
+        if (m_registers.empty()) {
+            return 0.0;
+        }
+        const double m = static_cast<double>(m_registers.size());
+        double sum     = 0.0;
+        size_t zeros   = 0;
+        for (uint8_t r : m_registers) {
+            sum += std::ldexp(1.0, -static_cast<int>(r));
+            zeros += r == 0 ? 1 : 0;
+        }
+        const double alpha = 0.7213 / (1.0 + 1.079 / m);
+        double e           = alpha * m * m / sum;
+        if (e <= 2.5 * m && zeros > 0) {
+            e = m * std::log(m / static_cast<double>(zeros));
+        }
+        return e;
+    }
+
+private:
+    static unsigned
+    leading_zeros(uint64_t x)
+    {
+#if defined(__GNUC__)
+        return static_cast<unsigned>(__builtin_clzll(x));
+#else
+        unsigned n = 0;
+        for (uint64_t bit = uint64_t{ 1 } << 63; (x & bit) == 0; bit >>= 1) {
+            ++n;
+        }
+        return n;
+#endif
+    }
+
+    unsigned m_precision;
+    std::vector<uint8_t> m_registers;
+};
+
+} // namespace mf::detail
+
+#endif // INCLUDED_mainframe_detail_sketch_h
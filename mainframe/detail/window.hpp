@@ -0,0 +1,716 @@
+//          Copyright Ted Middleton 2022.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef INCLUDED_mainframe_detail_window_h
+#define INCLUDED_mainframe_detail_window_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "mainframe/detail/base.hpp"
+#include "mainframe/detail/simd.hpp"
+#include "mainframe/missing.hpp"
+
+// Window kernels. Each one takes a run of num values in order - a whole
+// column, or one group's values gathered in row order - and writes one result
+// per value, in a single pass. Rolling windows cover the current value and up
+// to window - 1 before it, so the first few windows are short.
+
+namespace mf::detail
+{
+
+// Running sums, minimums and maximums, scanned as series::cumsum() and the
+// rest are: missing values stay missing and are passed over, and a NaN makes
+// every result from its row on NaN
+template<typename T>
+void
+cumulative_sum(const T* data, size_t num, T* out)
+{
+    inclusive_scan(data, num, out, scan_add{});
+}
+
+template<typename T>
+void
+cumulative_max(const T* data, size_t num, T* out)
+{
+    inclusive_scan(data, num, out, scan_max{});
+}
+
+template<typename T>
+void
+cumulative_min(const T* data, size_t num, T* out)
+{
+    inclusive_scan(data, num, out, scan_min{});
+}
+
+// out[i] = data[i - n], or missing for the first n values
+template<typename T, typename U>
+void
+shift_back(const T* data, size_t num, size_t n, U* out)
+{
+    for (size_t i = 0; i < num; ++i) {
+        out[i] = i >= n ? U{ data[i - n] } : U{};
+    }
+}
+
+// out[i] = data[i + n], or missing for the last n values
+template<typename T, typename U>
+void
+shift_forward(const T* data, size_t num, size_t n, U* out)
+{
+    for (size_t i = 0; i < num; ++i) {
+        out[i] = i + n < num ? U{ data[i + n] } : U{};
+    }
+}
+
+// SQL's RANK(): one more than the number of smaller values, so ties share a
+// rank and leave a gap after them. With dense set, ties leave no gap, as in
+// DENSE_RANK()
+template<typename T>
+void
+rank_values(const T* data, size_t num, bool dense, size_t* out)
+{
+    std::vector<size_t> order(num);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(
+        order.begin(), order.end(), [data](size_t a, size_t b) { return data[a] < data[b]; });
+    size_t rank = 0;
+    for (size_t k = 0; k < num; ++k) {
+        if (k == 0 || data[order[k - 1]] < data[order[k]]) {
+            rank = dense ? rank + 1 : k + 1;
+        }
+        out[order[k]] = rank;
+    }
+}
+
+// Whether a rolling window can use a value. Missing values and NaNs are kept
+// out of the running totals and counted instead, and a window holding any of
+// them gives window_gap(): missing, or NaN. Once they leave the window, the
+// results are as if they had never been there
+template<typename T>
+bool
+window_value_ok(const T& v)
+{
+    if constexpr (is_missing<T>::value) {
+        return v.has_value() && window_value_ok(*v);
+    }
+    else if constexpr (std::is_floating_point_v<T>) {
+        return !std::isnan(v);
+    }
+    else {
+        return true;
+    }
+}
+
+template<typename U>
+U
+window_gap()
+{
+    if constexpr (std::is_floating_point_v<U>) {
+        return std::numeric_limits<U>::quiet_NaN();
+    }
+    else {
+        return U{};
+    }
+}
+
+// The sum of each window, kept up to date by adding the value coming in and
+// subtracting the one going out
+template<typename T, typename U>
+void
+rolling_sum(const T* data, size_t num, size_t window, U* out)
+{
+    using V     = typename unwrap_missing<U>::type;
+    V acc       = V{};
+    size_t gaps = 0;
+    for (size_t i = 0; i < num; ++i) {
+        if (window_value_ok(data[i])) {
+            acc = acc + static_cast<V>(unwrap_missing<T>::unwrap(data[i]));
+        }
+        else {
+            ++gaps;
+        }
+        if (i >= window) {
+            if (window_value_ok(data[i - window])) {
+                acc = acc - static_cast<V>(unwrap_missing<T>::unwrap(data[i - window]));
+            }
+            else {
+                --gaps;
+            }
+        }
+        out[i] = gaps == 0 ? U{ acc } : window_gap<U>();
+    }
+}
+
+template<typename T, typename U>
+void
+rolling_mean(const T* data, size_t num, size_t window, U* out)
+{
+    rolling_sum(data, num, window, out);
+    for (size_t i = 0; i < num; ++i) {
+        const size_t n = std::min(i + 1, window);
+        if constexpr (std::is_arithmetic_v<U>) {
+            out[i] /= static_cast<U>(n);
+        }
+        else {
+            out[i] = out[i] / n;
+        }
+    }
+}
+
+// The population standard deviation of each window. The window's mean and
+// sum of squared deviations are updated as values come in and go out
+// (Welford's update, run backwards for the value leaving), which doesn't lose
+// precision to cancellation the way a running sum of squares does
+template<typename T, typename U>
+void
+rolling_std(const T* data, size_t num, size_t window, U* out)
+{
+    double n    = 0.0;
+    double mean = 0.0;
+    double m2   = 0.0;
+    size_t gaps = 0;
+    for (size_t i = 0; i < num; ++i) {
+        if (window_value_ok(data[i])) {
+            const auto x = static_cast<double>(unwrap_missing<T>::unwrap(data[i]));
+            n += 1.0;
+            const double delta = x - mean;
+            mean += delta / n;
+            m2 += delta * (x - mean);
+        }
+        else {
+            ++gaps;
+        }
+        if (i >= window) {
+            if (!window_value_ok(data[i - window])) {
+                --gaps;
+            }
+            else if (n > 1.0) {
+                const auto y = static_cast<double>(unwrap_missing<T>::unwrap(data[i - window]));
+                n -= 1.0;
+                const double delta = y - mean;
+                mean -= delta / n;
+                m2 -= delta * (y - mean);
+            }
+            else {
+                n    = 0.0;
+                mean = 0.0;
+                m2   = 0.0;
+            }
+        }
+        out[i] = gaps == 0 ? static_cast<U>(std::sqrt(std::max(m2, 0.0) / n)) : window_gap<U>();
+    }
+}
+
+// The smallest (with Less = std::less) value of each window, from a queue of
+// the window's candidates: the values that nothing later in the window beats.
+// They're in increasing order, so the front is the answer, and each value is
+// queued and dropped once. Missing values and NaNs are never queued, and are
+// counted as in rolling_sum()
+template<typename T, typename Less>
+void
+rolling_extreme(const T* data, size_t num, size_t window, T* out, Less less)
+{
+    std::vector<size_t> queue(num);
+    size_t head = 0;
+    size_t tail = 0;
+    size_t gaps = 0;
+    for (size_t i = 0; i < num; ++i) {
+        if (window_value_ok(data[i])) {
+            while (tail > head && !less(data[queue[tail - 1]], data[i])) {
+                --tail;
+            }
+            queue[tail++] = i;
+        }
+        else {
+            ++gaps;
+        }
+        if (i >= window && !window_value_ok(data[i - window])) {
+            --gaps;
+        }
+        if (tail > head && queue[head] + window <= i) {
+            ++head;
+        }
+        out[i] = gaps == 0 ? data[queue[head]] : window_gap<T>();
+    }
+}
+
+template<typename T>
+void
+rolling_min(const T* data, size_t num, size_t window, T* out)
+{
+    rolling_extreme(data, num, window, out, [](const T& a, const T& b) { return a < b; });
+}
+
+template<typename T>
+void
+rolling_max(const T* data, size_t num, size_t window, T* out)
+{
+    rolling_extreme(data, num, window, out, [](const T& a, const T& b) { return b < a; });
+}
+
+inline void
+check_ewm_alpha(double alpha)
+{
+    if (!(alpha > 0.0 && alpha <= 1.0)) {
+        throw std::invalid_argument{ "alpha must be in (0, 1]" };
+    }
+}
+
+// The exponentially weighted mean with smoothing factor alpha. With adjust
+// set, each mean is the average of the values so far weighted by
+// (1 - alpha)^age, age counted in rows; without it, it's the recursion
+// y = (1 - alpha) * y' + alpha * x. A missing value adds nothing but still
+// ages the values before it, so the mean carries across gaps, as in pandas
+// with ignore_na=False. Rows before the first value are missing
+template<typename T, typename U>
+void
+ewm_mean(const T* data, size_t num, double alpha, bool adjust, U* out)
+{
+    const double decay  = 1.0 - alpha;
+    const double new_wt = adjust ? 1.0 : alpha;
+    double old_wt       = 1.0;
+    double mean         = 0.0;
+    bool started        = false;
+    for (size_t i = 0; i < num; ++i) {
+        bool present = true;
+        if constexpr (is_missing<T>::value) {
+            present = data[i].has_value();
+        }
+        const auto x = present ? static_cast<double>(unwrap_missing<T>::unwrap(data[i])) : 0.0;
+        if (started) {
+            old_wt *= decay;
+            if (present) {
+                // Leaving a constant run alone keeps it exact
+                if (mean != x) {
+                    mean = (old_wt * mean + new_wt * x) / (old_wt + new_wt);
+                }
+                old_wt = adjust ? old_wt + new_wt : 1.0;
+            }
+        }
+        else if (present) {
+            mean    = x;
+            started = true;
+        }
+        out[i] = started ? U{ mean } : U{};
+    }
+}
+
+// The exponentially weighted variance, weighted as in ewm_mean and corrected
+// for bias the way pandas does with the weights' sum and sum of squares. A
+// row is missing until there are two values to compare
+template<typename T, typename U>
+void
+ewm_var(const T* data, size_t num, double alpha, bool adjust, U* out)
+{
+    const double decay  = 1.0 - alpha;
+    const double new_wt = adjust ? 1.0 : alpha;
+    double old_wt       = 1.0;
+    double sum_wt       = 1.0;
+    double sum_wt2      = 1.0;
+    double mean         = 0.0;
+    double var          = 0.0;
+    bool started        = false;
+    for (size_t i = 0; i < num; ++i) {
+        bool present = true;
+        if constexpr (is_missing<T>::value) {
+            present = data[i].has_value();
+        }
+        const auto x = present ? static_cast<double>(unwrap_missing<T>::unwrap(data[i])) : 0.0;
+        if (started) {
+            sum_wt *= decay;
+            sum_wt2 *= decay * decay;
+            old_wt *= decay;
+            if (present) {
+                const double old_mean = mean;
+                if (mean != x) {
+                    mean = (old_wt * old_mean + new_wt * x) / (old_wt + new_wt);
+                }
+                const double shift = old_mean - mean;
+                var = (old_wt * (var + shift * shift) + new_wt * (x - mean) * (x - mean)) /
+                    (old_wt + new_wt);
+                sum_wt += new_wt;
+                sum_wt2 += new_wt * new_wt;
+                old_wt += new_wt;
+                if (!adjust) {
+                    sum_wt /= old_wt;
+                    sum_wt2 /= old_wt * old_wt;
+                    old_wt = 1.0;
+                }
+            }
+        }
+        else if (present) {
+            mean    = x;
+            started = true;
+        }
+        const double numer = sum_wt * sum_wt;
+        const double denom = numer - sum_wt2;
+        out[i]             = started && denom > 0.0 ? U{ numer / denom * var } : U{};
+    }
+}
+
+// The whole-column kernels as function objects, for expressions. Each holds
+// its parameters, and result_type<T> is what it gives for values of T: the
+// mean and standard deviation of integers are doubles, and the exponentially
+// weighted statistics are missing where they aren't defined yet
+// The mean or standard deviation of values of T: a double for integers, and
+// mi<double> for mi<integer>
+template<typename T>
+struct rolling_moment_result
+{
+    using type = std::conditional_t<std::is_integral_v<T>, double, T>;
+};
+
+template<typename T>
+struct rolling_moment_result<mi<T>>
+{
+    using type = mi<typename rolling_moment_result<T>::type>;
+};
+
+struct rolling_sum_kernel
+{
+    template<typename T>
+    using result_type = T;
+
+    template<typename T>
+    void
+    operator()(const T* data, size_t num, result_type<T>* out) const
+    {
+        rolling_sum(data, num, window, out);
+    }
+
+    size_t window;
+};
+
+struct rolling_mean_kernel
+{
+    template<typename T>
+    using result_type = typename rolling_moment_result<T>::type;
+
+    template<typename T>
+    void
+    operator()(const T* data, size_t num, result_type<T>* out) const
+    {
+        rolling_mean(data, num, window, out);
+    }
+
+    size_t window;
+};
+
+struct rolling_std_kernel
+{
+    template<typename T>
+    using result_type = typename rolling_moment_result<T>::type;
+
+    template<typename T>
+    void
+    operator()(const T* data, size_t num, result_type<T>* out) const
+    {
+        rolling_std(data, num, window, out);
+    }
+
+    size_t window;
+};
+
+struct rolling_min_kernel
+{
+    template<typename T>
+    using result_type = T;
+
+    template<typename T>
+    void
+    operator()(const T* data, size_t num, result_type<T>* out) const
+    {
+        rolling_min(data, num, window, out);
+    }
+
+    size_t window;
+};
+
+struct rolling_max_kernel
+{
+    template<typename T>
+    using result_type = T;
+
+    template<typename T>
+    void
+    operator()(const T* data, size_t num, result_type<T>* out) const
+    {
+        rolling_max(data, num, window, out);
+    }
+
+    size_t window;
+};
+
+struct ewm_mean_kernel
+{
+    template<typename T>
+    using result_type = std::conditional_t<is_missing<T>::value, mi<double>, double>;
+
+    template<typename T>
+    void
+    operator()(const T* data, size_t num, result_type<T>* out) const
+    {
+        ewm_mean(data, num, alpha, adjust, out);
+    }
+
+    double alpha;
+    bool adjust;
+};
+
+struct ewm_var_kernel
+{
+    template<typename T>
+    using result_type = mi<double>;
+
+    template<typename T>
+    void
+    operator()(const T* data, size_t num, result_type<T>* out) const
+    {
+        ewm_var(data, num, alpha, adjust, out);
+    }
+
+    double alpha;
+    bool adjust;
+};
+
+struct row_number_op
+{};
+
+template<size_t Ind>
+struct rank_op : std::integral_constant<size_t, Ind>
+{};
+
+template<size_t Ind>
+struct dense_rank_op : std::integral_constant<size_t, Ind>
+{};
+
+template<size_t Ind>
+struct lag_op : std::integral_constant<size_t, Ind>
+{
+    size_t n{ 1 };
+};
+
+template<size_t Ind>
+struct lead_op : std::integral_constant<size_t, Ind>
+{
+    size_t n{ 1 };
+};
+
+template<size_t Ind>
+struct cumsum_op : std::integral_constant<size_t, Ind>
+{};
+
+template<size_t Ind>
+struct cummin_op : std::integral_constant<size_t, Ind>
+{};
+
+template<size_t Ind>
+struct cummax_op : std::integral_constant<size_t, Ind>
+{};
+
+template<size_t Ind>
+struct rolling_sum_op : std::integral_constant<size_t, Ind>
+{
+    size_t window{ 1 };
+};
+
+template<size_t Ind>
+struct rolling_mean_op : std::integral_constant<size_t, Ind>
+{
+    size_t window{ 1 };
+};
+
+template<size_t Ind>
+struct rolling_std_op : std::integral_constant<size_t, Ind>
+{
+    size_t window{ 1 };
+};
+
+template<size_t Ind>
+struct rolling_min_op : std::integral_constant<size_t, Ind>
+{
+    size_t window{ 1 };
+};
+
+template<size_t Ind>
+struct rolling_max_op : std::integral_constant<size_t, Ind>
+{
+    size_t window{ 1 };
+};
+
+// A window op over one run of values of type T: the type of its results, and
+// apply(op, data, num, out)
+template<typename Op, typename T>
+struct window_agg
+{
+    using result_type = T;
+};
+
+template<typename T>
+struct window_agg<row_number_op, T>
+{
+    using result_type = size_t;
+
+    static void
+    apply(row_number_op, const T*, size_t num, size_t* out)
+    {
+        std::iota(out, out + num, size_t{ 1 });
+    }
+};
+
+template<size_t Ind, typename T>
+struct window_agg<rank_op<Ind>, T>
+{
+    using result_type = size_t;
+
+    static void
+    apply(rank_op<Ind>, const T* data, size_t num, size_t* out)
+    {
+        rank_values(data, num, false, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct window_agg<dense_rank_op<Ind>, T>
+{
+    using result_type = size_t;
+
+    static void
+    apply(dense_rank_op<Ind>, const T* data, size_t num, size_t* out)
+    {
+        rank_values(data, num, true, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct window_agg<lag_op<Ind>, T>
+{
+    using result_type = typename ensure_missing<T>::type;
+
+    static void
+    apply(lag_op<Ind> op, const T* data, size_t num, result_type* out)
+    {
+        shift_back(data, num, op.n, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct window_agg<lead_op<Ind>, T>
+{
+    using result_type = typename ensure_missing<T>::type;
+
+    static void
+    apply(lead_op<Ind> op, const T* data, size_t num, result_type* out)
+    {
+        shift_forward(data, num, op.n, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct window_agg<cumsum_op<Ind>, T>
+{
+    using result_type = T;
+
+    static void
+    apply(cumsum_op<Ind>, const T* data, size_t num, T* out)
+    {
+        cumulative_sum(data, num, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct window_agg<cummin_op<Ind>, T>
+{
+    using result_type = T;
+
+    static void
+    apply(cummin_op<Ind>, const T* data, size_t num, T* out)
+    {
+        cumulative_min(data, num, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct window_agg<cummax_op<Ind>, T>
+{
+    using result_type = T;
+
+    static void
+    apply(cummax_op<Ind>, const T* data, size_t num, T* out)
+    {
+        cumulative_max(data, num, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct window_agg<rolling_sum_op<Ind>, T>
+{
+    using result_type = T;
+
+    static void
+    apply(rolling_sum_op<Ind> op, const T* data, size_t num, T* out)
+    {
+        rolling_sum(data, num, op.window, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct window_agg<rolling_mean_op<Ind>, T>
+{
+    using result_type = rolling_mean_kernel::result_type<T>;
+
+    static void
+    apply(rolling_mean_op<Ind> op, const T* data, size_t num, result_type* out)
+    {
+        rolling_mean(data, num, op.window, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct window_agg<rolling_std_op<Ind>, T>
+{
+    using result_type = rolling_std_kernel::result_type<T>;
+
+    static void
+    apply(rolling_std_op<Ind> op, const T* data, size_t num, result_type* out)
+    {
+        rolling_std(data, num, op.window, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct window_agg<rolling_min_op<Ind>, T>
+{
+    using result_type = T;
+
+    static void
+    apply(rolling_min_op<Ind> op, const T* data, size_t num, T* out)
+    {
+        rolling_min(data, num, op.window, out);
+    }
+};
+
+template<size_t Ind, typename T>
+struct window_agg<rolling_max_op<Ind>, T>
+{
+    using result_type = T;
+
+    static void
+    apply(rolling_max_op<Ind> op, const T* data, size_t num, T* out)
+    {
+        rolling_max(data, num, op.window, out);
+    }
+};
+
+} // namespace mf::detail
+
+#endif // INCLUDED_mainframe_detail_window_h
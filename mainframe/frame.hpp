@@ -39,6 +39,9 @@ struct index_defn;
 template<typename IndexDefn, typename... Ts>
 class group;
 
+template<typename... Ts>
+struct factorization;
+
 ///
 /// dataframe class
 ///
@@ -373,6 +376,27 @@ public:
     iterator
     erase(iterator pos);
 
+    /// Give every row a dense code by the values in columns Inds..., and
+    /// return the codes along with a frame of the distinct keys. Row i's key
+    /// is uniques.row(codes[i])
+    ///
+    ///     frame<std::string, int, double> f;
+    ///     auto fz = f.factorize(_0, _1);
+    ///     // fz.codes is a std::vector<uint32_t>, fz.uniques a frame<std::string, int>
+    ///
+    /// Keys are numbered in the order they're first seen, or in key order
+    /// with factorize_sorted(). A single integral (including bool and char)
+    /// column whose values span a small range is coded through a lookup table
+    /// rather than a hash table.
+    ///
+    template<size_t... Inds>
+    factorization<typename detail::pack_element<Inds, Ts...>::type...>
+    factorize(columnindex<Inds>... cols) const;
+
+    template<size_t... Inds>
+    factorization<typename detail::pack_element<Inds, Ts...>::type...>
+    factorize_sorted(columnindex<Inds>... cols) const;
+
     frame<Ts...>
     fill_forward() const;
 
@@ -403,6 +427,9 @@ public:
     template<size_t Ind>
     double mean(columnindex<Ind>) const;
 
+    template<size_t Ind>
+    double median(columnindex<Ind>) const;
+
     template<size_t Ind>
     using pack_elem_pair =
         std::pair<typename pack_element<Ind, Ts...>::type, typename detail::pack_element<Ind, Ts...>::type>;
@@ -641,6 +668,9 @@ public:
     template<size_t Ind>
     frame_without_indexed_column<Ind> remove_column(columnindex<Ind>);
 
+    template<size_t Ind>
+    double quantile(columnindex<Ind>, double q) const;
+
     void
     reserve(size_t newsize);
 
@@ -668,6 +698,19 @@ public:
     std::enable_if_t<is_expression<Ex>::value, frame<Ts...>>
     rows(Ex ex) const;
 
+    ///
+    /// The rows for which ex is true, with only the columns cols. Same as
+    ///
+    ///     f.rows(ex).columns(cols...)
+    ///
+    /// except that only the columns ex refers to are read, and only cols are
+    /// gathered into the result
+    ///
+    template<typename Ex, size_t... Inds>
+    std::enable_if_t<is_expression<Ex>::value,
+        typename detail::rearrange<frame<Ts...>, Inds...>::type>
+    rows(Ex ex, columnindex<Inds>... cols) const;
+
     void
     set_column_names(const std::vector<std::string>& names);
 
@@ -752,6 +795,10 @@ private:
     void
     insert_impl(std::tuple<Ts*...>& ptrs, iterator pos, const_iterator first, const_iterator last);
 
+    template<typename Ex>
+    std::vector<size_t>
+    matching_rows(Ex ex) const;
+
     template<size_t Ind>
     void
     pop_back_impl();
@@ -820,6 +867,17 @@ private:
     std::tuple<series<Ts>...> m_columns;
 };
 
+///
+/// The result of frame::factorize(): a code for every row, and the distinct
+/// keys the codes refer to
+///
+template<typename... Ts>
+struct factorization
+{
+    std::vector<uint32_t> codes;
+    frame<Ts...> uniques;
+};
+
 } // namespace mf
 
 
@@ -6,11 +6,14 @@
 #ifndef INCLUDED_mainframe_group_h
 #define INCLUDED_mainframe_group_h
 
-#include <unordered_map>
+#include <utility>
 
 #include "mainframe/frame.hpp"
+#include "mainframe/detail/aggregate.hpp"
 #include "mainframe/detail/group.hpp"
 #include "mainframe/detail/frame_indexer.hpp"
+#include "mainframe/detail/parallel.hpp"
+#include "mainframe/detail/window.hpp"
 
 namespace mf
 {
@@ -52,13 +55,437 @@ stddev(columnindex<Ind>)
     return detail::stddev_op<Ind>{};
 }
 
+template<size_t Ind>
+detail::median_op<Ind>
+median(columnindex<Ind>)
+{
+    return detail::median_op<Ind>{};
+}
+
+/// The q-quantile of a column, 0 <= q <= 1, interpolated linearly between the
+/// two nearest values, so quantiles and medians of integers are doubles.
+/// agg::quantile(_1, 0.99) is named "p99( col )" in the result
+template<size_t Ind>
+detail::quantile_op<Ind>
+quantile(columnindex<Ind>, double q)
+{
+    if (!(q >= 0.0 && q <= 1.0)) {
+        throw std::invalid_argument{ "quantile must be between 0 and 1" };
+    }
+    detail::quantile_op<Ind> op;
+    op.q = q;
+    return op;
+}
+
+/// Like quantile(), but from a t-digest: a fixed few KB per group however
+/// many rows it has, and mergeable, so it works with multi-threaded
+/// aggregation. Named like quantile() with an "approx_" prefix
+template<size_t Ind>
+detail::approx_quantile_op<Ind>
+approx_quantile(columnindex<Ind>, double q)
+{
+    if (!(q >= 0.0 && q <= 1.0)) {
+        throw std::invalid_argument{ "quantile must be between 0 and 1" };
+    }
+    detail::approx_quantile_op<Ind> op;
+    op.q = q;
+    return op;
+}
+
+/// The number of distinct values in a column, estimated with HyperLogLog: 4KB
+/// per group and a standard error of about 1.6%
+template<size_t Ind>
+detail::approx_count_distinct_op<Ind>
+approx_count_distinct(columnindex<Ind>)
+{
+    return detail::approx_count_distinct_op<Ind>{};
+}
+
+/// The number of distinct values in a column, exactly
+template<size_t Ind>
+detail::count_distinct_op<Ind>
+count_distinct(columnindex<Ind>)
+{
+    return detail::count_distinct_op<Ind>{};
+}
+
+/// The value from the first row of each group
+template<size_t Ind>
+detail::first_op<Ind>
+first(columnindex<Ind>)
+{
+    return detail::first_op<Ind>{};
+}
+
+/// The value from the last row of each group
+template<size_t Ind>
+detail::last_op<Ind>
+last(columnindex<Ind>)
+{
+    return detail::last_op<Ind>{};
+}
+
+/// The row number (in the grouped frame) of the smallest value in each group.
+/// Ties go to the earliest row
+template<size_t Ind>
+detail::argmin_op<Ind>
+argmin(columnindex<Ind>)
+{
+    return detail::argmin_op<Ind>{};
+}
+
+/// The row number (in the grouped frame) of the largest value in each group.
+/// Ties go to the earliest row
+template<size_t Ind>
+detail::argmax_op<Ind>
+argmax(columnindex<Ind>)
+{
+    return detail::argmax_op<Ind>{};
+}
+
 detail::count_op inline count()
 {
     return detail::count_op{};
 }
 
+/// The number of values in a column that aren't missing. Every other
+/// aggregation over a column of mi<T> also skips missing values - the mean is
+/// of the values that are there - and gives missing for a group with no
+/// values at all (distinct counts give zero)
+template<size_t Ind>
+detail::count_values_op<Ind>
+count(columnindex<Ind>)
+{
+    return detail::count_values_op<Ind>{};
+}
+
 } // namespace agg
 
+/// Window functions for group::window(). Each gives one value per row,
+/// computed over the rows of the row's group in row order - the group is the
+/// partition, and row order the ordering
+namespace win
+{
+/// 1, 2, 3... through each group
+inline detail::row_number_op
+row_number()
+{
+    return detail::row_number_op{};
+}
+
+/// SQL's RANK() by a column within each group: ties share a rank, and the
+/// ranks after them skip ahead
+template<size_t Ind>
+detail::rank_op<Ind>
+rank(columnindex<Ind>)
+{
+    return detail::rank_op<Ind>{};
+}
+
+/// SQL's DENSE_RANK(): like rank(), but with no gaps after ties
+template<size_t Ind>
+detail::dense_rank_op<Ind>
+dense_rank(columnindex<Ind>)
+{
+    return detail::dense_rank_op<Ind>{};
+}
+
+/// The value n rows earlier in the group, or missing
+template<size_t Ind>
+detail::lag_op<Ind>
+lag(columnindex<Ind>, size_t n = 1)
+{
+    detail::lag_op<Ind> op;
+    op.n = n;
+    return op;
+}
+
+/// The value n rows later in the group, or missing
+template<size_t Ind>
+detail::lead_op<Ind>
+lead(columnindex<Ind>, size_t n = 1)
+{
+    detail::lead_op<Ind> op;
+    op.n = n;
+    return op;
+}
+
+/// Running totals within the group, as from series::cumsum(), cummin() and
+/// cummax(): missing values stay missing and are passed over
+template<size_t Ind>
+detail::cumsum_op<Ind>
+cumsum(columnindex<Ind>)
+{
+    return detail::cumsum_op<Ind>{};
+}
+
+template<size_t Ind>
+detail::cummin_op<Ind>
+cummin(columnindex<Ind>)
+{
+    return detail::cummin_op<Ind>{};
+}
+
+template<size_t Ind>
+detail::cummax_op<Ind>
+cummax(columnindex<Ind>)
+{
+    return detail::cummax_op<Ind>{};
+}
+
+/// Rolling aggregates over the current row and up to window - 1 rows before
+/// it in the same group, each in O(1) per row. The mean and standard deviation
+/// of integers are doubles
+template<size_t Ind>
+detail::rolling_sum_op<Ind>
+rolling_sum(columnindex<Ind>, size_t window)
+{
+    if (window == 0) {
+        throw std::invalid_argument{ "window must be at least 1" };
+    }
+    detail::rolling_sum_op<Ind> op;
+    op.window = window;
+    return op;
+}
+
+template<size_t Ind>
+detail::rolling_mean_op<Ind>
+rolling_mean(columnindex<Ind>, size_t window)
+{
+    if (window == 0) {
+        throw std::invalid_argument{ "window must be at least 1" };
+    }
+    detail::rolling_mean_op<Ind> op;
+    op.window = window;
+    return op;
+}
+
+template<size_t Ind>
+detail::rolling_std_op<Ind>
+rolling_std(columnindex<Ind>, size_t window)
+{
+    if (window == 0) {
+        throw std::invalid_argument{ "window must be at least 1" };
+    }
+    detail::rolling_std_op<Ind> op;
+    op.window = window;
+    return op;
+}
+
+template<size_t Ind>
+detail::rolling_min_op<Ind>
+rolling_min(columnindex<Ind>, size_t window)
+{
+    if (window == 0) {
+        throw std::invalid_argument{ "window must be at least 1" };
+    }
+    detail::rolling_min_op<Ind> op;
+    op.window = window;
+    return op;
+}
+
+template<size_t Ind>
+detail::rolling_max_op<Ind>
+rolling_max(columnindex<Ind>, size_t window)
+{
+    if (window == 0) {
+        throw std::invalid_argument{ "window must be at least 1" };
+    }
+    detail::rolling_max_op<Ind> op;
+    op.window = window;
+    return op;
+}
+
+} // namespace win
+
+///
+/// Options for group::aggregate()
+///
+/// With num_threads other than 1 (0 means one per hardware thread) the rows
+/// are split into contiguous pieces, each thread groups and pre-aggregates its
+/// own piece into its own table, and the per-thread partial results are
+/// merged at the end. Groups still come out in first-seen order. With sort
+/// set the result is sorted by its key columns.
+///
+///     auto res = f.groupby(_0, _1).aggregate(aggregate_options{ 0, true },
+///         agg::sum(_2), agg::stddev(_3), agg::count());
+///
+/// If the frame is already sorted on the group columns, ascending or
+/// descending, aggregate() notices and reduces each run of equal keys in a
+/// single pass, with no hash table and no row lists; the groups come out in
+/// the frame's order. keys_sorted skips that check and promises that rows
+/// with equal keys are contiguous, sorted or not. A key that appears in more
+/// than one run comes out once per run.
+///
+struct aggregate_options
+{
+    size_t num_threads = 1;
+    bool sort          = false;
+    bool keys_sorted   = false;
+};
+
+///
+/// One group of a group: its key and its rows, as a view onto the grouped
+/// frame. Nothing is copied - the rows are read through the group's row lists
+/// - until to_frame() or column() asks for contiguous data. A group_view is
+/// only good for as long as the group it came from.
+///
+///     for (auto g : f.groupby(_0).groups()) {
+///         std::cout << g.key() << ": " << g.size() << " rows\n";
+///         for (auto row : g) { ... }
+///     }
+///
+template<typename Key, typename... Ts>
+class group_view
+{
+public:
+    /// Iterates the rows of the group, in row order
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = _row_proxy<true, Ts...>;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const value_type*;
+        using reference         = value_type;
+
+        const_iterator(const frame<Ts...>* f, const size_t* pos)
+            : m_frame(f)
+            , m_pos(pos)
+        {}
+
+        value_type
+        operator*() const
+        {
+            return m_frame->row(*m_pos);
+        }
+
+        const_iterator&
+        operator++()
+        {
+            ++m_pos;
+            return *this;
+        }
+
+        const_iterator
+        operator++(int)
+        {
+            const_iterator out = *this;
+            ++m_pos;
+            return out;
+        }
+
+        bool
+        operator==(const const_iterator& other) const
+        {
+            return m_pos == other.m_pos;
+        }
+
+        bool
+        operator!=(const const_iterator& other) const
+        {
+            return m_pos != other.m_pos;
+        }
+
+    private:
+        const frame<Ts...>* m_frame;
+        const size_t* m_pos;
+    };
+
+    using iterator = const_iterator;
+
+    group_view(Key key, const frame<Ts...>* f, detail::row_range rows)
+        : m_key(key)
+        , m_frame(f)
+        , m_rows(rows)
+    {}
+
+    /// The group's key - a row of the group's key columns
+    const Key&
+    key() const
+    {
+        return m_key;
+    }
+
+    size_t
+    size() const
+    {
+        return m_rows.size();
+    }
+
+    bool
+    empty() const
+    {
+        return m_rows.size() == 0;
+    }
+
+    /// The i'th row of the group
+    _row_proxy<true, Ts...>
+    row(size_t i) const
+    {
+        return m_frame->row(m_rows.begin()[i]);
+    }
+
+    /// The group's row numbers in the grouped frame, in ascending order
+    detail::row_range
+    row_numbers() const
+    {
+        return m_rows;
+    }
+
+    const_iterator
+    begin() const
+    {
+        return const_iterator{ m_frame, m_rows.begin() };
+    }
+
+    const_iterator
+    end() const
+    {
+        return const_iterator{ m_frame, m_rows.end() };
+    }
+
+    const_iterator
+    cbegin() const
+    {
+        return begin();
+    }
+
+    const_iterator
+    cend() const
+    {
+        return end();
+    }
+
+    /// Copy one column of the group's rows into a series
+    template<size_t Ind>
+    series<typename detail::pack_element<Ind, Ts...>::type>
+    column(columnindex<Ind> ci) const
+    {
+        const auto* data = m_frame->column(ci).data();
+        series<typename detail::pack_element<Ind, Ts...>::type> out;
+        out.set_name(m_frame->column_name(ci));
+        out.resize(size());
+        auto* o = out.data();
+        for (size_t i = 0; i < size(); ++i) {
+            o[i] = data[m_rows.begin()[i]];
+        }
+        return out;
+    }
+
+    /// Copy the group's rows into a frame of their own
+    frame<Ts...>
+    to_frame() const
+    {
+        return detail::take_rows(*m_frame, std::vector<size_t>(m_rows.begin(), m_rows.end()));
+    }
+
+private:
+    Key m_key;
+    const frame<Ts...>* m_frame;
+    detail::row_range m_rows;
+};
+
 ///
 /// Intermediate class for GROUP BY aggregate operations
 ///
@@ -84,45 +511,761 @@ class group<index_defn<GroupInds...>, Ts...>
     template<typename IndexDefn>
     using result_frame = typename get_result_frame<IndexDefn>::type;
 
-    using key_type       = typename index_frame::const_value_type; // _row_proxy
-    using map_value_type = std::vector<size_t>;
-    using map_type       = std::unordered_map<key_type, map_value_type>;
-
     template<typename... Ops>
     using get_aggregate_frame = detail::get_aggregate_frame<frame<Ts...>, group_index_defn, Ops...>;
 
 public:
     group(frame<Ts...> f)
-        : frame_indexer<index_defn<GroupInds...>, Ts...>(f)
+        : frame_indexer<index_defn<GroupInds...>, Ts...>(std::move(f))
     {}
 
+    template<typename... Ops,
+        std::enable_if_t<(!std::is_same<Ops, aggregate_options>::value && ...), bool> = true>
+    typename get_aggregate_frame<Ops...>::type
+    aggregate(Ops... ops) const
+    {
+        return aggregate(aggregate_options{}, ops...);
+    }
+
     template<typename... Ops>
     typename get_aggregate_frame<Ops...>::type
-    aggregate(Ops...) const
+    aggregate(const aggregate_options& opts, Ops... ops) const
+    {
+        const size_t nrows    = this->m_frame.size();
+        const size_t nthreads = detail::resolve_num_threads(opts.num_threads);
+        const size_t nchunks  = std::min(nthreads, std::max<size_t>(1, nrows / min_chunk_rows));
+
+        typename get_aggregate_frame<Ops...>::type result;
+        std::vector<size_t> starts;
+        if (find_runs(opts.keys_sorted, starts)) {
+            result = aggregate_runs(starts, ops...);
+        }
+        else if constexpr (!(detail::is_mergeable_op<Ops>::value && ...)) {
+            // Medians and quantiles need all of a group's values at once, so
+            // they can't be pre-aggregated in pieces
+            result = aggregate_hashed(ops...);
+        }
+        else if (nchunks > 1) {
+            result = aggregate_parallel(nchunks, nthreads, ops...);
+        }
+        else {
+            result = aggregate_hashed(ops...);
+        }
+        if (opts.sort) {
+            sort_by_keys(result, std::make_index_sequence<sizeof...(GroupInds)>{});
+        }
+        return result;
+    }
+
+    ///
+    /// Evaluate a window function (see namespace win) over each group, giving
+    /// a series with one value per row of the grouped frame. Each group's
+    /// rows are gathered in row order, run through the window kernel in one
+    /// pass and scattered back; a group whose rows are already contiguous is
+    /// done in place.
+    ///
+    ///     auto prev  = f.groupby(_0).window(win::lag(_2));
+    ///     auto ranks = f.groupby(_0).window(win::rank(_2));
+    ///
+    template<typename Op>
+    series<typename detail::window_agg<Op,
+        typename detail::op_column_type<Op, frame<Ts...>>::type>::result_type>
+    window(Op op) const
     {
+        using T   = typename detail::op_column_type<Op, frame<Ts...>>::type;
+        using agg = detail::window_agg<Op, T>;
+        using R   = typename agg::result_type;
         this->build_index();
 
-        typename detail::get_result_columns_from_args<frame<Ts...>, Ops...>::type result_columns;
-        rename_result_columns_args<0, Ops...>(result_columns);
-        auto ifr = get_index_frame::op(this->m_frame);
-        ifr.clear(); // this is mostly to get the column names
+        series<R> out;
+        out.set_name(get_window_name(op));
+        out.resize(this->m_frame.size());
+        R* o          = out.data();
+        const T* data = nullptr;
+        if constexpr (!std::is_same<Op, detail::row_number_op>::value) {
+            data = this->m_frame.column(columnindex<Op::value>{}).data();
+        }
+
+        std::vector<T> values;
+        std::vector<R> results;
+        for (uint32_t g = 0; g < this->num_groups(); ++g) {
+            const detail::row_range rows = this->m_idx.rows(g);
+            const size_t num             = rows.size();
+            const size_t first           = rows.begin()[0];
+            if (rows.begin()[num - 1] - first + 1 == num) {
+                agg::apply(op, data == nullptr ? nullptr : data + first, num, o + first);
+                continue;
+            }
+            values.resize(data == nullptr ? 0 : num);
+            for (size_t k = 0; k < values.size(); ++k) {
+                values[k] = data[rows.begin()[k]];
+            }
+            results.resize(num);
+            agg::apply(op, values.data(), num, results.data());
+            for (size_t k = 0; k < num; ++k) {
+                o[rows.begin()[k]] = results[k];
+            }
+        }
+        return out;
+    }
+
+    ///
+    /// Aggregate a column by group and give every row its group's result: a
+    /// series with one value per row of the grouped frame, named like the
+    /// op's column in aggregate(). Each group's result is worked out once and
+    /// then gathered into the rows by group id, with no join back on the keys.
+    ///
+    ///     auto means = f.groupby(_0).transform(agg::mean(_2));
+    ///     auto f2    = f.append_series(means);
+    ///
+    template<typename Op>
+    series<typename detail::op_result_type<Op, frame<Ts...>>::type>
+    transform(Op op) const
+    {
+        this->build_index();
+
+        const std::tuple<Op> args{ op };
+        typename detail::get_result_columns_from_args<frame<Ts...>, Op>::type result_columns;
+        rename_result_columns_args<0, Op>(args, result_columns);
+        const size_t ngroups = this->num_groups();
+        std::vector<size_t> counts(ngroups);
+        for (uint32_t g = 0; g < ngroups; ++g) {
+            counts[g] = this->m_idx.rows(g).size();
+        }
+        aggregate_column<0, Op>(args, counts, result_columns);
+        aggregate_count<Op>(counts, result_columns);
+
+        const auto& per_group = std::get<0>(result_columns);
+        const auto* res       = per_group.data();
+        const auto& gids      = this->group_ids();
+        series<typename detail::op_result_type<Op, frame<Ts...>>::type> out;
+        out.set_name(per_group.name());
+        out.resize(gids.size());
+        auto* o = out.data();
+        for (size_t i = 0; i < gids.size(); ++i) {
+            o[i] = res[gids[i]];
+        }
+        return out;
+    }
+
+    using view_type = group_view<typename index_frame::const_value_type, Ts...>;
+
+    ///
+    /// The groups of a group, in first-seen order, as group_views
+    ///
+    class group_range
+    {
+    public:
+        class const_iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type        = view_type;
+            using difference_type   = std::ptrdiff_t;
+            using pointer           = const view_type*;
+            using reference         = view_type;
+
+            const_iterator(const group* grp, uint32_t g)
+                : m_group(grp)
+                , m_g(g)
+            {}
+
+            view_type
+            operator*() const
+            {
+                return m_group->view(m_g);
+            }
+
+            const_iterator&
+            operator++()
+            {
+                ++m_g;
+                return *this;
+            }
+
+            const_iterator
+            operator++(int)
+            {
+                const_iterator out = *this;
+                ++m_g;
+                return out;
+            }
+
+            bool
+            operator==(const const_iterator& other) const
+            {
+                return m_g == other.m_g;
+            }
+
+            bool
+            operator!=(const const_iterator& other) const
+            {
+                return m_g != other.m_g;
+            }
+
+        private:
+            const group* m_group;
+            uint32_t m_g;
+        };
+
+        using iterator = const_iterator;
+
+        explicit group_range(const group* grp)
+            : m_group(grp)
+        {}
+
+        const_iterator
+        begin() const
+        {
+            return const_iterator{ m_group, 0 };
+        }
+
+        const_iterator
+        end() const
+        {
+            return const_iterator{ m_group, static_cast<uint32_t>(size()) };
+        }
+
+        size_t
+        size() const
+        {
+            return m_group->num_groups();
+        }
+
+    private:
+        const group* m_group;
+    };
+
+    /// Every group, without copying any rows
+    group_range
+    groups() const
+    {
+        this->build_index();
+        return group_range{ this };
+    }
+
+    /// The group with the given key, without copying any rows. Throws
+    /// std::out_of_range if there's no such group
+    ///
+    ///     auto g = f.groupby(_0, _1).get_group(2022_y, "AAPL");
+    ///     double total = g.column(_3).sum();
+    ///
+    view_type
+    get_group(const typename detail::pack_element<GroupInds, Ts...>::type&... keys) const
+    {
+        this->build_index();
+        const typename index_frame::row_type key{ std::make_tuple(keys...) };
+        auto it = this->find_index(key);
+        if (it == this->end_index()) {
+            throw std::out_of_range{ "no such group" };
+        }
+        return view(it.group_id());
+    }
+
+private:
+    view_type
+    view(uint32_t g) const
+    {
+        const index_frame& ifr = this->m_ifr;
+        return view_type{ ifr.row(this->m_idx.first_row(g)), &this->m_frame, this->m_idx.rows(g) };
+    }
+
+    // The partial state of an op over its column
+    template<typename Op>
+    using partial_agg = typename detail::partial_agg_for<Op,
+        typename detail::op_column_type<Op, frame<Ts...>>::type>::type;
+
+    template<typename... Ops>
+    using partial_states = std::tuple<std::vector<typename partial_agg<Ops>::state>...>;
+
+public:
+    template<typename... Ops>
+    class incremental_aggregate;
+
+    ///
+    /// Aggregations that can be kept up to date as rows are appended, without
+    /// going back over the rows already seen. Only the distinct keys and one
+    /// partial state per group and op are kept, so it's O(new rows) to fold
+    /// more rows in and O(groups) to produce the result, which has the same
+    /// type and group order as aggregate(ops...).
+    ///
+    ///     auto inc = f.groupby(_0).incremental(agg::sum(_2), agg::count());
+    ///     inc.append(more_rows);
+    ///     inc.push_back(2022_y / 3, 1.5, 4);
+    ///     auto res = inc.result();
+    ///
+    /// Ops that need all of a group's values at once - median, quantile and
+    /// count_distinct - can't be used; approx_quantile and
+    /// approx_count_distinct can.
+    ///
+    template<typename... Ops>
+    incremental_aggregate<Ops...>
+    incremental(Ops... ops) const
+    {
+        return incremental_aggregate<Ops...>{ *this, ops... };
+    }
+
+    template<typename... Ops>
+    class incremental_aggregate
+    {
+        static_assert((detail::is_mergeable_op<Ops>::value && ...),
+            "median, quantile and count_distinct can't be updated incrementally");
+
+    public:
+        incremental_aggregate(const group& g, Ops... ops)
+            : m_names(names_only(g.m_frame))
+            , m_ops(ops...)
+        {
+            append(g.m_frame);
+        }
+
+        /// Fold in a frame of new rows
+        void
+        append(const frame<Ts...>& rows)
+        {
+            const size_t num = rows.size();
+            if (num == 0) {
+                return;
+            }
+
+            // Group the new rows among themselves first, and pre-aggregate
+            // each of their groups with the usual kernels
+            std::vector<uint64_t> hashes(num);
+            detail::hash_columns(rows, 0, num, hashes.data(), columnindex<GroupInds>{}...);
+            detail::flat_index local;
+            local.build(hashes.data(), num, [&](size_t a, size_t b) {
+                return detail::rows_equal<GroupInds...>(rows, a, b);
+            });
+            const size_t nlocal = local.num_groups();
+            std::vector<size_t> counts(nlocal);
+            detail::group_count(local.row_groups().data(), num, nlocal, counts.data());
+
+            // Then each of those is one of the groups already seen, or a new
+            // one. Groups are numbered by their row in m_keys. The new rows'
+            // groups are all different, so only old groups need comparing
+            const size_t nbefore = m_counts.size();
+            std::vector<uint32_t> gids(nlocal);
+            std::vector<size_t> newrows;
+            for (uint32_t j = 0; j < nlocal; ++j) {
+                const size_t r = local.first_row(j);
+                gids[j] = m_index.find_or_add(local.group_hash(j), m_counts.size(),
+                    [&](size_t k) {
+                        return k < nbefore
+                            && keys_equal(k, rows, r,
+                                std::make_index_sequence<sizeof...(GroupInds)>{});
+                    });
+                if (gids[j] == m_counts.size()) {
+                    m_counts.push_back(0);
+                    newrows.push_back(r);
+                }
+                m_counts[gids[j]] += counts[j];
+            }
+            if (!newrows.empty()) {
+                auto newkeys = detail::take_rows(get_index_frame::op(rows), newrows);
+                m_keys.insert(m_keys.end(), newkeys.cbegin(), newkeys.cend());
+            }
+
+            fold_partials<0>(rows, local, gids, nbefore);
+            m_nrows += num;
+        }
+
+        /// Fold in one new row. Rows are buffered and folded in a batch at a
+        /// time
+        template<typename... Args>
+        void
+        push_back(Args&&... args)
+        {
+            m_pending.push_back(std::forward<Args>(args)...);
+            if (m_pending.size() >= pending_rows) {
+                flush();
+            }
+        }
+
+        /// The aggregate of every row so far
+        typename get_aggregate_frame<Ops...>::type
+        result()
+        {
+            flush();
+            typename detail::get_result_columns_from_args<frame<Ts...>, Ops...>::type
+                result_columns;
+            m_names.template rename_result_columns_args<0, Ops...>(m_ops, result_columns);
+            finish_partials<0>(result_columns);
+            index_frame keys = m_keys;
+            keys.set_column_names(get_index_frame::op(m_names.m_frame).column_names());
+            return m_names.template add_result_series<0>(keys, result_columns);
+        }
+
+        /// Number of rows folded in so far
+        size_t
+        num_rows() const
+        {
+            return m_nrows + m_pending.size();
+        }
+
+        /// Number of distinct keys so far, not counting buffered rows
+        size_t
+        num_groups() const
+        {
+            return m_counts.size();
+        }
+
+    private:
+        static constexpr size_t pending_rows = 1 << 12;
 
-        for (const auto& [key, rowinds] : this->m_idx) {
+        // A group over no rows, just for the column names of the result
+        static frame<Ts...>
+        names_only(const frame<Ts...>& f)
+        {
+            frame<Ts...> out;
+            out.set_column_names(f.column_names());
+            return out;
+        }
+
+        void
+        flush()
+        {
+            if (!m_pending.empty()) {
+                append(std::exchange(m_pending, frame<Ts...>{}));
+            }
+        }
+
+        template<size_t... Is>
+        bool
+        keys_equal(size_t k, const frame<Ts...>& rows, size_t r, std::index_sequence<Is...>) const
+        {
+            return ((m_keys.column(columnindex<Is>{}).data()[k]
+                        == rows.column(columnindex<GroupInds>{}).data()[r])
+                && ...);
+        }
+
+        template<size_t ArgInd>
+        void
+        fold_partials(const frame<Ts...>& rows, const detail::flat_index& local,
+            const std::vector<uint32_t>& gids, size_t nbefore)
+        {
+            using Op      = typename detail::pack_element<ArgInd, Ops...>::type;
+            using T       = typename detail::op_column_type<Op, frame<Ts...>>::type;
+            const T* data = nullptr;
+            if constexpr (!std::is_same<Op, detail::count_op>::value) {
+                data = rows.column(columnindex<Op::value>{}).data();
+            }
+            std::vector<typename partial_agg<Op>::state> states(local.num_groups());
+            partial_agg<Op>::scatter(data, local.row_groups().data(), m_nrows, rows.size(),
+                local.num_groups(), states.data());
+
+            auto& merged = std::get<ArgInd>(m_states);
+            merged.resize(m_counts.size());
+            for (size_t j = 0; j < gids.size(); ++j) {
+                if (gids[j] >= nbefore) {
+                    merged[gids[j]] = std::move(states[j]);
+                }
+                else {
+                    partial_agg<Op>::merge(merged[gids[j]], states[j]);
+                }
+            }
+            if constexpr (ArgInd + 1 < sizeof...(Ops)) {
+                fold_partials<ArgInd + 1>(rows, local, gids, nbefore);
+            }
+        }
+
+        template<size_t ArgInd, typename... Us>
+        void
+        finish_partials(std::tuple<series<Us>...>& result_columns) const
+        {
+            using Op            = typename detail::pack_element<ArgInd, Ops...>::type;
+            const auto& merged  = std::get<ArgInd>(m_states);
+            auto& result_column = std::get<ArgInd>(result_columns);
+            result_column.resize(m_counts.size());
+            auto* out = result_column.data();
+            for (size_t g = 0; g < m_counts.size(); ++g) {
+                out[g] = partial_agg<Op>::finish(std::get<ArgInd>(m_ops), merged[g], m_counts[g]);
+            }
+            if constexpr (ArgInd + 1 < sizeof...(Ops)) {
+                finish_partials<ArgInd + 1>(result_columns);
+            }
+        }
+
+        group m_names;
+        std::tuple<Ops...> m_ops;
+        detail::flat_index m_index;
+        index_frame m_keys;
+        std::vector<size_t> m_counts;
+        partial_states<Ops...> m_states;
+        size_t m_nrows{ 0 };
+        frame<Ts...> m_pending;
+    };
+
+private:
+    // Don't bother splitting up fewer rows than this per thread
+    static constexpr size_t min_chunk_rows = 1 << 14;
+
+    template<typename... Ops>
+    typename get_aggregate_frame<Ops...>::type
+    aggregate_hashed(Ops... ops) const
+    {
+        this->build_index();
 
-            // key is a _row_proxy into the original frame
-            // rowinds is a vector<size_t> of row indices into the original frame
+        const std::tuple<Ops...> args{ ops... };
+        typename detail::get_result_columns_from_args<frame<Ts...>, Ops...>::type result_columns;
+        rename_result_columns_args<0, Ops...>(args, result_columns);
 
-            // now we iterate the frame columns, performing all operations
-            aggregate_column<0, Ops...>(rowinds, result_columns);
-            aggregate_count<Ops...>(rowinds, result_columns);
-            ifr.push_back(key);
+        // Each op runs over its whole column at once, scattering rows into
+        // per-group accumulators by group id
+        const size_t ngroups = this->num_groups();
+        std::vector<size_t> counts(ngroups);
+        std::vector<size_t> firstrows(ngroups);
+        for (uint32_t g = 0; g < ngroups; ++g) {
+            counts[g]    = this->m_idx.rows(g).size();
+            firstrows[g] = this->m_idx.first_row(g);
         }
+        aggregate_column<0, Ops...>(args, counts, result_columns);
+        aggregate_count<Ops...>(counts, result_columns);
+
+        // The keys, one row per group in group id order
+        auto ifr = detail::take_rows(get_index_frame::op(this->m_frame), firstrows);
 
         auto result = add_result_series<0>(ifr, result_columns);
         return result;
     }
 
-private:
+    // If the rows of each group are contiguous, fill starts with the first row
+    // of each run of equal keys, then the number of rows, and return true.
+    // Unless assume_contiguous is set, the keys have to be sorted one way or
+    // the other for this to succeed.
+    bool
+    find_runs(bool assume_contiguous, std::vector<size_t>& starts) const
+    {
+        constexpr bool can_compare = (detail::is_less_comparable<
+            typename detail::pack_element<GroupInds, Ts...>::type>::value && ...);
+        // NaN compares neither less nor greater, but isn't equal to itself
+        constexpr bool can_be_unordered =
+            (std::is_floating_point_v<typename detail::pack_element<GroupInds, Ts...>::type>
+                || ...);
+        const size_t nrows = this->m_frame.size();
+        starts.clear();
+        if (nrows == 0) {
+            return false;
+        }
+        starts.push_back(0);
+        if (assume_contiguous) {
+            for (size_t i = 1; i < nrows; ++i) {
+                if (!detail::rows_equal<GroupInds...>(this->m_frame, i - 1, i)) {
+                    starts.push_back(i);
+                }
+            }
+        }
+        else if constexpr (can_compare) {
+            int direction = 0;
+            for (size_t i = 1; i < nrows; ++i) {
+                int cmp = detail::compare_rows<GroupInds...>(this->m_frame, i - 1, i);
+                if (cmp == 0) {
+                    if constexpr (can_be_unordered) {
+                        if (!detail::rows_equal<GroupInds...>(this->m_frame, i - 1, i)) {
+                            return false;
+                        }
+                    }
+                    continue;
+                }
+                if (direction != 0 && cmp != direction) {
+                    return false;
+                }
+                direction = cmp;
+                starts.push_back(i);
+            }
+        }
+        else {
+            return false;
+        }
+        starts.push_back(nrows);
+        return true;
+    }
+
+    template<typename... Ops>
+    typename get_aggregate_frame<Ops...>::type
+    aggregate_runs(const std::vector<size_t>& starts, Ops... ops) const
+    {
+        const std::tuple<Ops...> args{ ops... };
+        typename detail::get_result_columns_from_args<frame<Ts...>, Ops...>::type result_columns;
+        rename_result_columns_args<0, Ops...>(args, result_columns);
+        aggregate_runs_arg<0, Ops...>(args, starts, result_columns);
+
+        // The keys, from the first row of each run
+        std::vector<size_t> firstrows(starts.begin(), starts.end() - 1);
+        auto ifr = detail::take_rows(get_index_frame::op(this->m_frame), firstrows);
+        return add_result_series<0>(ifr, result_columns);
+    }
+
+    template<size_t ArgInd, typename... Ops, typename... Us>
+    void
+    aggregate_runs_arg(const std::tuple<Ops...>& ops, const std::vector<size_t>& starts,
+        std::tuple<series<Us>...>& result_columns) const
+    {
+        using Op            = typename detail::pack_element<ArgInd, Ops...>::type;
+        const size_t nruns  = starts.size() - 1;
+        auto& result_column = std::get<ArgInd>(result_columns);
+        result_column.resize(nruns);
+        auto* out = result_column.data();
+        if constexpr (std::is_same<Op, detail::count_op>::value) {
+            for (size_t r = 0; r < nruns; ++r) {
+                out[r] = starts[r + 1] - starts[r];
+            }
+        }
+        else {
+            using T       = typename detail::op_column_type<Op, frame<Ts...>>::type;
+            const T* data = this->m_frame.column(columnindex<Op::value>{}).data();
+            if constexpr (detail::is_missing<T>::value) {
+                // Runs lose their shape once the missing values are taken out,
+                // so number the rows by run and aggregate them like groups
+                std::vector<uint32_t> gids(starts[nruns]);
+                for (size_t r = 0; r < nruns; ++r) {
+                    std::fill(gids.begin() + starts[r], gids.begin() + starts[r + 1],
+                        static_cast<uint32_t>(r));
+                }
+                detail::aggregate_present(
+                    std::get<ArgInd>(ops), data, gids.data(), gids.size(), nruns, out);
+            }
+            else {
+                detail::run_agg<Op, T>::apply(
+                    std::get<ArgInd>(ops), data, starts.data(), nruns, out);
+            }
+        }
+        if constexpr (ArgInd + 1 < sizeof...(Ops)) {
+            aggregate_runs_arg<ArgInd + 1, Ops...>(ops, starts, result_columns);
+        }
+    }
+
+    template<typename... Ops>
+    struct partial_chunk
+    {
+        size_t begin{ 0 };
+        detail::flat_index idx;
+        std::vector<size_t> counts;
+        partial_states<Ops...> states;
+    };
+
+    template<typename... Ops>
+    typename get_aggregate_frame<Ops...>::type
+    aggregate_parallel(size_t nchunks, size_t nthreads, Ops... ops) const
+    {
+        const size_t nrows = this->m_frame.size();
+        std::vector<partial_chunk<Ops...>> chunks(nchunks);
+
+        // Each thread groups its own rows into its own table
+        detail::parallel_for(nchunks, nthreads, [&](size_t c) {
+            auto& ch         = chunks[c];
+            ch.begin         = nrows * c / nchunks;
+            const size_t num = nrows * (c + 1) / nchunks - ch.begin;
+            std::vector<uint64_t> hashes(num);
+            detail::hash_columns(
+                this->m_frame, ch.begin, num, hashes.data(), columnindex<GroupInds>{}...);
+            ch.idx.build(hashes.data(), num, [&](size_t a, size_t b) {
+                return detail::rows_equal<GroupInds...>(this->m_frame, ch.begin + a, ch.begin + b);
+            });
+            ch.counts.resize(ch.idx.num_groups());
+            detail::group_count(
+                ch.idx.row_groups().data(), num, ch.idx.num_groups(), ch.counts.data());
+            scatter_partials<0, Ops...>(ch.begin, num, ch.idx, ch.states);
+        });
+
+        // Number the groups of all of the chunks together. Going through the
+        // chunks in order keeps the groups in first-seen order
+        std::vector<uint64_t> hashes;
+        std::vector<size_t> firstrows;
+        for (const auto& ch : chunks) {
+            for (uint32_t g = 0; g < ch.idx.num_groups(); ++g) {
+                hashes.push_back(ch.idx.group_hash(g));
+                firstrows.push_back(ch.begin + ch.idx.first_row(g));
+            }
+        }
+        detail::flat_index merged;
+        merged.build(hashes.data(), hashes.size(), [&](size_t a, size_t b) {
+            return detail::rows_equal<GroupInds...>(this->m_frame, firstrows[a], firstrows[b]);
+        });
+        const size_t ngroups = merged.num_groups();
+        const auto& gids     = merged.row_groups();
+
+        std::vector<size_t> counts(ngroups, 0);
+        size_t k = 0;
+        for (const auto& ch : chunks) {
+            for (size_t count : ch.counts) {
+                counts[gids[k++]] += count;
+            }
+        }
+
+        const std::tuple<Ops...> args{ ops... };
+        typename detail::get_result_columns_from_args<frame<Ts...>, Ops...>::type result_columns;
+        rename_result_columns_args<0, Ops...>(args, result_columns);
+        merge_partials<0, Ops...>(args, chunks, gids, counts, result_columns);
+
+        std::vector<size_t> keyrows(ngroups);
+        for (uint32_t g = 0; g < ngroups; ++g) {
+            keyrows[g] = firstrows[merged.first_row(g)];
+        }
+        auto ifr = detail::take_rows(get_index_frame::op(this->m_frame), keyrows);
+        return add_result_series<0>(ifr, result_columns);
+    }
+
+    template<size_t ArgInd, typename... Ops>
+    void
+    scatter_partials(size_t begin, size_t num, const detail::flat_index& idx,
+        partial_states<Ops...>& states) const
+    {
+        using Op     = typename detail::pack_element<ArgInd, Ops...>::type;
+        using T      = typename detail::op_column_type<Op, frame<Ts...>>::type;
+        auto& state  = std::get<ArgInd>(states);
+        const T* data = nullptr;
+        if constexpr (!std::is_same<Op, detail::count_op>::value) {
+            data = this->m_frame.column(columnindex<Op::value>{}).data() + begin;
+        }
+        state.resize(idx.num_groups());
+        partial_agg<Op>::scatter(
+            data, idx.row_groups().data(), begin, num, idx.num_groups(), state.data());
+        if constexpr (ArgInd + 1 < sizeof...(Ops)) {
+            scatter_partials<ArgInd + 1, Ops...>(begin, num, idx, states);
+        }
+    }
+
+    template<size_t ArgInd, typename... Ops, typename... Us>
+    void
+    merge_partials(const std::tuple<Ops...>& ops, const std::vector<partial_chunk<Ops...>>& chunks,
+        const std::vector<uint32_t>& gids, const std::vector<size_t>& counts,
+        std::tuple<series<Us>...>& result_columns) const
+    {
+        using Op = typename detail::pack_element<ArgInd, Ops...>::type;
+        std::vector<typename partial_agg<Op>::state> merged(counts.size());
+        std::vector<bool> seen(counts.size(), false);
+        size_t k = 0;
+        for (const auto& ch : chunks) {
+            for (const auto& state : std::get<ArgInd>(ch.states)) {
+                const uint32_t g = gids[k++];
+                if (seen[g]) {
+                    partial_agg<Op>::merge(merged[g], state);
+                }
+                else {
+                    merged[g] = state;
+                    seen[g]   = true;
+                }
+            }
+        }
+
+        auto& result_column = std::get<ArgInd>(result_columns);
+        result_column.resize(counts.size());
+        auto* out = result_column.data();
+        for (size_t g = 0; g < counts.size(); ++g) {
+            out[g] = partial_agg<Op>::finish(std::get<ArgInd>(ops), merged[g], counts[g]);
+        }
+        if constexpr (ArgInd + 1 < sizeof...(Ops)) {
+            merge_partials<ArgInd + 1, Ops...>(ops, chunks, gids, counts, result_columns);
+        }
+    }
+
+    template<typename Frame, size_t... Is>
+    static void
+    sort_by_keys(Frame& f, std::index_sequence<Is...>)
+    {
+        f.sort(columnindex<Is>{}...);
+    }
+
     template<size_t ColInd>
     std::string
     get_op_name(detail::sum_op<ColInd>) const
@@ -158,14 +1301,190 @@ private:
         return "stddev";
     }
 
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::median_op<ColInd>) const
+    {
+        return "median";
+    }
+
+    // Quantiles are named as percentiles: p50, p99, p99.9
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::quantile_op<ColInd> op) const
+    {
+        std::stringstream ss;
+        ss << "p" << op.q * 100.0;
+        return ss.str();
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::approx_quantile_op<ColInd> op) const
+    {
+        detail::quantile_op<ColInd> exact;
+        exact.q = op.q;
+        return "approx_" + get_op_name(exact);
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::approx_count_distinct_op<ColInd>) const
+    {
+        return "approx_count_distinct";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::count_distinct_op<ColInd>) const
+    {
+        return "count_distinct";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::first_op<ColInd>) const
+    {
+        return "first";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::last_op<ColInd>) const
+    {
+        return "last";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::argmin_op<ColInd>) const
+    {
+        return "argmin";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::argmax_op<ColInd>) const
+    {
+        return "argmax";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::count_values_op<ColInd>) const
+    {
+        return "count";
+    }
+
+    std::string
+    get_window_name(detail::row_number_op) const
+    {
+        return "row_number";
+    }
+
+    template<typename Op>
+    std::string
+    get_window_name(Op op) const
+    {
+        std::stringstream ss;
+        ss << get_op_name(op) << "( " << this->m_frame.column_name(columnindex<Op::value>{})
+           << " )";
+        return ss.str();
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::rank_op<ColInd>) const
+    {
+        return "rank";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::dense_rank_op<ColInd>) const
+    {
+        return "dense_rank";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::lag_op<ColInd>) const
+    {
+        return "lag";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::lead_op<ColInd>) const
+    {
+        return "lead";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::cumsum_op<ColInd>) const
+    {
+        return "cumsum";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::cummin_op<ColInd>) const
+    {
+        return "cummin";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::cummax_op<ColInd>) const
+    {
+        return "cummax";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::rolling_sum_op<ColInd>) const
+    {
+        return "rolling_sum";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::rolling_mean_op<ColInd>) const
+    {
+        return "rolling_mean";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::rolling_std_op<ColInd>) const
+    {
+        return "rolling_std";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::rolling_min_op<ColInd>) const
+    {
+        return "rolling_min";
+    }
+
+    template<size_t ColInd>
+    std::string
+    get_op_name(detail::rolling_max_op<ColInd>) const
+    {
+        return "rolling_max";
+    }
+
     template<size_t ArgInd, typename... Ops, typename... Us>
     void
-    rename_result_columns_args(std::tuple<series<Us>...>& result_columns) const
+    rename_result_columns_args(
+        const std::tuple<Ops...>& ops, std::tuple<series<Us>...>& result_columns) const
     {
-        rename_result_columns_args_cols<0, ArgInd, Ops...>(result_columns);
+        rename_result_columns_args_cols<0, ArgInd, Ops...>(ops, result_columns);
         rename_result_columns_args_count<ArgInd, Ops...>(result_columns);
         if constexpr (ArgInd + 1 < sizeof...(Ops)) {
-            rename_result_columns_args<ArgInd + 1, Ops...>(result_columns);
+            rename_result_columns_args<ArgInd + 1, Ops...>(ops, result_columns);
         }
     }
 
@@ -182,166 +1501,246 @@ private:
 
     template<size_t ColInd, size_t ArgInd, typename... Ops, typename... Us>
     void
-    rename_result_columns_args_cols(std::tuple<series<Us>...>& result_columns) const
+    rename_result_columns_args_cols(
+        const std::tuple<Ops...>& ops, std::tuple<series<Us>...>& result_columns) const
     {
         using OpsTup = std::tuple<Ops...>;
         if constexpr (detail::is_colind_at_argind<ColInd, ArgInd, OpsTup>::value) {
             columnindex<ColInd> ci;
             auto name = this->m_frame.column_name(ci);
             auto& s   = std::get<ArgInd>(result_columns);
-            using Op  = typename detail::pack_element<ArgInd, Ops...>::type;
-            Op op;
             std::stringstream ss;
-            ss << get_op_name(op) << "( " << name << " )";
+            ss << get_op_name(std::get<ArgInd>(ops)) << "( " << name << " )";
             s.set_name(ss.str());
         }
         if constexpr (ColInd + 1 < sizeof...(Ts)) {
-            rename_result_columns_args_cols<ColInd + 1, ArgInd, Ops...>(result_columns);
+            rename_result_columns_args_cols<ColInd + 1, ArgInd, Ops...>(ops, result_columns);
         }
     }
 
     template<typename... Ops, typename... Us>
     void
     aggregate_count(
-        const std::vector<size_t>& rowinds, std::tuple<series<Us>...>& result_columns) const
+        const std::vector<size_t>& counts, std::tuple<series<Us>...>& result_columns) const
     {
-        aggregate_count_arg<0, Ops...>(rowinds, result_columns);
+        aggregate_count_arg<0, Ops...>(counts, result_columns);
     }
 
     template<size_t ArgInd, typename... Ops, typename... Us>
     void
     aggregate_count_arg(
-        const std::vector<size_t>& rowinds, std::tuple<series<Us>...>& result_columns) const
+        const std::vector<size_t>& counts, std::tuple<series<Us>...>& result_columns) const
     {
         using Op = typename detail::pack_element<ArgInd, Ops...>::type;
         if constexpr (std::is_same<Op, detail::count_op>::value) {
             auto& s = std::get<ArgInd>(result_columns);
-            s.push_back(rowinds.size());
+            s.resize(counts.size());
+            std::copy(counts.begin(), counts.end(), s.data());
         }
         if constexpr (ArgInd + 1 < sizeof...(Ops)) {
-            aggregate_count_arg<ArgInd + 1, Ops...>(rowinds, result_columns);
+            aggregate_count_arg<ArgInd + 1, Ops...>(counts, result_columns);
         }
     }
 
     template<size_t ColInd, typename... Ops, typename... Us>
     void
-    aggregate_column(
-        const std::vector<size_t>& rowinds, std::tuple<series<Us>...>& result_columns) const
+    aggregate_column(const std::tuple<Ops...>& ops, const std::vector<size_t>& counts,
+        std::tuple<series<Us>...>& result_columns) const
     {
-        aggregate_column_arg<ColInd, 0, Ops...>(rowinds, result_columns);
+        aggregate_column_arg<ColInd, 0, Ops...>(ops, counts, result_columns);
         if constexpr (ColInd + 1 < sizeof...(Ts)) {
-            aggregate_column<ColInd + 1, Ops...>(rowinds, result_columns);
+            aggregate_column<ColInd + 1, Ops...>(ops, counts, result_columns);
         }
     }
 
     template<size_t ColInd, size_t ArgInd, typename... Ops, typename... Us>
     void
-    aggregate_column_arg(
-        const std::vector<size_t>& rowinds, std::tuple<series<Us>...>& result_columns) const
+    aggregate_column_arg(const std::tuple<Ops...>& ops, const std::vector<size_t>& counts,
+        std::tuple<series<Us>...>& result_columns) const
     {
+        (void)ops;
         (void)result_columns;
         using OpsTup = std::tuple<Ops...>;
         if constexpr (detail::is_colind_at_argind<ColInd, ArgInd, OpsTup>::value) {
-
-            using Op = typename detail::pack_element<ArgInd, Ops...>::type;
-            Op op;
+            using Op            = typename detail::pack_element<ArgInd, Ops...>::type;
+            using T             = typename detail::op_column_type<Op, frame<Ts...>>::type;
             auto& result_column = std::get<ArgInd>(result_columns);
-            aggregate_column_arg_op(op, rowinds, result_column);
+            if constexpr (detail::is_missing<T>::value) {
+                const T* data = this->m_frame.column(columnindex<ColInd>{}).data();
+                result_column.resize(counts.size());
+                detail::aggregate_present(std::get<ArgInd>(ops), data, this->group_ids().data(),
+                    this->m_frame.size(), counts.size(), result_column.data());
+            }
+            else {
+                aggregate_column_arg_op(std::get<ArgInd>(ops), counts, result_column);
+            }
         }
         if constexpr (ArgInd + 1 < sizeof...(Us)) {
-            aggregate_column_arg<ColInd, ArgInd + 1, Ops...>(rowinds, result_columns);
+            aggregate_column_arg<ColInd, ArgInd + 1, Ops...>(ops, counts, result_columns);
         }
     }
 
     template<size_t ColInd, typename T>
     void
     aggregate_column_arg_op(
-        detail::sum_op<ColInd>, const std::vector<size_t>& rowinds, series<T>& result_column) const
+        detail::sum_op<ColInd>, const std::vector<size_t>& counts, series<T>& result_column) const
     {
-        T temp = static_cast<T>(0);
-        columnindex<ColInd> ci;
-        for (size_t rowind : rowinds) {
-            const auto& row = this->m_frame.row(rowind);
-            const T& t      = row.at(ci);
-            temp += t;
-        }
-        result_column.push_back(temp);
+        const T* data = this->m_frame.column(columnindex<ColInd>{}).data();
+        result_column.resize(counts.size());
+        detail::group_sum(data, this->group_ids().data(), this->m_frame.size(), counts.size(),
+            result_column.data());
     }
 
     template<size_t ColInd, typename T>
     void
     aggregate_column_arg_op(
-        detail::max_op<ColInd>, const std::vector<size_t>& rowinds, series<T>& result_column) const
+        detail::max_op<ColInd>, const std::vector<size_t>& counts, series<T>& result_column) const
     {
-        using std::max;
-        using std::numeric_limits;
-        T temp = numeric_limits<T>::lowest();
-        columnindex<ColInd> ci;
-        for (size_t rowind : rowinds) {
-            const auto& row = this->m_frame.row(rowind);
-            const T& t      = row.at(ci);
-            temp            = max(temp, t);
-        }
-        result_column.push_back(temp);
+        const T* data = this->m_frame.column(columnindex<ColInd>{}).data();
+        result_column.resize(counts.size());
+        detail::group_max(data, this->group_ids().data(), this->m_frame.size(), counts.size(),
+            result_column.data());
     }
 
     template<size_t ColInd, typename T>
     void
     aggregate_column_arg_op(
-        detail::min_op<ColInd>, const std::vector<size_t>& rowinds, series<T>& result_column) const
+        detail::min_op<ColInd>, const std::vector<size_t>& counts, series<T>& result_column) const
     {
-        using std::min;
-        using std::numeric_limits;
-        T temp = numeric_limits<T>::max();
-        columnindex<ColInd> ci;
-        for (size_t rowind : rowinds) {
-            const auto& row = this->m_frame.row(rowind);
-            const T& t      = row.at(ci);
-            temp            = min(temp, t);
-        }
-        result_column.push_back(temp);
+        const T* data = this->m_frame.column(columnindex<ColInd>{}).data();
+        result_column.resize(counts.size());
+        detail::group_min(data, this->group_ids().data(), this->m_frame.size(), counts.size(),
+            result_column.data());
     }
 
     template<size_t ColInd, typename T>
     void
     aggregate_column_arg_op(
-        detail::mean_op<ColInd>, const std::vector<size_t>& rowinds, series<T>& result_column) const
+        detail::mean_op<ColInd>, const std::vector<size_t>& counts, series<T>& result_column) const
     {
-        T temp = static_cast<T>(0);
-        columnindex<ColInd> ci;
-        for (size_t rowind : rowinds) {
-            const auto& row = this->m_frame.row(rowind);
-            const T& t      = row.at(ci);
-            temp += t;
-        }
-        temp /= rowinds.size();
-        result_column.push_back(temp);
+        const T* data = this->m_frame.column(columnindex<ColInd>{}).data();
+        result_column.resize(counts.size());
+        detail::group_mean(data, this->group_ids().data(), this->m_frame.size(), counts.size(),
+            counts.data(), result_column.data());
     }
 
     template<size_t ColInd, typename T>
     void
-    aggregate_column_arg_op(detail::stddev_op<ColInd>, const std::vector<size_t>& rowinds,
+    aggregate_column_arg_op(detail::stddev_op<ColInd>, const std::vector<size_t>& counts,
         series<T>& result_column) const
     {
-        T sum = static_cast<T>(0);
-        columnindex<ColInd> ci;
-        for (size_t rowind : rowinds) {
-            const auto& row = this->m_frame.row(rowind);
-            const T& t      = row.at(ci);
-            sum += t;
-        }
-        T mean = sum / rowinds.size();
+        const T* data = this->m_frame.column(columnindex<ColInd>{}).data();
+        result_column.resize(counts.size());
+        detail::group_stddev(data, this->group_ids().data(), this->m_frame.size(), counts.size(),
+            counts.data(), result_column.data());
+    }
 
-        T sqdist = static_cast<T>(0);
-        for (size_t rowind : rowinds) {
-            const auto& row = this->m_frame.row(rowind);
-            const T& t      = row.at(ci);
-            T dist          = t - mean;
-            sqdist += (dist * dist);
-        }
+    template<size_t ColInd, typename T>
+    void
+    aggregate_column_arg_op(detail::median_op<ColInd>, const std::vector<size_t>& counts,
+        series<T>& result_column) const
+    {
+        const auto* data = this->m_frame.column(columnindex<ColInd>{}).data();
+        result_column.resize(counts.size());
+        detail::group_quantile(data, this->group_ids().data(), this->m_frame.size(), counts.size(),
+            counts.data(), 0.5, result_column.data());
+    }
+
+    template<size_t ColInd, typename T>
+    void
+    aggregate_column_arg_op(detail::quantile_op<ColInd> op, const std::vector<size_t>& counts,
+        series<T>& result_column) const
+    {
+        const auto* data = this->m_frame.column(columnindex<ColInd>{}).data();
+        result_column.resize(counts.size());
+        detail::group_quantile(data, this->group_ids().data(), this->m_frame.size(), counts.size(),
+            counts.data(), op.q, result_column.data());
+    }
+
+    template<size_t ColInd, typename U>
+    void
+    aggregate_column_arg_op(detail::approx_quantile_op<ColInd> op,
+        const std::vector<size_t>& counts, series<U>& result_column) const
+    {
+        aggregate_column_partial(op, counts, result_column);
+    }
+
+    template<size_t ColInd, typename U>
+    void
+    aggregate_column_arg_op(detail::approx_count_distinct_op<ColInd> op,
+        const std::vector<size_t>& counts, series<U>& result_column) const
+    {
+        aggregate_column_partial(op, counts, result_column);
+    }
+
+    template<size_t ColInd, typename U>
+    void
+    aggregate_column_arg_op(detail::count_distinct_op<ColInd>, const std::vector<size_t>& counts,
+        series<U>& result_column) const
+    {
+        const auto* data = this->m_frame.column(columnindex<ColInd>{}).data();
+        result_column.resize(counts.size());
+        detail::group_count_distinct(data, this->group_ids().data(), this->m_frame.size(),
+            counts.size(), result_column.data());
+    }
+
+    template<size_t ColInd, typename U>
+    void
+    aggregate_column_arg_op(detail::first_op<ColInd> op, const std::vector<size_t>& counts,
+        series<U>& result_column) const
+    {
+        aggregate_column_partial(op, counts, result_column);
+    }
+
+    template<size_t ColInd, typename U>
+    void
+    aggregate_column_arg_op(detail::last_op<ColInd> op, const std::vector<size_t>& counts,
+        series<U>& result_column) const
+    {
+        aggregate_column_partial(op, counts, result_column);
+    }
+
+    template<size_t ColInd, typename U>
+    void
+    aggregate_column_arg_op(detail::argmin_op<ColInd> op, const std::vector<size_t>& counts,
+        series<U>& result_column) const
+    {
+        aggregate_column_partial(op, counts, result_column);
+    }
+
+    template<size_t ColInd, typename U>
+    void
+    aggregate_column_arg_op(detail::argmax_op<ColInd> op, const std::vector<size_t>& counts,
+        series<U>& result_column) const
+    {
+        aggregate_column_partial(op, counts, result_column);
+    }
+
+    template<size_t ColInd, typename U>
+    void
+    aggregate_column_arg_op(detail::count_values_op<ColInd>, const std::vector<size_t>& counts,
+        series<U>& result_column) const
+    {
+        result_column.resize(counts.size());
+        std::copy(counts.begin(), counts.end(), result_column.data());
+    }
 
-        T stddev = static_cast<T>(sqrt(sqdist / rowinds.size()));
-        result_column.push_back(stddev);
+    // Ops without a kernel of their own fill one partial state per group
+    template<typename Op, typename U>
+    void
+    aggregate_column_partial(
+        Op op, const std::vector<size_t>& counts, series<U>& result_column) const
+    {
+        using T       = typename detail::op_column_type<Op, frame<Ts...>>::type;
+        const T* data = this->m_frame.column(columnindex<Op::value>{}).data();
+        std::vector<typename partial_agg<Op>::state> states(counts.size());
+        partial_agg<Op>::scatter(data, this->group_ids().data(), 0, this->m_frame.size(),
+            counts.size(), states.data());
+        result_column.resize(counts.size());
+        auto* out = result_column.data();
+        for (size_t g = 0; g < counts.size(); ++g) {
+            out[g] = partial_agg<Op>::finish(op, states[g], counts[g]);
+        }
     }
 
     template<size_t Ind, typename... Us>
@@ -178,19 +178,16 @@ frame<Ts...>::append_column(const std::string& column_name, Ex expr) const
     auto b              = out.begin();
     auto e              = out.end();
     auto it             = b;
-    if constexpr (detail::is_missing<T>::value) {
-        for (; it != e; ++it) {
-            auto val                         = expr(b, it, e);
+    evaluate_rows(expr, b, e, [&it](const auto& val) {
+        if constexpr (detail::is_missing<T>::value) {
             it->template at<sizeof...(Ts)>() = val;
         }
-    }
-    else {
-        for (; it != e; ++it) {
-            auto val                         = expr(b, it, e);
-            auto uval                        = detail::unwrap_missing<decltype(val)>::unwrap(val);
+        else {
+            auto uval = detail::unwrap_missing<std::decay_t<decltype(val)>>::unwrap(val);
             it->template at<sizeof...(Ts)>() = uval;
         }
-    }
+        ++it;
+    });
     return out;
 }
 
@@ -376,6 +373,33 @@ frame<Ts...>::erase(typename frame<Ts...>::iterator pos)
     return typename frame<Ts...>::iterator{ ptrs };
 }
 
+template<typename... Ts>
+template<size_t... Inds>
+factorization<typename detail::pack_element<Inds, Ts...>::type...>
+frame<Ts...>::factorize(columnindex<Inds>... cols) const
+{
+    detail::flat_index idx;
+    detail::factorize_rows(*this, idx, cols...);
+    std::vector<size_t> firsts(idx.num_groups());
+    for (uint32_t g = 0; g < firsts.size(); ++g) {
+        firsts[g] = idx.first_row(g);
+    }
+    factorization<typename detail::pack_element<Inds, Ts...>::type...> out;
+    out.uniques = detail::take_rows(columns(cols...), firsts);
+    out.codes   = idx.release_row_groups();
+    return out;
+}
+
+template<typename... Ts>
+template<size_t... Inds>
+factorization<typename detail::pack_element<Inds, Ts...>::type...>
+frame<Ts...>::factorize_sorted(columnindex<Inds>... cols) const
+{
+    auto out = factorize(cols...);
+    detail::sort_factorization(out.codes, out.uniques);
+    return out;
+}
+
 template<typename... Ts>
 frame<Ts...>
 frame<Ts...>::fill_forward() const
@@ -500,6 +524,15 @@ frame<Ts...>::mean(columnindex<Ind>) const
     return s.mean();
 }
 
+template<typename... Ts>
+template<size_t Ind>
+double
+frame<Ts...>::median(columnindex<Ind>) const
+{
+    const auto& s = std::get<Ind>(m_columns);
+    return s.median();
+}
+
 template<typename... Ts>
 template<size_t Ind>
 typename frame<Ts...>::template pack_elem_pair<Ind>
@@ -634,25 +667,17 @@ frame<Ts...>::prepend_column(const std::string& column_name, Ex expr) const
     useries us(ns);
     plust.prepend_column(us);
     frame<T, Ts...> out = plust;
-    auto ib             = begin();
-    auto ie             = end();
-    auto ob             = out.begin();
-    auto oe             = out.end();
-    auto iit            = ib;
-    auto oit             = ob;
-    if constexpr (detail::is_missing<T>::value) {
-        for (; oit != oe; ++oit, ++iit) {
-            auto val                         = expr(ib, iit, ie);
+    auto oit            = out.begin();
+    evaluate_rows(expr, begin(), end(), [&oit](const auto& val) {
+        if constexpr (detail::is_missing<T>::value) {
             oit->template at<0>() = val;
         }
-    }
-    else {
-        for (; oit != oe; ++oit, ++iit) {
-            auto val                         = expr(ib, iit, ie);
-            auto uval                        = detail::unwrap_missing<decltype(val)>::unwrap(val);
+        else {
+            auto uval = detail::unwrap_missing<std::decay_t<decltype(val)>>::unwrap(val);
             oit->template at<0>() = uval;
         }
-    }
+        ++oit;
+    });
     return out;
 }
 
@@ -718,6 +743,15 @@ typename frame<Ts...>::template frame_without_indexed_column<Ind> frame<Ts...>::
     return u;
 }
 
+template<typename... Ts>
+template<size_t Ind>
+double
+frame<Ts...>::quantile(columnindex<Ind>, double q) const
+{
+    const auto& s = std::get<Ind>(m_columns);
+    return s.quantile(q);
+}
+
 template<typename... Ts>
 void
 frame<Ts...>::reserve(size_t newsize)
@@ -785,20 +819,16 @@ template<typename Ex>
 std::enable_if_t<is_expression<Ex>::value, frame<Ts...>>
 frame<Ts...>::rows(Ex ex) const
 {
-    frame<Ts...> out;
-    out.set_column_names(column_names());
-
-    auto b    = cbegin();
-    auto curr = b;
-    auto e    = cend();
-    for (; curr != e; ++curr) {
-        auto exprval = ex(b, curr, e);
-        if (exprval) {
-            out.push_back(*curr);
-        }
-    }
+    return detail::take_rows(*this, matching_rows(ex));
+}
 
-    return out;
+template<typename... Ts>
+template<typename Ex, size_t... Inds>
+std::enable_if_t<is_expression<Ex>::value,
+    typename detail::rearrange<frame<Ts...>, Inds...>::type>
+frame<Ts...>::rows(Ex ex, columnindex<Inds>... cols) const
+{
+    return detail::take_rows(columns(cols...), matching_rows(ex));
 }
 
 template<typename... Ts>
@@ -1075,6 +1105,26 @@ frame<Ts...>::insert_impl(
     }
 }
 
+// The indices of the rows for which ex is true. Only the columns that ex
+// refers to are read
+template<typename... Ts>
+template<typename Ex>
+std::vector<size_t>
+frame<Ts...>::matching_rows(Ex ex) const
+{
+    std::vector<size_t> out;
+    auto b    = cbegin();
+    auto curr = b;
+    auto e    = cend();
+    for (size_t i = 0; curr != e; ++curr, ++i) {
+        auto exprval = ex(b, curr, e);
+        if (exprval) {
+            out.push_back(i);
+        }
+    }
+    return out;
+}
+
 template<typename... Ts>
 template<size_t Ind>
 void
@@ -23,9 +23,11 @@
 #include <variant>
 #include <vector>
 
+#include "mainframe/detail/aggregate.hpp"
 #include "mainframe/detail/base.hpp"
 #include "mainframe/detail/series_vector.hpp"
 #include "mainframe/detail/useries.hpp"
+#include "mainframe/detail/window.hpp"
 #include "mainframe/missing.hpp"
 
 namespace mf
@@ -241,6 +243,34 @@ series<T>::clear()
     m_sharedvec = std::make_shared<series_vector<T>>();
 }
 
+template<typename T>
+series<T>
+series<T>::cumsum(size_t num_threads) const
+{
+    return scan(detail::scan_add{}, num_threads);
+}
+
+template<typename T>
+series<T>
+series<T>::cumprod(size_t num_threads) const
+{
+    return scan(detail::scan_mul{}, num_threads);
+}
+
+template<typename T>
+series<T>
+series<T>::cummin(size_t num_threads) const
+{
+    return scan(detail::scan_min{}, num_threads);
+}
+
+template<typename T>
+series<T>
+series<T>::cummax(size_t num_threads) const
+{
+    return scan(detail::scan_max{}, num_threads);
+}
+
 template<typename T>
 T*
 series<T>::data()
@@ -256,6 +286,16 @@ series<T>::data() const
     return m_sharedvec->data();
 }
 
+template<typename T>
+series<typename detail::diff_result<T>::type>
+series<T>::diff(size_t n) const
+{
+    series<typename detail::diff_result<T>::type> out(size());
+    out.set_name(m_name);
+    detail::difference(data(), size(), n, out.data());
+    return out;
+}
+
 template<typename T>
 template<typename _U,
     std::enable_if_t<detail::is_missing<_U>::value &&
@@ -335,6 +375,28 @@ series<T>::erase(typename series<T>::const_iterator first, typename series<T>::c
     return m_sharedvec->erase(first, last);
 }
 
+template<typename T>
+series<typename detail::ewm_mean_kernel::template result_type<T>>
+series<T>::ewm_mean(double alpha, bool adjust) const
+{
+    detail::check_ewm_alpha(alpha);
+    series<typename detail::ewm_mean_kernel::template result_type<T>> out(size());
+    out.set_name(m_name);
+    detail::ewm_mean(data(), size(), alpha, adjust, out.data());
+    return out;
+}
+
+template<typename T>
+series<mi<double>>
+series<T>::ewm_var(double alpha, bool adjust) const
+{
+    detail::check_ewm_alpha(alpha);
+    series<mi<double>> out(size());
+    out.set_name(m_name);
+    detail::ewm_var(data(), size(), alpha, adjust, out.data());
+    return out;
+}
+
 template<typename T>
 typename series<T>::reference
 series<T>::front()
@@ -416,6 +478,13 @@ series<T>::mean() const
     return m;
 }
 
+template<typename T>
+double
+series<T>::median() const
+{
+    return quantile(0.5);
+}
+
 template<typename T>
 std::pair<T, T>
 series<T>::minmax() const
@@ -795,6 +864,41 @@ series<T>::pop_back()
     m_sharedvec->pop_back();
 }
 
+template<typename T>
+series<typename detail::pct_change_result<T>::type>
+series<T>::pct_change(size_t n) const
+{
+    series<typename detail::pct_change_result<T>::type> out(size());
+    out.set_name(m_name);
+    detail::percent_change(data(), size(), n, out.data());
+    return out;
+}
+
+template<typename T>
+double
+series<T>::quantile(double q) const
+{
+    if (!(q >= 0.0 && q <= 1.0)) {
+        throw std::invalid_argument{ "quantile must be between 0 and 1" };
+    }
+    std::vector<typename detail::unwrap_missing<T>::type> values;
+    if constexpr (detail::is_missing<T>::value) {
+        values.reserve(size());
+        for (const T& t : *m_sharedvec) {
+            if (t.has_value()) {
+                values.push_back(*t);
+            }
+        }
+    }
+    else {
+        values.assign(data(), data() + size());
+    }
+    if (values.empty()) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return detail::select_quantile(values.data(), values.size(), q);
+}
+
 template<typename T>
 void
 series<T>::reserve(size_t _size)
@@ -896,6 +1000,17 @@ series<T>::unref()
 
 // ================= private =================
 
+template<typename T>
+template<typename Op>
+series<T>
+series<T>::scan(Op op, size_t num_threads) const
+{
+    series out(size());
+    out.set_name(m_name);
+    detail::inclusive_scan(data(), size(), out.data(), op, num_threads);
+    return out;
+}
+
 template<typename T>
 typename series<T>::iterator
 series<T>::unref(typename series<T>::iterator it)
@@ -6,30 +6,112 @@
 #ifndef INCLUDED_mainframe_join_h
 #define INCLUDED_mainframe_join_h
 
+#include <numeric>
+#include <optional>
+
+#include "mainframe/bloom_filter.hpp"
 #include "mainframe/detail/frame_indexer.hpp"
+#include "mainframe/detail/parallel.hpp"
 
 namespace mf
 {
 
-template<typename... Ts, size_t Ind1, typename... Us, size_t Ind2>
+namespace detail
+{
+
+// Two frames can be joined on two index definitions if the key columns have
+// the same types in the same order
+template<typename IndexDefn1, typename Frame1, typename IndexDefn2, typename Frame2>
+struct is_joinable
+    : std::is_same<typename get_index_frame<IndexDefn1, Frame1>::type,
+          typename get_index_frame<IndexDefn2, Frame2>::type>
+{};
+
+} // namespace detail
+
+///
+/// Options for innerjoin()
+///
+/// By default both frames are indexed and matching rows come out grouped by
+/// key, in the order the left frame's index visits them. With left_order set,
+/// the left frame isn't indexed: each left row is looked up in the right
+/// frame's index in turn, and matching rows come out in left row order.
+///
+/// With prefilter set, a bloom_filter is built from the distinct keys of the
+/// right frame and each left row's key is screened against it before it's
+/// looked up. When only a small fraction of left keys have a match this turns
+/// most probes into a single cache line read. The prefilter implies
+/// left_order, so the order of the output depends on it.
+///
+struct join_options
+{
+    bool prefilter            = false;
+    double bloom_bits_per_key = 10.0;
+    bool left_order           = false;
+};
+
+///
+/// Join two frames, keeping rows whose key columns match in both. Keys can be
+/// a single column or several columns; multi-column keys are hashed and
+/// compared directly over the key columns
+///
+///     auto f1 = innerjoin(left, _0, right, _2);
+///     auto f2 = innerjoin(left, (_0, _1), right, (_2, _0));
+///     auto f3 = innerjoin(left, index_defn<0, 1>{}, right, index_defn<2, 0>{});
+///     auto f4 = innerjoin(left, _0, right, _2, join_options{ true });
+///
+template<typename... Ts, size_t... Inds1, typename... Us, size_t... Inds2>
 frame<Ts..., Us...>
-innerjoin(frame<Ts...> left, columnindex<Ind1>, frame<Us...> right, columnindex<Ind2>)
+innerjoin(frame<Ts...> left, index_defn<Inds1...>, frame<Us...> right, index_defn<Inds2...>,
+    join_options opts = {})
 {
-    // These should be comparable
-    using LT = typename detail::pack_element<Ind1, Ts...>::type;
-    using RT = typename detail::pack_element<Ind2, Us...>::type;
-    static_assert(detail::is_equality_comparable<LT, RT>::value,
-        "Column types to join on must be equality comparable");
+    static_assert(detail::is_joinable<index_defn<Inds1...>, frame<Ts...>, index_defn<Inds2...>,
+                      frame<Us...>>::value,
+        "Column types to join on must be the same on both sides");
 
-    const frame_indexer<index_defn<Ind1>, Ts...> ileft{ left };
-    const frame_indexer<index_defn<Ind2>, Us...> iright{ right };
-    ileft.build_index();
+    const frame_indexer<index_defn<Inds2...>, Us...> iright{ right };
     iright.build_index();
     frame<Ts...> fleft;
     fleft.set_column_names(left.column_names());
     frame<Us...> fright;
     fright.set_column_names(right.column_names());
 
+    if (opts.prefilter || opts.left_order) {
+        bloom_filter bf;
+        std::vector<uint64_t> lhashes;
+        if (opts.prefilter) {
+            using key_seq = std::make_index_sequence<sizeof...(Inds1)>;
+            bf            = bloom_filter{ iright.num_groups(), opts.bloom_bits_per_key };
+            for (auto riit = iright.begin_index(); riit != iright.end_index(); ++riit) {
+                bf.insert_hash(detail::hash_row(riit->first, key_seq{}));
+            }
+            lhashes = detail::hash_columns(left, columnindex<Inds1>{}...);
+        }
+
+        const auto lkeys =
+            detail::get_index_frame<index_defn<Inds1...>, frame<Ts...>>::op(left);
+        for (size_t leftind = 0; leftind < lkeys.size(); ++leftind) {
+            if (opts.prefilter && !bf.may_contain_hash(lhashes[leftind])) {
+                continue;
+            }
+            auto key  = lkeys.row(leftind);
+            auto riit = iright.find_index(key);
+            if (riit == iright.end_index()) {
+                continue;
+            }
+            auto leftrow = *(left.cbegin() + leftind);
+            for (auto rrit = iright.begin_index_row(riit); rrit != iright.end_index_row(riit);
+                 ++rrit) {
+                fleft.push_back(leftrow);
+                fright.push_back(*(iright.begin() + *rrit));
+            }
+        }
+        return fleft.hcat(fright);
+    }
+
+    const frame_indexer<index_defn<Inds1...>, Ts...> ileft{ left };
+    ileft.build_index();
+
     // Iterator through left index keys
     for (auto liit = ileft.begin_index(); liit != ileft.end_index(); ++liit) {
 
@@ -61,18 +143,36 @@ innerjoin(frame<Ts...> left, columnindex<Ind1>, frame<Us...> right, columnindex<
     return out;
 }
 
+template<typename... Ts, size_t... Inds1, typename... Us, size_t... Inds2>
+frame<Ts..., Us...>
+innerjoin(frame<Ts...> left, columnindexpack<Inds1...>, frame<Us...> right,
+    columnindexpack<Inds2...>, join_options opts = {})
+{
+    return innerjoin(left, index_defn<Inds1...>{}, right, index_defn<Inds2...>{}, opts);
+}
+
 template<typename... Ts, size_t Ind1, typename... Us, size_t Ind2>
 frame<Ts..., Us...>
-leftjoin(frame<Ts...> left, columnindex<Ind1>, frame<Us...> right, columnindex<Ind2>)
+innerjoin(frame<Ts...> left, columnindex<Ind1>, frame<Us...> right, columnindex<Ind2>,
+    join_options opts = {})
 {
-    // These should be comparable
-    using LT = typename detail::pack_element<Ind1, Ts...>::type;
-    using RT = typename detail::pack_element<Ind2, Us...>::type;
-    static_assert(detail::is_equality_comparable<LT, RT>::value,
-        "Column types to join on must be equality comparable");
+    return innerjoin(left, index_defn<Ind1>{}, right, index_defn<Ind2>{}, opts);
+}
+
+///
+/// Join two frames, keeping every row of left. Left rows without a match get
+/// default-constructed right columns. Keys are as for innerjoin()
+///
+template<typename... Ts, size_t... Inds1, typename... Us, size_t... Inds2>
+frame<Ts..., Us...>
+leftjoin(frame<Ts...> left, index_defn<Inds1...>, frame<Us...> right, index_defn<Inds2...>)
+{
+    static_assert(detail::is_joinable<index_defn<Inds1...>, frame<Ts...>, index_defn<Inds2...>,
+                      frame<Us...>>::value,
+        "Column types to join on must be the same on both sides");
 
-    const frame_indexer<index_defn<Ind1>, Ts...> ileft{ left };
-    const frame_indexer<index_defn<Ind2>, Us...> iright{ right };
+    const frame_indexer<index_defn<Inds1...>, Ts...> ileft{ left };
+    const frame_indexer<index_defn<Inds2...>, Us...> iright{ right };
     ileft.build_index();
     iright.build_index();
     frame<Ts...> fleft;
@@ -123,18 +223,35 @@ leftjoin(frame<Ts...> left, columnindex<Ind1>, frame<Us...> right, columnindex<I
     return out;
 }
 
+template<typename... Ts, size_t... Inds1, typename... Us, size_t... Inds2>
+frame<Ts..., Us...>
+leftjoin(frame<Ts...> left, columnindexpack<Inds1...>, frame<Us...> right,
+    columnindexpack<Inds2...>)
+{
+    return leftjoin(left, index_defn<Inds1...>{}, right, index_defn<Inds2...>{});
+}
+
 template<typename... Ts, size_t Ind1, typename... Us, size_t Ind2>
 frame<Ts..., Us...>
-outerjoin(frame<Ts...> left, columnindex<Ind1>, frame<Us...> right, columnindex<Ind2>)
+leftjoin(frame<Ts...> left, columnindex<Ind1>, frame<Us...> right, columnindex<Ind2>)
+{
+    return leftjoin(left, index_defn<Ind1>{}, right, index_defn<Ind2>{});
+}
+
+///
+/// Join two frames, keeping every row of both. Rows without a match get
+/// default-constructed columns for the other side. Keys are as for innerjoin()
+///
+template<typename... Ts, size_t... Inds1, typename... Us, size_t... Inds2>
+frame<Ts..., Us...>
+outerjoin(frame<Ts...> left, index_defn<Inds1...>, frame<Us...> right, index_defn<Inds2...>)
 {
-    // These should be comparable
-    using LT = typename detail::pack_element<Ind1, Ts...>::type;
-    using RT = typename detail::pack_element<Ind2, Us...>::type;
-    static_assert(detail::is_equality_comparable<LT, RT>::value,
-        "Column types to join on must be equality comparable");
+    static_assert(detail::is_joinable<index_defn<Inds1...>, frame<Ts...>, index_defn<Inds2...>,
+                      frame<Us...>>::value,
+        "Column types to join on must be the same on both sides");
 
-    const frame_indexer<index_defn<Ind1>, Ts...> ileft{ left };
-    const frame_indexer<index_defn<Ind2>, Us...> iright{ right };
+    const frame_indexer<index_defn<Inds1...>, Ts...> ileft{ left };
+    const frame_indexer<index_defn<Inds2...>, Us...> iright{ right };
     ileft.build_index();
     iright.build_index();
     frame<Ts...> fleft;
@@ -202,6 +319,298 @@ outerjoin(frame<Ts...> left, columnindex<Ind1>, frame<Us...> right, columnindex<
     return out;
 }
 
+template<typename... Ts, size_t... Inds1, typename... Us, size_t... Inds2>
+frame<Ts..., Us...>
+outerjoin(frame<Ts...> left, columnindexpack<Inds1...>, frame<Us...> right,
+    columnindexpack<Inds2...>)
+{
+    return outerjoin(left, index_defn<Inds1...>{}, right, index_defn<Inds2...>{});
+}
+
+template<typename... Ts, size_t Ind1, typename... Us, size_t Ind2>
+frame<Ts..., Us...>
+outerjoin(frame<Ts...> left, columnindex<Ind1>, frame<Us...> right, columnindex<Ind2>)
+{
+    return outerjoin(left, index_defn<Ind1>{}, right, index_defn<Ind2>{});
+}
+
+namespace detail
+{
+
+// Selection vector (left row indices, in left's order) of the left rows that
+// have (keep_matches) or don't have (!keep_matches) a key in right. Only a set
+// of right's keys is built - no right columns are copied.
+template<typename... Ts, size_t... Inds1, typename... Us, size_t... Inds2>
+std::vector<size_t>
+semijoin_selection(const frame<Ts...>& left, index_defn<Inds1...>, const frame<Us...>& right,
+    index_defn<Inds2...>, bool keep_matches)
+{
+    static_assert(is_joinable<index_defn<Inds1...>, frame<Ts...>, index_defn<Inds2...>,
+                      frame<Us...>>::value,
+        "Column types to join on must be the same on both sides");
+    using get_lkeys = get_index_frame<index_defn<Inds1...>, frame<Ts...>>;
+    using get_rkeys = get_index_frame<index_defn<Inds2...>, frame<Us...>>;
+    using key_type  = typename get_rkeys::type::const_value_type;
+
+    const auto lkeys = get_lkeys::op(left);
+    const auto rkeys = get_rkeys::op(right);
+    std::unordered_set<key_type> keyset;
+    keyset.reserve(rkeys.size());
+    for (size_t i = 0; i < rkeys.size(); ++i) {
+        keyset.insert(rkeys.row(i));
+    }
+
+    std::vector<size_t> sel;
+    for (size_t i = 0; i < lkeys.size(); ++i) {
+        bool found = keyset.count(lkeys.row(i)) != 0;
+        if (found == keep_matches) {
+            sel.push_back(i);
+        }
+    }
+    return sel;
+}
+
+} // namespace detail
+
+///
+/// Semi-join: the rows of left that have a matching key in right, in left's
+/// order. Nothing from right is copied into the result - it's a filtered left
+///
+///     // events whose (user, site) is in the allow-list
+///     auto allowed = semijoin(events, (_1, _2), allowlist, (_0, _1));
+///
+template<typename... Ts, size_t... Inds1, typename... Us, size_t... Inds2>
+frame<Ts...>
+semijoin(const frame<Ts...>& left, index_defn<Inds1...> li, const frame<Us...>& right,
+    index_defn<Inds2...> ri)
+{
+    auto sel = detail::semijoin_selection(left, li, right, ri, true);
+    return detail::take_rows(left, sel);
+}
+
+template<typename... Ts, size_t... Inds1, typename... Us, size_t... Inds2>
+frame<Ts...>
+semijoin(const frame<Ts...>& left, columnindexpack<Inds1...>, const frame<Us...>& right,
+    columnindexpack<Inds2...>)
+{
+    return semijoin(left, index_defn<Inds1...>{}, right, index_defn<Inds2...>{});
+}
+
+template<typename... Ts, size_t Ind1, typename... Us, size_t Ind2>
+frame<Ts...>
+semijoin(const frame<Ts...>& left, columnindex<Ind1>, const frame<Us...>& right, columnindex<Ind2>)
+{
+    return semijoin(left, index_defn<Ind1>{}, right, index_defn<Ind2>{});
+}
+
+///
+/// Anti-join: the rows of left that have no matching key in right, in left's
+/// order. Like semijoin(), nothing from right is copied into the result
+///
+///     auto unknown = antijoin(events, _1, users, _0);
+///
+template<typename... Ts, size_t... Inds1, typename... Us, size_t... Inds2>
+frame<Ts...>
+antijoin(const frame<Ts...>& left, index_defn<Inds1...> li, const frame<Us...>& right,
+    index_defn<Inds2...> ri)
+{
+    auto sel = detail::semijoin_selection(left, li, right, ri, false);
+    return detail::take_rows(left, sel);
+}
+
+template<typename... Ts, size_t... Inds1, typename... Us, size_t... Inds2>
+frame<Ts...>
+antijoin(const frame<Ts...>& left, columnindexpack<Inds1...>, const frame<Us...>& right,
+    columnindexpack<Inds2...>)
+{
+    return antijoin(left, index_defn<Inds1...>{}, right, index_defn<Inds2...>{});
+}
+
+template<typename... Ts, size_t Ind1, typename... Us, size_t Ind2>
+frame<Ts...>
+antijoin(const frame<Ts...>& left, columnindex<Ind1>, const frame<Us...>& right, columnindex<Ind2>)
+{
+    return antijoin(left, index_defn<Ind1>{}, right, index_defn<Ind2>{});
+}
+
+///
+/// Options for asofjoin()
+///
+/// Tol is the type of the difference between two "on" keys - for example `int`
+/// for `int` keys or `std::chrono::days` for `sys_days` keys. If tolerance is
+/// set, a right row only matches a left row when `left key - right key <=
+/// tolerance`. If allow_exact_matches is false, the right key must be strictly
+/// less than the left key. num_threads is only used when joining with "by"
+/// columns, where each "by" partition is an independent unit of work; 0 means
+/// one thread per hardware thread.
+///
+template<typename Tol = void>
+struct asof_options
+{
+    std::optional<Tol> tolerance;
+    bool allow_exact_matches = true;
+    size_t num_threads       = 1;
+};
+
+template<>
+struct asof_options<void>
+{
+    bool allow_exact_matches = true;
+    size_t num_threads       = 1;
+};
+
+namespace detail
+{
+
+// Order rows (a list of row indices) by key. Rows that are already in key
+// order - the common case for time series - are left alone.
+template<typename K>
+void
+asof_order(const K* keys, std::vector<size_t>& rows)
+{
+    auto lt = [keys](size_t a, size_t b) { return keys[a] < keys[b]; };
+    if (!std::is_sorted(rows.begin(), rows.end(), lt)) {
+        std::stable_sort(rows.begin(), rows.end(), lt);
+    }
+}
+
+// Linear merge of one partition. lrows and rrows must be in key order.
+// matches[lrow] is set to the right row with the greatest key at or before
+// (or strictly before) the left key, or npos_row if there isn't one.
+template<typename L, typename R, typename Tol>
+void
+asof_merge(const L* lkeys, const std::vector<size_t>& lrows, const R* rkeys,
+    const std::vector<size_t>& rrows, const asof_options<Tol>& opts,
+    std::vector<size_t>& matches)
+{
+    const size_t rsize = rrows.size();
+    size_t r           = 0; // number of right rows before the current left key
+    for (size_t lrow : lrows) {
+        const L& lkey = lkeys[lrow];
+        if (opts.allow_exact_matches) {
+            while (r < rsize && !(lkey < rkeys[rrows[r]])) {
+                ++r;
+            }
+        }
+        else {
+            while (r < rsize && rkeys[rrows[r]] < lkey) {
+                ++r;
+            }
+        }
+        if (r == 0) {
+            matches[lrow] = npos_row;
+            continue;
+        }
+        size_t rrow = rrows[r - 1];
+        if constexpr (!std::is_void<Tol>::value) {
+            if (opts.tolerance.has_value() && *opts.tolerance < (lkey - rkeys[rrow])) {
+                matches[lrow] = npos_row;
+                continue;
+            }
+        }
+        matches[lrow] = rrow;
+    }
+}
+
+} // namespace detail
+
+///
+/// As-of join: for every row of left, find the last row of right whose "on"
+/// key is at or before the left row's "on" key. For example, joining trades to
+/// the latest quote at or before each trade time:
+///
+///     frame<int, double> trades;   // time, volume
+///     frame<int, double> quotes;   // time, price
+///     auto f = asofjoin(trades, _0, quotes, _0);
+///
+/// The result has every row of left, in left's order, followed by the matched
+/// right columns. Left rows without a match get default-constructed right
+/// columns, like leftjoin(). Both inputs are merged in one linear pass over
+/// their "on" key order - inputs that are already sorted on their keys aren't
+/// sorted again.
+///
+template<typename... Ts, size_t Ind1, typename... Us, size_t Ind2, typename Tol = void>
+frame<Ts..., Us...>
+asofjoin(const frame<Ts...>& left, columnindex<Ind1> lon, const frame<Us...>& right,
+    columnindex<Ind2> ron, asof_options<Tol> opts = {})
+{
+    const auto* lkeys = left.column(lon).data();
+    const auto* rkeys = right.column(ron).data();
+
+    std::vector<size_t> lrows(left.size());
+    std::iota(lrows.begin(), lrows.end(), 0);
+    std::vector<size_t> rrows(right.size());
+    std::iota(rrows.begin(), rrows.end(), 0);
+    detail::asof_order(lkeys, lrows);
+    detail::asof_order(rkeys, rrows);
+
+    std::vector<size_t> matches(left.size(), detail::npos_row);
+    detail::asof_merge(lkeys, lrows, rkeys, rrows, opts, matches);
+
+    return left.hcat(detail::take_rows(right, matches));
+}
+
+///
+/// As-of join with an exact-match "by" column: the as-of match for a left row
+/// is only looked for among right rows with the same "by" value. For example,
+/// the latest quote for the same ticker at or before each trade:
+///
+///     frame<int, std::string, double> trades;   // time, ticker, volume
+///     frame<int, std::string, double> quotes;   // time, ticker, price
+///     asof_options<int> opts;
+///     opts.tolerance   = 10;
+///     opts.num_threads = 4;
+///     auto f = asofjoin(trades, _0, _1, quotes, _0, _1, opts);
+///
+/// Each "by" partition is merged independently, so partitions are spread
+/// across opts.num_threads threads.
+///
+template<typename... Ts, size_t On1, size_t By1, typename... Us, size_t On2, size_t By2,
+    typename Tol = void>
+frame<Ts..., Us...>
+asofjoin(const frame<Ts...>& left, columnindex<On1> lon, columnindex<By1>,
+    const frame<Us...>& right, columnindex<On2> ron, columnindex<By2>,
+    asof_options<Tol> opts = {})
+{
+    using LT = typename detail::pack_element<By1, Ts...>::type;
+    using RT = typename detail::pack_element<By2, Us...>::type;
+    static_assert(std::is_same<LT, RT>::value, "Column types to join by must be the same");
+
+    const frame_indexer<index_defn<By1>, Ts...> ileft{ left };
+    const frame_indexer<index_defn<By2>, Us...> iright{ right };
+    ileft.build_index();
+    iright.build_index();
+
+    const auto* lkeys = left.column(lon).data();
+    const auto* rkeys = right.column(ron).data();
+
+    // Pair up the partitions first so that the threads don't touch the
+    // indexes' hash tables
+    using lpart = std::vector<size_t>;
+    std::vector<std::pair<lpart, lpart>> parts;
+    for (auto liit = ileft.begin_index(); liit != ileft.end_index(); ++liit) {
+        auto riit = iright.find_index(liit->first);
+        lpart rrows;
+        if (riit != iright.end_index()) {
+            rrows.assign(iright.begin_index_row(riit), iright.end_index_row(riit));
+        }
+        parts.emplace_back(lpart(ileft.begin_index_row(liit), ileft.end_index_row(liit)),
+            std::move(rrows));
+    }
+
+    // Every left row is in exactly one partition, so the threads write
+    // disjoint elements of matches
+    std::vector<size_t> matches(left.size(), detail::npos_row);
+    detail::parallel_for(parts.size(), opts.num_threads, [&](size_t p) {
+        auto& [lrows, rrows] = parts[p];
+        detail::asof_order(lkeys, lrows);
+        detail::asof_order(rkeys, rrows);
+        detail::asof_merge(lkeys, lrows, rkeys, rrows, opts, matches);
+    });
+
+    return left.hcat(detail::take_rows(right, matches));
+}
+
 } // namespace mf
   //
 #endif // INCLUDED_mainframe_join_h
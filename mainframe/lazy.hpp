@@ -0,0 +1,809 @@
+//          Copyright Ted Middleton 2022.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          https://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef INCLUDED_mainframe_lazy_h
+#define INCLUDED_mainframe_lazy_h
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "mainframe/frame.hpp"
+#include "mainframe/group.hpp"
+
+namespace mf
+{
+
+namespace detail
+{
+
+// A batch of rows on its way through a lazy pipeline: the rows of frame that
+// are still selected, in ascending order. Filters only shrink the selection,
+// and projections only rearrange the (shared) columns, so nothing is copied
+// until a derived column needs the rows gathered
+template<typename F>
+struct lazy_batch
+{
+    F frame;
+    std::vector<size_t> selected;
+};
+
+template<typename F>
+F
+gather(const lazy_batch<F>& batch)
+{
+    if (batch.selected.size() == batch.frame.size()) {
+        return batch.frame;
+    }
+    return take_rows(batch.frame, batch.selected);
+}
+
+template<typename F>
+lazy_batch<F>
+gathered(const lazy_batch<F>& batch)
+{
+    lazy_batch<F> out{ gather(batch), {} };
+    out.selected.resize(out.frame.size());
+    std::iota(out.selected.begin(), out.selected.end(), 0);
+    return out;
+}
+
+template<typename F>
+struct frame_width;
+
+template<typename... Ts>
+struct frame_width<frame<Ts...>> : std::integral_constant<size_t, sizeof...(Ts)>
+{};
+
+// Sets of a frame's columns, for working out which ones a pipeline uses:
+// used[i] is whether column i is needed
+template<size_t N>
+constexpr std::array<bool, N>
+all_columns()
+{
+    std::array<bool, N> out{};
+    for (auto& u : out) {
+        u = true;
+    }
+    return out;
+}
+
+template<size_t N>
+constexpr size_t
+count_columns(const std::array<bool, N>& used)
+{
+    size_t num = 0;
+    for (bool u : used) {
+        num += u ? 1 : 0;
+    }
+    return num;
+}
+
+// The index of the n'th used column
+template<size_t N>
+constexpr size_t
+nth_column(const std::array<bool, N>& used, size_t n)
+{
+    size_t i = 0;
+    for (; i < N; ++i) {
+        if (used[i] && n-- == 0) {
+            break;
+        }
+    }
+    return i;
+}
+
+// A frame's columns Cols, or the frame itself if that's all of them
+template<typename F, size_t... Cols>
+auto
+project_columns(const F& f, std::index_sequence<Cols...>)
+{
+    if constexpr (std::is_same_v<std::index_sequence<Cols...>,
+                      std::make_index_sequence<frame_width<F>::value>>) {
+        return f;
+    }
+    else {
+        return f.columns(columnindex<Cols>{}...);
+    }
+}
+
+template<size_t... Inds>
+struct lazy_select;
+
+// The stages that take a frame of columns Natural to one of columns Out, a
+// subset of them - none if they're the same
+template<size_t... Natural, size_t... Out>
+auto
+project_stage(std::index_sequence<Natural...>, std::index_sequence<Out...>)
+{
+    if constexpr (std::is_same_v<std::index_sequence<Natural...>, std::index_sequence<Out...>>) {
+        return std::tuple<>{};
+    }
+    else {
+        return std::make_tuple(lazy_select<column_position<Out, Natural...>()...>{});
+    }
+}
+
+template<typename Op, typename = void>
+struct op_reads_column : std::false_type
+{};
+
+template<typename Op>
+struct op_reads_column<Op, std::void_t<decltype(Op::value)>> : std::true_type
+{};
+
+template<typename To, typename From>
+void
+copy_op_params(To&, const From&)
+{}
+
+template<size_t I, size_t J>
+void
+copy_op_params(quantile_op<I>& to, const quantile_op<J>& from)
+{
+    to.q = from.q;
+}
+
+template<size_t I, size_t J>
+void
+copy_op_params(approx_quantile_op<I>& to, const approx_quantile_op<J>& from)
+{
+    to.q = from.q;
+}
+
+// The same aggregate op over a frame made of just the columns Cols
+template<template<size_t> typename Op, size_t Ind, size_t... Cols>
+Op<column_position<Ind, Cols...>()>
+relabel_op(const Op<Ind>& op, std::index_sequence<Cols...>)
+{
+    Op<column_position<Ind, Cols...>()> out;
+    copy_op_params(out, op);
+    return out;
+}
+
+template<size_t... Cols>
+count_op
+relabel_op(const count_op& op, std::index_sequence<Cols...>)
+{
+    return op;
+}
+
+// The stages a lazy_frame records. Each can run() on a whole frame, and the
+// ones marked batchable can also run_batch() on a lazy_batch. output<F> is
+// the frame type a stage makes from F.
+//
+// used_columns<N>(out) is which of its input's N columns a stage needs to
+// make the columns out of its output, and relabel<N>(in, out) is the same
+// stage (as a tuple of stages) over a frame of just the input columns in,
+// making just the output columns out
+template<typename Ex>
+struct lazy_filter
+{
+    static constexpr bool batchable = is_row_local<Ex>::value;
+
+    template<typename F>
+    using output = F;
+
+    template<typename F>
+    F
+    run(const F& f) const
+    {
+        return f.rows(ex);
+    }
+
+    template<typename F>
+    lazy_batch<F>
+    run_batch(lazy_batch<F> batch) const
+    {
+        auto b     = batch.frame.cbegin();
+        auto e     = batch.frame.cend();
+        auto it    = b;
+        size_t pos = 0;
+        size_t num = 0;
+        for (size_t row : batch.selected) {
+            it += static_cast<ptrdiff_t>(row - pos);
+            pos = row;
+            if (ex(b, it, e)) {
+                batch.selected[num++] = row;
+            }
+        }
+        batch.selected.resize(num);
+        return batch;
+    }
+
+    template<size_t N>
+    static constexpr std::array<bool, N>
+    used_columns(std::array<bool, N> used)
+    {
+        expr_columns<Ex>::mark(used);
+        return used;
+    }
+
+    template<size_t N, size_t... In, size_t... Out>
+    auto
+    relabel(std::index_sequence<In...> in, std::index_sequence<Out...> out) const
+    {
+        auto rex = relabel_columns(ex, in);
+        return std::tuple_cat(
+            std::make_tuple(lazy_filter<decltype(rex)>{ rex }), project_stage(in, out));
+    }
+
+    Ex ex;
+};
+
+template<typename T, typename Ex>
+struct lazy_derive
+{
+    static constexpr bool batchable = is_row_local<Ex>::value;
+
+    template<typename F>
+    using output = decltype(std::declval<const F&>().template append_column<T>(
+        std::declval<const std::string&>(), std::declval<Ex>()));
+
+    template<typename F>
+    output<F>
+    run(const F& f) const
+    {
+        return f.template append_column<T>(name, ex);
+    }
+
+    template<typename F>
+    lazy_batch<output<F>>
+    run_batch(const lazy_batch<F>& batch) const
+    {
+        auto dense = gathered(batch);
+        return { run(dense.frame), std::move(dense.selected) };
+    }
+
+    // A column that nothing uses isn't worked out at all
+    template<size_t N>
+    static constexpr std::array<bool, N>
+    used_columns(const std::array<bool, N + 1>& out)
+    {
+        std::array<bool, N> used{};
+        for (size_t i = 0; i < N; ++i) {
+            used[i] = out[i];
+        }
+        if (out[N]) {
+            expr_columns<Ex>::mark(used);
+        }
+        return used;
+    }
+
+    template<size_t N, size_t... In, size_t... Out>
+    auto
+    relabel(std::index_sequence<In...> in, std::index_sequence<Out...> out) const
+    {
+        if constexpr (((Out == N) || ...)) {
+            auto rex = relabel_columns(ex, in);
+            return std::tuple_cat(std::make_tuple(lazy_derive<T, decltype(rex)>{ name, rex }),
+                project_stage(std::index_sequence<In..., N>{}, out));
+        }
+        else {
+            return project_stage(in, out);
+        }
+    }
+
+    std::string name;
+    Ex ex;
+};
+
+template<size_t... Inds>
+struct lazy_select
+{
+    static constexpr bool batchable = true;
+
+    template<typename F>
+    using output = typename rearrange<F, Inds...>::type;
+
+    template<typename F>
+    output<F>
+    run(const F& f) const
+    {
+        return f.columns(columnindex<Inds>{}...);
+    }
+
+    template<typename F>
+    lazy_batch<output<F>>
+    run_batch(lazy_batch<F> batch) const
+    {
+        return { run(batch.frame), std::move(batch.selected) };
+    }
+
+    static constexpr std::array<size_t, sizeof...(Inds)> indices{ Inds... };
+
+    template<size_t N>
+    static constexpr std::array<bool, N>
+    used_columns(const std::array<bool, sizeof...(Inds)>& out)
+    {
+        std::array<bool, N> used{};
+        for (size_t i = 0; i < sizeof...(Inds); ++i) {
+            used[indices[i]] = used[indices[i]] || out[i];
+        }
+        return used;
+    }
+
+    template<size_t N, size_t... In, size_t... Out>
+    auto
+    relabel(std::index_sequence<In...>, std::index_sequence<Out...>) const
+    {
+        return std::make_tuple(lazy_select<column_position<indices[Out], In...>()...>{});
+    }
+};
+
+template<bool Reverse, size_t... Inds>
+struct lazy_sort
+{
+    static constexpr bool batchable = false;
+
+    template<typename F>
+    using output = F;
+
+    template<typename F>
+    F
+    run(const F& f) const
+    {
+        if constexpr (Reverse) {
+            return f.reverse_sorted(columnindex<Inds>{}...);
+        }
+        else {
+            return f.sorted(columnindex<Inds>{}...);
+        }
+    }
+
+    template<size_t N>
+    static constexpr std::array<bool, N>
+    used_columns(std::array<bool, N> used)
+    {
+        ((used[Inds] = true), ...);
+        return used;
+    }
+
+    template<size_t N, size_t... In, size_t... Out>
+    auto
+    relabel(std::index_sequence<In...> in, std::index_sequence<Out...> out) const
+    {
+        using relabeled = lazy_sort<Reverse, column_position<Inds, In...>()...>;
+        return std::tuple_cat(std::make_tuple(relabeled{}), project_stage(in, out));
+    }
+};
+
+template<typename Keys, typename... Ops>
+struct lazy_aggregate;
+
+template<size_t... Keys, typename... Ops>
+struct lazy_aggregate<index_defn<Keys...>, Ops...>
+{
+    static constexpr bool batchable = false;
+
+    // Whether batches can be folded in as they come, rather than gathered
+    // into one frame first
+    static constexpr bool incremental = (is_mergeable_op<Ops>::value && ...);
+
+    template<typename F>
+    using output = decltype(std::declval<const F&>()
+                                .groupby(columnindex<Keys>{}...)
+                                .aggregate(std::declval<Ops>()...));
+
+    template<typename F>
+    output<F>
+    run(const F& f) const
+    {
+        return std::apply(
+            [&f](const Ops&... o) { return f.groupby(columnindex<Keys>{}...).aggregate(o...); },
+            ops);
+    }
+
+    // An incremental aggregate over no rows yet, from a frame with F's
+    // column names
+    template<typename F>
+    auto
+    start(const F& names) const
+    {
+        return std::apply(
+            [&names](const Ops&... o) {
+                return names.groupby(columnindex<Keys>{}...).incremental(o...);
+            },
+            ops);
+    }
+
+    // Every result column is made, used or not
+    template<size_t N, size_t M>
+    static constexpr std::array<bool, N>
+    used_columns(const std::array<bool, M>&)
+    {
+        std::array<bool, N> used{};
+        ((used[Keys] = true), ...);
+        (mark_op<Ops>(used), ...);
+        return used;
+    }
+
+    template<size_t N, size_t... In, size_t... Out>
+    auto
+    relabel(std::index_sequence<In...> in, std::index_sequence<Out...>) const
+    {
+        return std::apply(
+            [in](const Ops&... o) {
+                using relabeled = lazy_aggregate<index_defn<column_position<Keys, In...>()...>,
+                    decltype(relabel_op(o, in))...>;
+                return std::make_tuple(relabeled{ { relabel_op(o, in)... } });
+            },
+            ops);
+    }
+
+    template<typename Op, size_t N>
+    static constexpr void
+    mark_op(std::array<bool, N>& used)
+    {
+        if constexpr (op_reads_column<Op>::value) {
+            used[Op::value] = true;
+        }
+    }
+
+    std::tuple<Ops...> ops;
+};
+
+// The frame type after the first I stages
+template<size_t I, typename F, typename... Stages>
+struct lazy_output
+{
+    using type = F;
+};
+
+template<size_t I, typename F, typename Stage, typename... Stages>
+struct lazy_output<I, F, Stage, Stages...>
+    : std::conditional_t<I == 0, lazy_output<0, F>,
+          lazy_output<I - 1, typename Stage::template output<F>, Stages...>>
+{};
+
+template<typename Stage>
+struct is_lazy_aggregate : std::false_type
+{};
+
+template<typename Keys, typename... Ops>
+struct is_lazy_aggregate<lazy_aggregate<Keys, Ops...>> : std::true_type
+{};
+
+template<typename Stage>
+struct is_incremental_aggregate : std::false_type
+{};
+
+template<typename Keys, typename... Ops>
+struct is_incremental_aggregate<lazy_aggregate<Keys, Ops...>>
+    : std::bool_constant<lazy_aggregate<Keys, Ops...>::incremental>
+{};
+
+} // namespace detail
+
+template<typename Lazy, size_t... Keys>
+class lazy_group;
+
+///
+/// A pipeline of frame operations, recorded by mf::lazy() and run by collect()
+///
+/// rows(), columns(), append_column(), sorted(), reverse_sorted() and
+/// groupby().aggregate() take the same arguments as on a frame, but only
+/// record the operation. collect() then runs the whole pipeline, fusing what
+/// it can: each run of consecutive filters, projections and derived columns
+/// goes over the source a batch of rows at a time, so there are no
+/// intermediate frames the size of the input. A filter only narrows the
+/// batch's selection of rows, a projection only picks columns, and rows are
+/// gathered when a derived column is computed (only the rows still selected)
+/// or at the end of the run. An aggregation after such a run folds in each
+/// batch as it comes, unless it has an op like median that needs all of a
+/// group's values at once.
+///
+///     auto res = mf::lazy(trades)
+///                    .rows(_2 > 0.0)
+///                    .append_column<double>("notional", _2 * _3)
+///                    .rows(_4 > 1e6)
+///                    .groupby(_1)
+///                    .aggregate(agg::sum(_4), agg::count())
+///                    .collect();
+///
+/// Before it runs, the pipeline is cut down to the columns it uses. A column
+/// that no later filter, derived column, sort, aggregation or the result
+/// needs is dropped as soon as it can be - from the source, if nothing reads
+/// it at all - so it is never read, gathered or copied, and a derived column
+/// that nothing uses isn't worked out. Above, only columns 1 to 3 of trades
+/// are touched, however many it has.
+///
+/// Expressions that look at other rows - _1[-1], rolling_mean(), row_number()
+/// and so on - and sorts break the pipeline there: everything before them is
+/// gathered into one frame first, so the results are the same as running each
+/// operation in turn.
+///
+template<typename Frame, typename... Stages>
+class lazy_frame
+{
+public:
+    using output_frame = typename detail::lazy_output<sizeof...(Stages), Frame, Stages...>::type;
+
+    explicit lazy_frame(Frame source, std::tuple<Stages...> stages = {})
+        : m_source(std::move(source))
+        , m_stages(std::move(stages))
+    {}
+
+    template<typename Ex>
+    lazy_frame<Frame, Stages..., detail::lazy_filter<Ex>>
+    rows(Ex ex) const
+    {
+        return then(detail::lazy_filter<Ex>{ ex });
+    }
+
+    template<size_t... Inds>
+    lazy_frame<Frame, Stages..., detail::lazy_select<Inds...>>
+    columns(columnindex<Inds>...) const
+    {
+        return then(detail::lazy_select<Inds...>{});
+    }
+
+    template<typename T, typename Ex>
+    lazy_frame<Frame, Stages..., detail::lazy_derive<T, Ex>>
+    append_column(const std::string& column_name, Ex ex) const
+    {
+        return then(detail::lazy_derive<T, Ex>{ column_name, ex });
+    }
+
+    template<size_t... Inds>
+    lazy_frame<Frame, Stages..., detail::lazy_sort<false, Inds...>>
+    sorted(columnindex<Inds>...) const
+    {
+        return then(detail::lazy_sort<false, Inds...>{});
+    }
+
+    template<size_t... Inds>
+    lazy_frame<Frame, Stages..., detail::lazy_sort<true, Inds...>>
+    reverse_sorted(columnindex<Inds>...) const
+    {
+        return then(detail::lazy_sort<true, Inds...>{});
+    }
+
+    template<size_t... Keys>
+    lazy_group<lazy_frame, Keys...>
+    groupby(columnindex<Keys>...) const
+    {
+        return lazy_group<lazy_frame, Keys...>{ *this };
+    }
+
+    /// Run the pipeline
+    output_frame
+    collect() const
+    {
+        return pruned().run();
+    }
+
+private:
+    template<typename, size_t...>
+    friend class lazy_group;
+
+    template<typename, typename...>
+    friend class lazy_frame;
+
+    static constexpr size_t num_stages = sizeof...(Stages);
+    static constexpr size_t batch_rows = 1 << 14;
+
+    template<size_t I>
+    using stage_type = std::tuple_element_t<I, std::tuple<Stages...>>;
+
+    // The frame going into stage I
+    template<size_t I>
+    using frame_at = typename detail::lazy_output<I, Frame, Stages...>::type;
+
+    template<size_t I>
+    using width_at = detail::frame_width<frame_at<I>>;
+
+    template<typename Stage>
+    lazy_frame<Frame, Stages..., Stage>
+    then(Stage stage) const
+    {
+        return lazy_frame<Frame, Stages..., Stage>{ m_source,
+            std::tuple_cat(m_stages, std::make_tuple(std::move(stage))) };
+    }
+
+    // The columns of the frame going into stage I that are kept: the ones
+    // that stage I or a later one uses, or all of them after an aggregation
+    template<size_t I>
+    static constexpr std::array<bool, width_at<I>::value>
+    kept_mask()
+    {
+        if constexpr (I == num_stages) {
+            return detail::all_columns<width_at<I>::value>();
+        }
+        else if constexpr (follows_aggregate<I>()) {
+            return detail::all_columns<width_at<I>::value>();
+        }
+        else {
+            return stage_type<I>::template used_columns<width_at<I>::value>(kept_mask<I + 1>());
+        }
+    }
+
+    template<size_t I>
+    static constexpr bool
+    follows_aggregate()
+    {
+        if constexpr (I > 0) {
+            return detail::is_lazy_aggregate<stage_type<I - 1>>::value;
+        }
+        else {
+            return false;
+        }
+    }
+
+    template<size_t I, size_t... Ns>
+    static constexpr auto
+    kept_columns_impl(std::index_sequence<Ns...>)
+    {
+        constexpr auto mask = kept_mask<I>();
+        return std::index_sequence<detail::nth_column(mask, Ns)...>{};
+    }
+
+    template<size_t I>
+    using kept_columns = decltype(kept_columns_impl<I>(
+        std::make_index_sequence<detail::count_columns(kept_mask<I>())>{}));
+
+    // The same pipeline over just the source's kept columns, with each stage
+    // making just the columns kept after it
+    auto
+    pruned() const
+    {
+        auto stages = relabel_from<0>();
+        auto source = detail::project_columns(m_source, kept_columns<0>{});
+        return std::apply(
+            [&source](const auto&... s) {
+                return lazy_frame<decltype(source), std::decay_t<decltype(s)>...>{ source,
+                    std::make_tuple(s...) };
+            },
+            stages);
+    }
+
+    template<size_t I>
+    auto
+    relabel_from() const
+    {
+        if constexpr (I == num_stages) {
+            return std::tuple<>{};
+        }
+        else {
+            return std::tuple_cat(std::get<I>(m_stages).template relabel<width_at<I>::value>(
+                                      kept_columns<I>{}, kept_columns<I + 1>{}),
+                relabel_from<I + 1>());
+        }
+    }
+
+    output_frame
+    run() const
+    {
+        return run_from<0>(m_source);
+    }
+
+    // The end of the run of batchable stages starting at I
+    template<size_t I>
+    static constexpr size_t
+    batch_end()
+    {
+        if constexpr (I < num_stages) {
+            if constexpr (stage_type<I>::batchable) {
+                return batch_end<I + 1>();
+            }
+            else {
+                return I;
+            }
+        }
+        else {
+            return I;
+        }
+    }
+
+    // Whether stage J can take the batches of the run before it one by one
+    template<size_t J>
+    static constexpr bool
+    folds_batches()
+    {
+        if constexpr (J < num_stages) {
+            return detail::is_incremental_aggregate<stage_type<J>>::value;
+        }
+        else {
+            return false;
+        }
+    }
+
+    template<size_t I, typename F>
+    auto
+    run_from(const F& in) const
+    {
+        if constexpr (I == num_stages) {
+            return in;
+        }
+        else {
+            constexpr size_t J = batch_end<I>();
+            if constexpr (J == I) {
+                return run_from<I + 1>(std::get<I>(m_stages).run(in));
+            }
+            else if constexpr (folds_batches<J>()) {
+                auto agg = std::get<J>(m_stages).start(run_rows<I, J>(in, 0, 0));
+                for (size_t first = 0; first < in.size(); first += batch_rows) {
+                    agg.append(run_rows<I, J>(in, first, std::min(first + batch_rows, in.size())));
+                }
+                return run_from<J + 1>(agg.result());
+            }
+            else {
+                // An empty batch gives the result's column names
+                auto out = run_rows<I, J>(in, 0, 0);
+                for (size_t first = 0; first < in.size(); first += batch_rows) {
+                    auto part = run_rows<I, J>(in, first, std::min(first + batch_rows, in.size()));
+                    out.insert(out.end(), part.cbegin(), part.cend());
+                }
+                return run_from<J>(out);
+            }
+        }
+    }
+
+    // Rows first to last of in through stages I to J - 1
+    template<size_t I, size_t J, typename F>
+    auto
+    run_rows(const F& in, size_t first, size_t last) const
+    {
+        detail::lazy_batch<F> batch{ in, std::vector<size_t>(last - first) };
+        std::iota(batch.selected.begin(), batch.selected.end(), first);
+        return detail::gather(run_stages<I, J>(std::move(batch)));
+    }
+
+    template<size_t I, size_t J, typename Batch>
+    auto
+    run_stages(Batch batch) const
+    {
+        if constexpr (I == J) {
+            return batch;
+        }
+        else {
+            return run_stages<I + 1, J>(std::get<I>(m_stages).run_batch(std::move(batch)));
+        }
+    }
+
+    Frame m_source;
+    std::tuple<Stages...> m_stages;
+};
+
+///
+/// The groupby() of a lazy_frame, waiting for its aggregate()
+///
+template<typename Lazy, size_t... Keys>
+class lazy_group
+{
+public:
+    explicit lazy_group(Lazy l)
+        : m_lazy(std::move(l))
+    {}
+
+    template<typename... Ops>
+    auto
+    aggregate(Ops... ops) const
+    {
+        return m_lazy.then(detail::lazy_aggregate<index_defn<Keys...>, Ops...>{ { ops... } });
+    }
+
+private:
+    Lazy m_lazy;
+};
+
+///
+/// Start a lazy pipeline over a frame. See lazy_frame
+///
+template<typename... Ts>
+lazy_frame<frame<Ts...>>
+lazy(const frame<Ts...>& f)
+{
+    return lazy_frame<frame<Ts...>>{ f };
+}
+
+} // namespace mf
+
+#endif // INCLUDED_mainframe_lazy_h
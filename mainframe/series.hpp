@@ -24,7 +24,9 @@
 
 #include "mainframe/detail/base.hpp"
 #include "mainframe/detail/series_vector.hpp"
+#include "mainframe/detail/simd.hpp"
 #include "mainframe/detail/useries.hpp"
+#include "mainframe/detail/window.hpp"
 #include "mainframe/missing.hpp"
 
 namespace mf
@@ -163,6 +165,25 @@ public:
     void
     clear();
 
+    /// Running totals: each value is the sum (product, smallest, largest) of
+    /// the series up to and including it. For a series of mi<T> missing
+    /// values stay missing and are passed over; a NaN makes every result from
+    /// its row on NaN, for all four. float and double series (and
+    /// integer sums, with AVX2) are scanned in SIMD registers, and a long
+    /// series can be scanned on up to num_threads threads (0 means one per
+    /// hardware thread) in two passes
+    series
+    cumsum(size_t num_threads = 1) const;
+
+    series
+    cumprod(size_t num_threads = 1) const;
+
+    series
+    cummin(size_t num_threads = 1) const;
+
+    series
+    cummax(size_t num_threads = 1) const;
+
     // data
     T*
     data();
@@ -170,6 +191,11 @@ public:
     const T*
     data() const;
 
+    /// Each value less the one n before it. The first n values are NaN for a
+    /// floating point series, and missing otherwise
+    series<typename detail::diff_result<T>::type>
+    diff(size_t n = 1) const;
+
     // This requires default-construction. Can we do better?
     template<typename _U = T,
         std::enable_if_t<detail::is_missing<_U>::value &&
@@ -201,6 +227,17 @@ public:
     iterator
     erase(const_iterator first, const_iterator last);
 
+    /// The exponentially weighted mean at each position, with smoothing factor
+    /// alpha, 0 < alpha <= 1, as for mf::function::ewm_mean. A series of
+    /// mi<T> gives mi<double>, missing before the first value
+    series<typename detail::ewm_mean_kernel::template result_type<T>>
+    ewm_mean(double alpha, bool adjust = true) const;
+
+    /// The bias-corrected exponentially weighted variance at each position,
+    /// missing until there are two values, as for mf::function::ewm_var
+    series<mi<double>>
+    ewm_var(double alpha, bool adjust = true) const;
+
     // front & back
     reference
     front();
@@ -231,6 +268,11 @@ public:
     double
     mean() const;
 
+    /// The middle value of the series (the mean of the middle two for an even
+    /// number of values), found by selection rather than sorting
+    double
+    median() const;
+
     /// Calculate the minimum and maximum value in the series, and return them in
     /// a std::pair<>
     ///
@@ -358,6 +400,18 @@ public:
     void
     pop_back();
 
+    /// The fractional change from the value n before: x[i] / x[i - n] - 1.
+    /// The first n values are NaN (missing for a series of mi<T>)
+    series<typename detail::pct_change_result<T>::type>
+    pct_change(size_t n = 1) const;
+
+    /// The q-quantile of the series, 0 <= q <= 1, interpolated linearly
+    /// between the two nearest values. quantile(0.5) is the median. Missing
+    /// values are left out, a series with no values gives NaN, and q outside
+    /// [0, 1] throws std::invalid_argument
+    double
+    quantile(double q) const;
+
     void
     reserve(size_t _size);
 
@@ -393,6 +447,10 @@ public:
     unref();
 
 private:
+    template<typename Op>
+    series
+    scan(Op op, size_t num_threads) const;
+
     iterator
     unref(iterator it);
 
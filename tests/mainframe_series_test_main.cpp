@@ -1401,6 +1401,61 @@ TEST_CASE("stddev", "[series]")
         series<int> s4{ -2, -3, -4 };
         REQUIRE(s4.stddev() == Approx(0.816497));
     }
+
+    SECTION("float")
+    {
+        series<float> s1{ 1, 2, 3, 4, 5, 1, 2, 3, 4, 5, 1, 2, 3, 4, 5 };
+        REQUIRE(s1.stddev() == Approx(1.414213));
+    }
+
+    SECTION("large offset")
+    {
+        // Values far from zero relative to their spread, long enough to go
+        // through the vectorized lanes and the scalar tail
+        series<double> s1;
+        for (int i = 0; i < 1001; ++i) {
+            s1.push_back(1e9 + (i % 4 == 0 ? 4.0 : i % 4 == 1 ? 7.0 : i % 4 == 2 ? 13.0 : 16.0));
+        }
+        series<double> s2;
+        for (double d : s1) {
+            s2.push_back(d - 1e9);
+        }
+        REQUIRE(s1.stddev() == Approx(s2.stddev()));
+        REQUIRE(s2.stddev() == Approx(4.744834));
+    }
+
+    SECTION("merged moments")
+    {
+        series<double> s1{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+        mf::detail::moments a = mf::detail::column_moments(s1.data(), 4);
+        mf::detail::moments b = mf::detail::column_moments(s1.data() + 4, 7);
+        a.merge(b);
+        REQUIRE(a.n == 11.0);
+        REQUIRE(a.mean == Approx(6.0));
+        REQUIRE(a.stddev() == Approx(s1.stddev()));
+        REQUIRE(a.variance() == Approx(10.0));
+    }
+}
+
+TEST_CASE("median quantile", "[series]")
+{
+    series<double> s1{ 5, 1, 4, 2, 3 };
+    REQUIRE(s1.median() == 3.0);
+    REQUIRE(s1.quantile(0.0) == 1.0);
+    REQUIRE(s1.quantile(1.0) == 5.0);
+    REQUIRE(s1.quantile(0.25) == 2.0);
+    REQUIRE(s1.quantile(0.1) == Approx(1.4));
+
+    // Selection works on a copy - the series keeps its order
+    REQUIRE(s1.at(0) == 5.0);
+    REQUIRE(s1.at(1) == 1.0);
+
+    series<int> s2{ 4, 1, 3, 2 };
+    REQUIRE(s2.median() == 2.5);
+
+    series<double> s3;
+    REQUIRE(std::isnan(s3.median()));
+    REQUIRE_THROWS_AS(s1.quantile(-0.1), std::invalid_argument);
 }
 
 struct no_default_ctor
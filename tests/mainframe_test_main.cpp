@@ -5,7 +5,9 @@
 
 #include <iostream>
 #include <map>
+#include <numeric>
 #include <ostream>
+#include <set>
 
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
@@ -24,6 +26,13 @@ using namespace mf::placeholders;
 using mf::function::real;
 using mf::function::imag;
 using mf::function::cmplx;
+using mf::function::ewm_mean;
+using mf::function::ewm_var;
+using mf::function::rolling_max;
+using mf::function::rolling_mean;
+using mf::function::rolling_min;
+using mf::function::rolling_std;
+using mf::function::rolling_sum;
 
 
 namespace std
@@ -3475,6 +3484,1770 @@ TEST_CASE("outerjoin", "[frame]")
     }
 }
 
+TEST_CASE("multi-column join keys", "[frame]")
+{
+    frame<int, char, double> f1;
+    f1.set_column_names("id", "kind", "weight");
+    f1.push_back(1, 'a', 1.5);
+    f1.push_back(1, 'b', 2.5);
+    f1.push_back(2, 'a', 3.5);
+    f1.push_back(2, 'b', 4.5);
+
+    frame<char, int, std::string> f2;
+    f2.set_column_names("kind", "id", "label");
+    f2.push_back('a', 1, "one-a");
+    f2.push_back('b', 2, "two-b");
+    f2.push_back('b', 3, "three-b");
+
+    SECTION("innerjoin")
+    {
+        auto res = innerjoin(f1, (_0, _1), f2, (_1, _0));
+        res.sort(_0, _1);
+        dout << res;
+        REQUIRE(res.size() == 2);
+        auto it = res.cbegin();
+        REQUIRE((it + 0)->at(_0) == 1);
+        REQUIRE((it + 0)->at(_1) == 'a');
+        REQUIRE((it + 0)->at(_5) == "one-a");
+        REQUIRE((it + 1)->at(_0) == 2);
+        REQUIRE((it + 1)->at(_1) == 'b');
+        REQUIRE((it + 1)->at(_5) == "two-b");
+
+        auto res2 = innerjoin(f1, index_defn<0, 1>{}, f2, index_defn<1, 0>{});
+        res2.sort(_0, _1);
+        REQUIRE(res2 == res);
+    }
+
+    SECTION("leftjoin")
+    {
+        auto res = leftjoin(f1, (_1, _0), f2, (_0, _1));
+        res.sort(_0, _1);
+        dout << res;
+        REQUIRE(res.size() == 4);
+        auto it = res.cbegin();
+        REQUIRE((it + 0)->at(_5) == "one-a");
+        REQUIRE((it + 1)->at(_5) == "");
+        REQUIRE((it + 2)->at(_5) == "");
+        REQUIRE((it + 3)->at(_5) == "two-b");
+    }
+
+    SECTION("outerjoin")
+    {
+        auto res = outerjoin(f1, (_0, _1), f2, (_1, _0));
+        dout << res;
+        REQUIRE(res.size() == 5);
+        REQUIRE(res.rows(_5 == "three-b").size() == 1);
+        REQUIRE(res.rows(_5 == "").size() == 2);
+    }
+}
+
+TEST_CASE("semijoin/antijoin", "[frame]")
+{
+    frame<int, char, double> events;
+    events.set_column_names("user", "site", "value");
+    events.push_back(3, 'x', 1.0);
+    events.push_back(1, 'y', 2.0);
+    events.push_back(2, 'x', 3.0);
+    events.push_back(1, 'x', 4.0);
+    events.push_back(3, 'y', 5.0);
+
+    frame<char, int> allow;
+    allow.set_column_names("site", "user");
+    allow.push_back('x', 1);
+    allow.push_back('x', 1);
+    allow.push_back('y', 3);
+    allow.push_back('z', 9);
+
+    SECTION("semijoin")
+    {
+        auto res = semijoin(events, _0, allow, _1);
+        dout << res;
+        REQUIRE(res.size() == 4);
+        REQUIRE(res.column_names() == events.column_names());
+        auto it = res.cbegin();
+        REQUIRE((it + 0)->at(_2) == 1.0);
+        REQUIRE((it + 1)->at(_2) == 2.0);
+        REQUIRE((it + 2)->at(_2) == 4.0);
+        REQUIRE((it + 3)->at(_2) == 5.0);
+
+        auto res2 = semijoin(events, (_0, _1), allow, (_1, _0));
+        dout << res2;
+        REQUIRE(res2.size() == 2);
+        it = res2.cbegin();
+        REQUIRE((it + 0)->at(_2) == 4.0);
+        REQUIRE((it + 1)->at(_2) == 5.0);
+    }
+
+    SECTION("antijoin")
+    {
+        auto res = antijoin(events, _0, allow, _1);
+        dout << res;
+        REQUIRE(res.size() == 1);
+        REQUIRE(res.cbegin()->at(_0) == 2);
+
+        auto res2 = antijoin(events, (_0, _1), allow, (_1, _0));
+        dout << res2;
+        REQUIRE(res2.size() == 3);
+        auto it = res2.cbegin();
+        REQUIRE((it + 0)->at(_2) == 1.0);
+        REQUIRE((it + 1)->at(_2) == 2.0);
+        REQUIRE((it + 2)->at(_2) == 3.0);
+    }
+}
+
+TEST_CASE("asofjoin", "[frame]")
+{
+    frame<int, double> trades;
+    trades.set_column_names("time", "volume");
+    trades.push_back(1, 10.0);
+    trades.push_back(5, 20.0);
+    trades.push_back(6, 30.0);
+    trades.push_back(12, 40.0);
+
+    frame<int, mi<double>> quotes;
+    quotes.set_column_names("qtime", "price");
+    quotes.push_back(2, 100.0);
+    quotes.push_back(5, 101.0);
+    quotes.push_back(7, 102.0);
+
+    SECTION("on")
+    {
+        auto res = asofjoin(trades, _0, quotes, _0);
+        dout << res;
+        REQUIRE(res.size() == 4);
+        REQUIRE(res.column_name(_2) == "qtime");
+        auto it = res.cbegin();
+        REQUIRE((it + 0)->at(_0) == 1);
+        REQUIRE((it + 0)->at(_3) == missing);
+        REQUIRE((it + 1)->at(_2) == 5);
+        REQUIRE((it + 1)->at(_3) == 101.0);
+        REQUIRE((it + 2)->at(_2) == 5);
+        REQUIRE((it + 2)->at(_3) == 101.0);
+        REQUIRE((it + 3)->at(_2) == 7);
+        REQUIRE((it + 3)->at(_3) == 102.0);
+    }
+
+    SECTION("tolerance and exact matches")
+    {
+        asof_options<int> opts;
+        opts.tolerance           = 3;
+        opts.allow_exact_matches = false;
+        auto res                 = asofjoin(trades, _0, quotes, _0, opts);
+        dout << res;
+        REQUIRE(res.size() == 4);
+        auto it = res.cbegin();
+        REQUIRE((it + 0)->at(_3) == missing);
+        REQUIRE((it + 1)->at(_3) == 100.0);
+        REQUIRE((it + 2)->at(_3) == 101.0);
+        REQUIRE((it + 3)->at(_3) == missing);
+    }
+
+    SECTION("unsorted")
+    {
+        auto rtrades = trades.reversed();
+        auto rquotes = quotes.reversed();
+        auto res     = asofjoin(rtrades, _0, rquotes, _0);
+        dout << res;
+        REQUIRE(res.size() == 4);
+        auto it = res.cbegin();
+        REQUIRE((it + 0)->at(_0) == 12);
+        REQUIRE((it + 0)->at(_3) == 102.0);
+        REQUIRE((it + 2)->at(_0) == 5);
+        REQUIRE((it + 2)->at(_3) == 101.0);
+        REQUIRE((it + 3)->at(_0) == 1);
+        REQUIRE((it + 3)->at(_3) == missing);
+    }
+
+    SECTION("by")
+    {
+        frame<int, char, double> t;
+        t.set_column_names("time", "ticker", "volume");
+        t.push_back(1, 'a', 1.0);
+        t.push_back(3, 'b', 2.0);
+        t.push_back(4, 'a', 3.0);
+        t.push_back(9, 'b', 4.0);
+        t.push_back(9, 'c', 5.0);
+
+        frame<int, char, mi<double>> q;
+        q.set_column_names("qtime", "qticker", "price");
+        q.push_back(0, 'a', 10.0);
+        q.push_back(2, 'b', 20.0);
+        q.push_back(3, 'a', 11.0);
+        q.push_back(8, 'a', 12.0);
+
+        for (size_t num_threads : { 1, 4 }) {
+            asof_options<> opts;
+            opts.num_threads = num_threads;
+            auto res         = asofjoin(t, _0, _1, q, _0, _1, opts);
+            dout << res;
+            REQUIRE(res.size() == 5);
+            auto it = res.cbegin();
+            REQUIRE((it + 0)->at(_5) == 10.0);
+            REQUIRE((it + 1)->at(_5) == 20.0);
+            REQUIRE((it + 2)->at(_5) == 11.0);
+            REQUIRE((it + 3)->at(_5) == 20.0);
+            REQUIRE((it + 3)->at(_3) == 2);
+            REQUIRE((it + 4)->at(_5) == missing);
+        }
+    }
+}
+
+TEST_CASE("row hashing", "[frame]")
+{
+    frame<int, int, double, mi<std::string>, int64_t> f;
+    f.push_back(1, 2, 0.0, "a", 7);
+    f.push_back(2, 1, -0.0, "a", 7);
+    f.push_back(3, 3, 1.5, missing, -7);
+    f.push_back(4, 4, 1.5, "b", 9);
+    f.push_back(5, 5, 2.5, "b", 9);
+    f.push_back(6, 6, 2.5, missing, 11);
+
+    SECTION("row and column at a time agree")
+    {
+        auto hashes = mf::detail::hash_columns(f, _0, _1, _2, _3, _4);
+        for (size_t i = 0; i < f.size(); ++i) {
+            REQUIRE(hashes[i] == std::hash<decltype(f.row(i))>{}(f.row(i)));
+        }
+        auto hashes2 = mf::detail::hash_columns(f, _4, _1);
+        for (size_t i = 0; i < f.size(); ++i) {
+            REQUIRE(hashes2[i] == mf::detail::hash_row<4, 1>(f.row(i)));
+        }
+        REQUIRE(mf::detail::hash_columns(f, _2)[0] == mf::detail::hash_columns(f, _2)[1]);
+    }
+
+    SECTION("column order and repeated values")
+    {
+        auto h01 = mf::detail::hash_columns(f, _0, _1);
+        REQUIRE(h01[0] != h01[1]);
+        // equal columns don't cancel each other out
+        REQUIRE(h01[2] != h01[3]);
+        REQUIRE(h01[2] != 0);
+        REQUIRE(h01[3] != 0);
+        auto h1 = mf::detail::hash_columns(f, _1);
+        REQUIRE(h01[0] != h1[0]);
+    }
+}
+
+TEST_CASE("frame_indexer", "[frame]")
+{
+    frame<int, std::string, double> f;
+    for (int i = 0; i < 1000; ++i) {
+        f.push_back(i % 37, std::to_string(i % 3), i * 1.0);
+    }
+
+    frame_indexer<index_defn<0, 1>, int, std::string, double> fi{ f };
+    fi.build_index();
+    REQUIRE(fi.num_groups() == 111);
+    REQUIRE(fi.group_ids().size() == f.size());
+
+    size_t total = 0;
+    for (auto it = fi.begin_index(); it != fi.end_index(); ++it) {
+        size_t prev = 0;
+        bool first  = true;
+        for (auto rit = fi.begin_index_row(it); rit != fi.end_index_row(it); ++rit) {
+            auto row = f.row(*rit);
+            REQUIRE(row.at(_0) == it->first.at(_0));
+            REQUIRE(row.at(_1) == it->first.at(_1));
+            REQUIRE(fi.group_ids()[*rit] == it.group_id());
+            REQUIRE((first || prev < *rit));
+            prev  = *rit;
+            first = false;
+            ++total;
+        }
+    }
+    REQUIRE(total == f.size());
+
+    // groups are numbered in first-seen order
+    auto it = fi.begin_index();
+    REQUIRE(it->first.at(_0) == 0);
+    REQUIRE(it->first.at(_1) == "0");
+    REQUIRE(*fi.begin_index_row(it) == 0);
+
+    frame<int, std::string> keys;
+    keys.push_back(5, "2");
+    keys.push_back(5, "9");
+    auto found = fi.find_index(keys.row(0));
+    REQUIRE(found != fi.end_index());
+    REQUIRE(found->second.size() == 9);
+    REQUIRE(fi.find_index(keys.row(1)) == fi.end_index());
+}
+
+TEST_CASE("group aggregate kernels", "[frame]")
+{
+    // Few groups with many rows each exercises the interleaved accumulators,
+    // many small groups the direct scatter
+    for (int ngroups : { 3, 5000 }) {
+        frame<int, int, double> f;
+        f.set_column_names("key", "ival", "dval");
+        for (int i = 0; i < 20000; ++i) {
+            f.push_back((i * 7) % ngroups, (i % 11) - 5, (i % 13) * 0.25);
+        }
+
+        auto res = f.groupby(_0).aggregate(agg::sum(_1), agg::min(_1), agg::max(_1),
+            agg::mean(_2), agg::stddev(_2), agg::count());
+        REQUIRE(res.size() == static_cast<size_t>(ngroups));
+        REQUIRE(res.column_name(_0) == "key");
+        REQUIRE(res.column_name(_1) == "sum( ival )");
+
+        for (auto row : res) {
+            int key     = row.at(_0);
+            int sum     = 0;
+            int mn      = std::numeric_limits<int>::max();
+            int mx      = std::numeric_limits<int>::lowest();
+            double dsum = 0.0;
+            size_t n    = 0;
+            for (auto frow : f) {
+                if (frow.at(_0) == key) {
+                    sum += frow.at(_1);
+                    mn = std::min(mn, frow.at(_1));
+                    mx = std::max(mx, frow.at(_1));
+                    dsum += frow.at(_2);
+                    ++n;
+                }
+            }
+            double mean = dsum / n;
+            double sq   = 0.0;
+            for (auto frow : f) {
+                if (frow.at(_0) == key) {
+                    sq += (frow.at(_2) - mean) * (frow.at(_2) - mean);
+                }
+            }
+            REQUIRE(row.at(_1) == sum);
+            REQUIRE(row.at(_2) == mn);
+            REQUIRE(row.at(_3) == mx);
+            REQUIRE(row.at(_4) == Approx(mean));
+            REQUIRE(row.at(_5) == Approx(std::sqrt(sq / n)));
+            REQUIRE(row.at(_6) == n);
+            if (ngroups > 100 && key > 20) {
+                break;
+            }
+        }
+    }
+}
+
+TEST_CASE("factorize", "[frame]")
+{
+    frame<int, std::string, bool, double> f;
+    f.set_column_names("num", "name", "flag", "value");
+    f.push_back(30, "c", true, 1.0);
+    f.push_back(-10, "a", false, 2.0);
+    f.push_back(30, "c", true, 3.0);
+    f.push_back(20, "b", true, 4.0);
+    f.push_back(-10, "a", true, 5.0);
+
+    SECTION("direct-indexed column")
+    {
+        auto fz = f.factorize(_0);
+        REQUIRE(fz.codes == std::vector<uint32_t>{ 0, 1, 0, 2, 1 });
+        REQUIRE(fz.uniques.size() == 3);
+        REQUIRE(fz.uniques.column_name(_0) == "num");
+        REQUIRE(fz.uniques.row(0).at(_0) == 30);
+        REQUIRE(fz.uniques.row(1).at(_0) == -10);
+        REQUIRE(fz.uniques.row(2).at(_0) == 20);
+
+        auto fzb = f.factorize(_2);
+        REQUIRE(fzb.codes == std::vector<uint32_t>{ 0, 1, 0, 0, 0 });
+        REQUIRE(fzb.uniques.row(1).at(_0) == false);
+
+        auto fzs = f.factorize_sorted(_0);
+        REQUIRE(fzs.codes == std::vector<uint32_t>{ 2, 0, 2, 1, 0 });
+        REQUIRE(fzs.uniques.row(0).at(_0) == -10);
+        REQUIRE(fzs.uniques.row(2).at(_0) == 30);
+    }
+
+    SECTION("hashed columns")
+    {
+        frame<int64_t> wide;
+        wide.push_back(1);
+        wide.push_back(int64_t{ 1 } << 40);
+        wide.push_back(1);
+        auto fzw = wide.factorize(_0);
+        REQUIRE(fzw.codes == std::vector<uint32_t>{ 0, 1, 0 });
+
+        auto fz = f.factorize(_1, _2);
+        REQUIRE(fz.codes == std::vector<uint32_t>{ 0, 1, 0, 2, 3 });
+        REQUIRE(fz.uniques.size() == 4);
+        REQUIRE(fz.uniques.column_name(_1) == "flag");
+        for (size_t i = 0; i < f.size(); ++i) {
+            REQUIRE(fz.uniques.row(fz.codes[i]).at(_0) == f.row(i).at(_1));
+            REQUIRE(fz.uniques.row(fz.codes[i]).at(_1) == f.row(i).at(_2));
+        }
+
+        auto fzs = f.factorize_sorted(_1, _2);
+        REQUIRE(fzs.codes == std::vector<uint32_t>{ 3, 0, 3, 2, 1 });
+        REQUIRE(fzs.uniques.row(0).at(_0) == "a");
+        REQUIRE(fzs.uniques.row(0).at(_1) == false);
+    }
+}
+
+TEST_CASE("parallel groupby", "[frame]")
+{
+    frame<int, char, int, double> f;
+    f.set_column_names("a", "b", "ival", "dval");
+    for (int i = 0; i < 100000; ++i) {
+        f.push_back((i * 13) % 97, static_cast<char>('a' + i % 3), i % 7, (i % 101) * 0.5);
+    }
+
+    auto seq = f.groupby(_0, _1).aggregate(aggregate_options{ 1, true }, agg::sum(_2),
+        agg::min(_3), agg::max(_3), agg::mean(_3), agg::stddev(_3), agg::count());
+    auto par = f.groupby(_0, _1).aggregate(aggregate_options{ 4, true }, agg::sum(_2),
+        agg::min(_3), agg::max(_3), agg::mean(_3), agg::stddev(_3), agg::count());
+    REQUIRE(seq.size() == 291);
+    REQUIRE(par.size() == seq.size());
+    REQUIRE(par.column_names() == seq.column_names());
+    for (size_t i = 0; i < seq.size(); ++i) {
+        auto srow = seq.row(i);
+        auto prow = par.row(i);
+        REQUIRE(prow.at(_0) == srow.at(_0));
+        REQUIRE(prow.at(_1) == srow.at(_1));
+        REQUIRE(prow.at(_2) == srow.at(_2));
+        REQUIRE(prow.at(_3) == srow.at(_3));
+        REQUIRE(prow.at(_4) == srow.at(_4));
+        REQUIRE(prow.at(_5) == Approx(srow.at(_5)));
+        REQUIRE(prow.at(_6) == Approx(srow.at(_6)));
+        REQUIRE(prow.at(_7) == srow.at(_7));
+    }
+    REQUIRE(seq.row(0).at(_0) == 0);
+    REQUIRE(seq.row(0).at(_1) == 'a');
+
+    // Without sorting, groups come out in first-seen order either way
+    auto seq2 = f.groupby(_0).aggregate(agg::count());
+    auto par2 = f.groupby(_0).aggregate(aggregate_options{ 3 }, agg::count());
+    REQUIRE(seq2 == par2);
+}
+
+TEST_CASE("sorted groupby", "[frame]")
+{
+    frame<int, char, int, double> f;
+    f.set_column_names("a", "b", "ival", "dval");
+    for (int i = 0; i < 1000; ++i) {
+        f.push_back(i / 100, static_cast<char>('a' + (i / 10) % 3), i % 7, (i % 11) * 0.5);
+    }
+    frame<int, char, int, double> shuffled;
+    shuffled.set_column_names("a", "b", "ival", "dval");
+    for (int i = 0; i < 1000; ++i) {
+        auto r = f.row(static_cast<size_t>((i * 37) % 1000));
+        shuffled.push_back(r.at(_0), r.at(_1), r.at(_2), r.at(_3));
+    }
+
+    // Sorted keys go through the run path, shuffled ones through the hash
+    // table; both have to agree once sorted
+    auto runs = f.groupby(_0).aggregate(agg::sum(_2), agg::min(_3), agg::max(_3),
+        agg::mean(_3), agg::stddev(_3), agg::count());
+    auto hashed = shuffled.groupby(_0).aggregate(aggregate_options{ 1, true }, agg::sum(_2),
+        agg::min(_3), agg::max(_3), agg::mean(_3), agg::stddev(_3), agg::count());
+    REQUIRE(runs.size() == 10);
+    REQUIRE(hashed.size() == 10);
+    REQUIRE(runs.column_names() == hashed.column_names());
+    for (size_t i = 0; i < runs.size(); ++i) {
+        auto rrow = runs.row(i);
+        auto hrow = hashed.row(i);
+        REQUIRE(rrow.at(_0) == static_cast<int>(i));
+        REQUIRE(rrow.at(_0) == hrow.at(_0));
+        REQUIRE(rrow.at(_1) == hrow.at(_1));
+        REQUIRE(rrow.at(_2) == hrow.at(_2));
+        REQUIRE(rrow.at(_3) == hrow.at(_3));
+        REQUIRE(rrow.at(_4) == Approx(hrow.at(_4)));
+        REQUIRE(rrow.at(_5) == Approx(hrow.at(_5)));
+        REQUIRE(rrow.at(_6) == 100);
+    }
+
+    // Descending keys keep their order
+    frame<int, int> desc;
+    desc.push_back(3, 1);
+    desc.push_back(3, 2);
+    desc.push_back(2, 5);
+    desc.push_back(1, 7);
+    desc.push_back(1, 1);
+    auto dres = desc.groupby(_0).aggregate(agg::sum(_1));
+    REQUIRE(dres.size() == 3);
+    REQUIRE(dres.row(0).at(_0) == 3);
+    REQUIRE(dres.row(0).at(_1) == 3);
+    REQUIRE(dres.row(1).at(_0) == 2);
+    REQUIRE(dres.row(1).at(_1) == 5);
+    REQUIRE(dres.row(2).at(_0) == 1);
+    REQUIRE(dres.row(2).at(_1) == 8);
+
+    // Contiguous but unsorted keys only form runs with the hint
+    frame<int, int> contig;
+    contig.push_back(5, 1);
+    contig.push_back(5, 1);
+    contig.push_back(1, 2);
+    contig.push_back(9, 3);
+    contig.push_back(9, 3);
+    auto cres = contig.groupby(_0).aggregate(aggregate_options{ 1, false, true }, agg::count());
+    REQUIRE(cres.size() == 3);
+    REQUIRE(cres.row(0).at(_0) == 5);
+    REQUIRE(cres.row(0).at(_1) == 2);
+    REQUIRE(cres.row(1).at(_0) == 1);
+    REQUIRE(cres.row(2).at(_0) == 9);
+    REQUIRE(cres == contig.groupby(_0).aggregate(agg::count()));
+
+    // Sorted on the first column but not the second falls back to hashing
+    auto two = f.groupby(_0, _1).aggregate(agg::count());
+    REQUIRE(two.size() == 30);
+    REQUIRE(two.row(0).at(_0) == 0);
+    REQUIRE(two.row(0).at(_1) == 'a');
+    REQUIRE(two.row(0).at(_2) == 40);
+}
+
+TEST_CASE("group median and quantile", "[frame]")
+{
+    frame<int, double> f;
+    f.set_column_names("endpoint", "latency");
+    for (int i = 0; i < 1000; ++i) {
+        // Endpoint k gets latencies k, k + 1, ... k + 99 in a scrambled order
+        int k = i % 10;
+        f.push_back(k, static_cast<double>(k + (i / 10 * 37) % 100));
+    }
+
+    auto res = f.groupby(_0).aggregate(
+        agg::median(_1), agg::quantile(_1, 0.99), agg::quantile(_1, 0.0), agg::count());
+    REQUIRE(res.size() == 10);
+    REQUIRE(res.column_name(_1) == "median( latency )");
+    REQUIRE(res.column_name(_2) == "p99( latency )");
+    REQUIRE(res.column_name(_3) == "p0( latency )");
+    for (auto row : res) {
+        int k = row.at(_0);
+        REQUIRE(row.at(_1) == Approx(k + 49.5));
+        REQUIRE(row.at(_2) == Approx(k + 98.01));
+        REQUIRE(row.at(_3) == k);
+        REQUIRE(row.at(_4) == 100);
+    }
+
+    // The same through the run path, and with threads asked for
+    auto sorted = f.sorted(_0);
+    auto runs   = sorted.groupby(_0).aggregate(agg::median(_1), agg::quantile(_1, 0.99));
+    auto par    = f.groupby(_0).aggregate(
+        aggregate_options{ 4, true }, agg::median(_1), agg::quantile(_1, 0.99));
+    REQUIRE(runs.size() == 10);
+    REQUIRE(par.size() == 10);
+    for (size_t i = 0; i < runs.size(); ++i) {
+        REQUIRE(runs.row(i).at(_0) == static_cast<int>(i));
+        REQUIRE(runs.row(i).at(_1) == Approx(i + 49.5));
+        REQUIRE(runs.row(i).at(_2) == Approx(i + 98.01));
+        REQUIRE(par.row(i).at(_1) == runs.row(i).at(_1));
+        REQUIRE(par.row(i).at(_2) == runs.row(i).at(_2));
+    }
+
+    REQUIRE(f.median(_1) == Approx(54.0));
+    REQUIRE(f.quantile(_1, 1.0) == 108.0);
+
+    // Missing values are left out
+    series<mi<int>> gappy;
+    gappy.push_back(missing);
+    REQUIRE(std::isnan(gappy.median()));
+    gappy.push_back(4);
+    gappy.push_back(missing);
+    gappy.push_back(1);
+    REQUIRE(gappy.median() == 2.5);
+    REQUIRE(gappy.quantile(1.0) == 4.0);
+    REQUIRE_THROWS_AS(agg::quantile(_1, 1.5), std::invalid_argument);
+
+    // Quantiles of integers are doubles, on every path
+    frame<int, int, mi<int>> ints;
+    ints.set_column_names("key", "n", "gappy");
+    for (int i = 0; i < 8; ++i) {
+        ints.push_back(i % 2, i, i == 5 ? mi<int>{} : mi<int>{ i });
+    }
+    auto iq = ints.groupby(_0).aggregate(
+        agg::median(_1), agg::quantile(_1, 0.25), agg::median(_2), agg::approx_quantile(_1, 0.5));
+    static_assert(std::is_same_v<decltype(iq), frame<int, double, double, mi<double>, double>>);
+    REQUIRE(iq.row(0).at(_1) == 3.0);
+    REQUIRE(iq.row(0).at(_2) == 1.5);
+    REQUIRE(iq.row(1).at(_1) == 4.0);
+    REQUIRE(iq.row(0).at(_3) == 3.0);
+    REQUIRE(iq.row(1).at(_3) == 3.0);
+    REQUIRE(iq.row(0).at(_4) == Approx(3.0).margin(1.0));
+    auto irun = ints.sorted(_0).groupby(_0).aggregate(agg::median(_1), agg::median(_2));
+    REQUIRE(irun.row(0).at(_1) == 3.0);
+    REQUIRE(irun.row(1).at(_2) == 3.0);
+    auto itr = ints.groupby(_0).transform(agg::quantile(_1, 0.25));
+    REQUIRE(itr[1] == 2.5);
+}
+
+TEST_CASE("approximate aggregates", "[frame]")
+{
+    frame<int, double, int> f;
+    f.set_column_names("endpoint", "latency", "user");
+    for (int i = 0; i < 200000; ++i) {
+        // Endpoint 0 sees 1000 distinct users, endpoint 1 sees 50000
+        int k = i % 2;
+        int user = (i / 2) % (k == 0 ? 1000 : 50000);
+        f.push_back(k, static_cast<double>((i / 2 * 7919) % 10000), user);
+    }
+
+    auto res = f.groupby(_0).aggregate(agg::approx_quantile(_1, 0.5),
+        agg::approx_quantile(_1, 0.99), agg::approx_count_distinct(_2), agg::count());
+    REQUIRE(res.size() == 2);
+    REQUIRE(res.column_name(_1) == "approx_p50( latency )");
+    REQUIRE(res.column_name(_2) == "approx_p99( latency )");
+    REQUIRE(res.column_name(_3) == "approx_count_distinct( user )");
+    for (auto row : res) {
+        // Latencies are close to uniform over 0 .. 9999
+        REQUIRE(row.at(_1) == Approx(5000.0).margin(100.0));
+        REQUIRE(row.at(_2) == Approx(9900.0).margin(50.0));
+        REQUIRE(row.at(_4) == 100000);
+    }
+    REQUIRE(res.row(0).at(_3) == Approx(1000).epsilon(0.05));
+    REQUIRE(res.row(1).at(_3) == Approx(50000).epsilon(0.05));
+
+    // Merged per-thread sketches and the run path give about the same answers
+    auto par = f.groupby(_0).aggregate(aggregate_options{ 4, true },
+        agg::approx_quantile(_1, 0.99), agg::approx_count_distinct(_2));
+    auto runs = f.sorted(_0).groupby(_0).aggregate(
+        agg::approx_quantile(_1, 0.99), agg::approx_count_distinct(_2));
+    for (size_t i = 0; i < 2; ++i) {
+        REQUIRE(par.row(i).at(_1) == Approx(res.row(i).at(_2)).margin(50.0));
+        REQUIRE(runs.row(i).at(_1) == Approx(res.row(i).at(_2)).margin(50.0));
+        REQUIRE(par.row(i).at(_2) == Approx(res.row(i).at(_3)).epsilon(0.02));
+        REQUIRE(runs.row(i).at(_2) == res.row(i).at(_3));
+    }
+
+    // The digest stays small however much goes in
+    mf::detail::tdigest td;
+    for (int i = 0; i < 100000; ++i) {
+        td.add(static_cast<double>(i));
+    }
+    td.compress();
+    REQUIRE(td.num_centroids() <= 100);
+    REQUIRE(td.quantile(0.0) == 0.0);
+    REQUIRE(td.quantile(1.0) == 99999.0);
+    REQUIRE(td.quantile(0.001) == Approx(100.0).margin(5.0));
+}
+
+TEST_CASE("first last argmin argmax count_distinct", "[frame]")
+{
+    frame<int, int, double> f;
+    f.set_column_names("key", "user", "price");
+    for (int i = 0; i < 60000; ++i) {
+        int k = (i * 7) % 3;
+        f.push_back(k, (i / 3) % (10 * (k + 1)), static_cast<double>((i * 7919) % 1000));
+    }
+
+    auto check = [&](const auto& res) {
+        REQUIRE(res.size() == 3);
+        for (auto row : res) {
+            int key       = row.at(_0);
+            size_t first  = std::numeric_limits<size_t>::max();
+            size_t last   = 0;
+            size_t argmin = 0;
+            size_t argmax = 0;
+            std::set<int> users;
+            for (size_t i = 0; i < f.size(); ++i) {
+                auto frow = f.row(i);
+                if (frow.at(_0) != key) {
+                    continue;
+                }
+                if (first == std::numeric_limits<size_t>::max()) {
+                    first  = i;
+                    argmin = i;
+                    argmax = i;
+                }
+                last = i;
+                if (frow.at(_2) < f.row(argmin).at(_2)) {
+                    argmin = i;
+                }
+                if (frow.at(_2) > f.row(argmax).at(_2)) {
+                    argmax = i;
+                }
+                users.insert(frow.at(_1));
+            }
+            REQUIRE(row.at(_1) == f.row(first).at(_2));
+            REQUIRE(row.at(_2) == f.row(last).at(_2));
+            REQUIRE(row.at(_3) == argmin);
+            REQUIRE(row.at(_4) == argmax);
+            REQUIRE(row.at(_5) == users.size());
+        }
+    };
+
+    auto res = f.groupby(_0).aggregate(agg::first(_2), agg::last(_2), agg::argmin(_2),
+        agg::argmax(_2), agg::count_distinct(_1));
+    REQUIRE(res.column_name(_1) == "first( price )");
+    REQUIRE(res.column_name(_4) == "argmax( price )");
+    REQUIRE(res.column_name(_5) == "count_distinct( user )");
+    check(res);
+
+    // Without count_distinct this can go multi-threaded
+    auto par = f.groupby(_0).aggregate(aggregate_options{ 3 }, agg::first(_2), agg::last(_2),
+        agg::argmin(_2), agg::argmax(_2));
+    for (size_t i = 0; i < 3; ++i) {
+        REQUIRE(par.row(i).at(_0) == res.row(i).at(_0));
+        REQUIRE(par.row(i).at(_1) == res.row(i).at(_1));
+        REQUIRE(par.row(i).at(_2) == res.row(i).at(_2));
+        REQUIRE(par.row(i).at(_3) == res.row(i).at(_3));
+        REQUIRE(par.row(i).at(_4) == res.row(i).at(_4));
+    }
+
+    // Sorted by key (stably), the runs give the same values; row numbers are
+    // into the sorted frame
+    frame<int, int, double> sorted;
+    sorted.set_column_names("key", "user", "price");
+    for (int k = 0; k < 3; ++k) {
+        for (auto row : f) {
+            if (row.at(_0) == k) {
+                sorted.push_back(row.at(_0), row.at(_1), row.at(_2));
+            }
+        }
+    }
+    auto runs = sorted.groupby(_0).aggregate(agg::first(_2), agg::last(_2), agg::argmin(_2),
+        agg::argmax(_2), agg::count_distinct(_1));
+    for (size_t i = 0; i < 3; ++i) {
+        auto hres = res.rows(_0 == static_cast<int>(i));
+        auto hrow = hres.row(0);
+        REQUIRE(runs.row(i).at(_1) == hrow.at(_1));
+        REQUIRE(runs.row(i).at(_2) == hrow.at(_2));
+        REQUIRE(sorted.row(runs.row(i).at(_3)).at(_2) == f.row(hrow.at(_3)).at(_2));
+        REQUIRE(runs.row(i).at(_5) == hrow.at(_5));
+    }
+}
+
+TEST_CASE("missing-aware aggregation", "[frame]")
+{
+    // Every third row's value is missing, and all of group 3's are
+    frame<int, mi<double>> f;
+    f.set_column_names("key", "value");
+    for (int i = 0; i < 40000; ++i) {
+        int k = i % 4;
+        if (k == 3 || i % 3 == 0) {
+            f.push_back(k, missing);
+        }
+        else {
+            f.push_back(k, static_cast<double>((i * 7919) % 1000));
+        }
+    }
+
+    struct expected
+    {
+        double sum{ 0.0 };
+        double min{ std::numeric_limits<double>::max() };
+        double max{ std::numeric_limits<double>::lowest() };
+        size_t present{ 0 };
+        size_t rows{ 0 };
+        size_t first{ 0 };
+        size_t argmin{ 0 };
+    };
+    std::vector<expected> ex(4);
+    for (size_t i = 0; i < f.size(); ++i) {
+        auto row = f.row(i);
+        auto& e  = ex[static_cast<size_t>(row.at(_0))];
+        e.rows++;
+        if (!row.at(_1).has_value()) {
+            continue;
+        }
+        double v = *row.at(_1);
+        if (e.present == 0) {
+            e.first = i;
+        }
+        if (e.present == 0 || v < e.min) {
+            e.argmin = i;
+        }
+        e.present++;
+        e.sum += v;
+        e.min = std::min(e.min, v);
+        e.max = std::max(e.max, v);
+    }
+
+    auto check = [&](const auto& res) {
+        REQUIRE(res.size() == 4);
+        for (auto row : res) {
+            const auto& e = ex[static_cast<size_t>(row.at(_0))];
+            REQUIRE(row.at(_5) == e.present);
+            REQUIRE(row.at(_6) == e.rows);
+            if (e.present == 0) {
+                REQUIRE(row.at(_1) == missing);
+                REQUIRE(row.at(_2) == missing);
+                REQUIRE(row.at(_3) == missing);
+                REQUIRE(row.at(_4) == missing);
+                REQUIRE(row.at(_7) == missing);
+                REQUIRE(row.at(_8) == missing);
+                continue;
+            }
+            REQUIRE(row.at(_1) == e.sum);
+            REQUIRE(row.at(_2) == e.sum / static_cast<double>(e.present));
+            REQUIRE(row.at(_3) == e.min);
+            REQUIRE(row.at(_4) == e.max);
+            REQUIRE(row.at(_7) == *f.row(e.first).at(_1));
+            REQUIRE(row.at(_8) == e.argmin);
+        }
+    };
+
+    auto res = f.groupby(_0).aggregate(agg::sum(_1), agg::mean(_1), agg::min(_1), agg::max(_1),
+        agg::count(_1), agg::count(), agg::first(_1), agg::argmin(_1));
+    REQUIRE(res.column_name(_5) == "count( value )");
+    check(res);
+
+    auto par = f.groupby(_0).aggregate(aggregate_options{ 3 }, agg::sum(_1), agg::mean(_1),
+        agg::min(_1), agg::max(_1), agg::count(_1), agg::count(), agg::first(_1),
+        agg::argmin(_1));
+    check(par);
+
+    auto med = f.groupby(_0).aggregate(agg::median(_1), agg::count_distinct(_1));
+    REQUIRE(med.row(3).at(_1) == missing);
+    REQUIRE(med.row(3).at(_2) == 0);
+    REQUIRE(med.row(0).at(_1).has_value());
+    REQUIRE(med.row(0).at(_2) <= 1000);
+
+    // Runs of sorted keys come out the same
+    frame<int, mi<double>> sorted;
+    for (int k = 0; k < 4; ++k) {
+        for (auto row : f) {
+            if (row.at(_0) == k) {
+                sorted.push_back(row.at(_0), row.at(_1));
+            }
+        }
+    }
+    auto runs = sorted.groupby(_0).aggregate(agg::sum(_1), agg::mean(_1), agg::count(_1),
+        agg::median(_1));
+    for (size_t i = 0; i < 4; ++i) {
+        REQUIRE(runs.row(i).at(_1) == res.row(i).at(_1));
+        REQUIRE(runs.row(i).at(_2) == res.row(i).at(_2));
+        REQUIRE(runs.row(i).at(_3) == res.row(i).at(_5));
+        REQUIRE(runs.row(i).at(_4) == med.row(i).at(_1));
+    }
+}
+
+TEST_CASE("incremental aggregate", "[frame]")
+{
+    frame<int, int, double> f;
+    f.set_column_names("key", "user", "price");
+    for (int i = 0; i < 30000; ++i) {
+        // New keys keep turning up as the frame grows
+        int k = (i * 7) % (10 + i / 1000);
+        f.push_back(k, i % 13, static_cast<double>((i * 7919) % 1000));
+    }
+    auto full = f.groupby(_0).aggregate(agg::sum(_2), agg::min(_2), agg::max(_2), agg::first(_2),
+        agg::last(_2), agg::argmax(_2), agg::count(), agg::mean(_2));
+
+    frame<int, int, double> seed;
+    frame<int, int, double> batch;
+    for (size_t i = 0; i < 25000; ++i) {
+        auto row = f.row(i);
+        (i < 10000 ? seed : batch).push_back(row.at(_0), row.at(_1), row.at(_2));
+    }
+    seed.set_column_names("key", "user", "price");
+    auto inc = seed.groupby(_0).incremental(agg::sum(_2), agg::min(_2), agg::max(_2),
+        agg::first(_2), agg::last(_2), agg::argmax(_2), agg::count(), agg::mean(_2));
+    REQUIRE(inc.num_rows() == 10000);
+
+    inc.append(batch);
+    for (size_t i = 25000; i < f.size(); ++i) {
+        auto row = f.row(i);
+        inc.push_back(row.at(_0), row.at(_1), row.at(_2));
+    }
+    REQUIRE(inc.num_rows() == f.size());
+
+    auto res = inc.result();
+    REQUIRE(res.size() == full.size());
+    REQUIRE(res.column_name(_0) == "key");
+    REQUIRE(res.column_name(_1) == "sum( price )");
+    REQUIRE(res.column_name(_7) == "count(*)");
+    for (size_t i = 0; i < full.size(); ++i) {
+        auto r = res.row(i);
+        auto e = full.row(i);
+        REQUIRE(r.at(_0) == e.at(_0));
+        REQUIRE(r.at(_1) == e.at(_1));
+        REQUIRE(r.at(_2) == e.at(_2));
+        REQUIRE(r.at(_3) == e.at(_3));
+        REQUIRE(r.at(_4) == e.at(_4));
+        REQUIRE(r.at(_5) == e.at(_5));
+        REQUIRE(r.at(_6) == e.at(_6));
+        REQUIRE(r.at(_7) == e.at(_7));
+        REQUIRE(r.at(_8) == Approx(e.at(_8)));
+    }
+
+    // The result can be taken at any point, and more rows folded in after
+    inc.push_back(999, 0, 5.0);
+    auto more = inc.result();
+    REQUIRE(more.size() == full.size() + 1);
+    auto last = more.row(more.size() - 1);
+    REQUIRE(last.at(_0) == 999);
+    REQUIRE(last.at(_1) == 5.0);
+    REQUIRE(last.at(_6) == f.size());
+}
+
+TEST_CASE("group views", "[frame]")
+{
+    frame<int, std::string, double> f;
+    f.set_column_names("id", "name", "price");
+    for (int i = 0; i < 5000; ++i) {
+        f.push_back(i % 17, std::to_string(i % 3), static_cast<double>(i));
+    }
+    auto grp = f.groupby(_0, _1);
+
+    size_t total = 0;
+    size_t ngroups = 0;
+    for (auto g : grp.groups()) {
+        REQUIRE(!g.empty());
+        size_t prev = 0;
+        for (auto row : g) {
+            REQUIRE(row.at(_0) == g.key().at(_0));
+            REQUIRE(row.at(_1) == g.key().at(_1));
+            size_t rownum = static_cast<size_t>(row.at(_2));
+            REQUIRE((total == 0 || prev < rownum));
+            prev = rownum;
+            ++total;
+        }
+        ++ngroups;
+    }
+    REQUIRE(total == f.size());
+    REQUIRE(ngroups == grp.groups().size());
+    REQUIRE(ngroups == 51);
+
+    auto g = grp.get_group(5, "2");
+    REQUIRE(g.key().at(_0) == 5);
+    REQUIRE(g.key().at(_1) == "2");
+    double sum = 0.0;
+    for (int i = 0; i < 5000; ++i) {
+        if (i % 17 == 5 && i % 3 == 2) {
+            sum += i;
+        }
+    }
+    auto prices = g.column(_2);
+    REQUIRE(prices.name() == "price");
+    REQUIRE(prices.size() == g.size());
+    REQUIRE(std::accumulate(prices.begin(), prices.end(), 0.0) == sum);
+    REQUIRE(g.row(0).at(_2) == *g.row_numbers().begin());
+
+    auto gf = g.to_frame();
+    REQUIRE(gf.size() == g.size());
+    REQUIRE(gf.column_name(_2) == "price");
+    REQUIRE(gf.row(1).at(_2) == g.row(1).at(_2));
+
+    REQUIRE_THROWS_AS(grp.get_group(5, "7"), std::out_of_range);
+}
+
+TEST_CASE("group transform", "[frame]")
+{
+    frame<int, double> f;
+    f.set_column_names("key", "price");
+    for (int i = 0; i < 20000; ++i) {
+        f.push_back((i * 7) % 101, static_cast<double>((i * 7919) % 1000));
+    }
+    auto grp   = f.groupby(_0);
+    auto means = grp.transform(agg::mean(_1));
+    auto sizes = grp.transform(agg::count());
+    auto maxes = grp.transform(agg::max(_1));
+    REQUIRE(means.name() == "mean( price )");
+    REQUIRE(sizes.name() == "count(*)");
+    REQUIRE(means.size() == f.size());
+
+    auto res = grp.aggregate(agg::mean(_1), agg::count(), agg::max(_1));
+    std::map<int, size_t> resrow;
+    for (size_t i = 0; i < res.size(); ++i) {
+        resrow[res.row(i).at(_0)] = i;
+    }
+    for (size_t i = 0; i < f.size(); ++i) {
+        auto r = res.row(resrow[f.row(i).at(_0)]);
+        REQUIRE(means[i] == r.at(_1));
+        REQUIRE(sizes[i] == r.at(_2));
+        REQUIRE(maxes[i] == r.at(_3));
+    }
+
+    // Normalizing by the group mean
+    auto f2 = f.append_series(means);
+    REQUIRE(f2.column_name(_2) == "mean( price )");
+    REQUIRE(f2.row(10).at(_2) == means[10]);
+}
+
+TEST_CASE("group window functions", "[frame]")
+{
+    frame<int, double> f;
+    f.set_column_names("key", "price");
+    for (int i = 0; i < 3000; ++i) {
+        f.push_back((i * 7) % 5, static_cast<double>((i * 7919) % 97));
+    }
+
+    // Every row's group, in row order
+    std::map<int, std::vector<double>> parts;
+    std::vector<size_t> pos(f.size());
+    for (size_t i = 0; i < f.size(); ++i) {
+        auto& p = parts[f.row(i).at(_0)];
+        pos[i]  = p.size();
+        p.push_back(f.row(i).at(_1));
+    }
+
+    auto check = [&](const frame<int, double>& fr, const std::vector<size_t>& ps,
+                     const std::map<int, std::vector<double>>& pts) {
+        auto grp    = fr.groupby(_0);
+        auto rownum = grp.window(win::row_number());
+        auto rank   = grp.window(win::rank(_1));
+        auto drank  = grp.window(win::dense_rank(_1));
+        auto lag    = grp.window(win::lag(_1));
+        auto lead2  = grp.window(win::lead(_1, 2));
+        auto csum   = grp.window(win::cumsum(_1));
+        auto cmax   = grp.window(win::cummax(_1));
+        auto rsum   = grp.window(win::rolling_sum(_1, 4));
+        auto rmean  = grp.window(win::rolling_mean(_1, 4));
+        auto rmin   = grp.window(win::rolling_min(_1, 4));
+        auto rmax   = grp.window(win::rolling_max(_1, 4));
+        auto rstd   = grp.window(win::rolling_std(_1, 4));
+        REQUIRE(rownum.name() == "row_number");
+        REQUIRE(lag.name() == "lag( price )");
+        REQUIRE(rmax.name() == "rolling_max( price )");
+
+        for (size_t i = 0; i < fr.size(); ++i) {
+            const auto& p = pts.at(fr.row(i).at(_0));
+            const size_t k = ps[i];
+            const double v = p[k];
+            REQUIRE(rownum[i] == k + 1);
+
+            size_t smaller = 0;
+            std::set<double> distinct;
+            for (double x : p) {
+                smaller += x < v ? 1 : 0;
+                if (x < v) {
+                    distinct.insert(x);
+                }
+            }
+            REQUIRE(rank[i] == smaller + 1);
+            REQUIRE(drank[i] == distinct.size() + 1);
+
+            REQUIRE(lag[i] == (k >= 1 ? mi<double>{ p[k - 1] } : mi<double>{}));
+            REQUIRE(lead2[i] == (k + 2 < p.size() ? mi<double>{ p[k + 2] } : mi<double>{}));
+
+            double sum = 0.0;
+            double mx  = p[0];
+            for (size_t j = 0; j <= k; ++j) {
+                sum += p[j];
+                mx = std::max(mx, p[j]);
+            }
+            REQUIRE(csum[i] == sum);
+            REQUIRE(cmax[i] == mx);
+
+            const size_t from = k >= 3 ? k - 3 : 0;
+            double wsum       = 0.0;
+            double wmin       = p[from];
+            double wmax       = p[from];
+            for (size_t j = from; j <= k; ++j) {
+                wsum += p[j];
+                wmin = std::min(wmin, p[j]);
+                wmax = std::max(wmax, p[j]);
+            }
+            REQUIRE(rsum[i] == wsum);
+            REQUIRE(rmean[i] == Approx(wsum / static_cast<double>(k - from + 1)));
+            REQUIRE(rmin[i] == wmin);
+            REQUIRE(rmax[i] == wmax);
+
+            const double wmean = wsum / static_cast<double>(k - from + 1);
+            double ss          = 0.0;
+            for (size_t j = from; j <= k; ++j) {
+                ss += (p[j] - wmean) * (p[j] - wmean);
+            }
+            REQUIRE(rstd[i] == Approx(std::sqrt(ss / static_cast<double>(k - from + 1))).margin(1e-9));
+        }
+    };
+    check(f, pos, parts);
+
+    // With the groups in contiguous runs the kernels work in place
+    frame<int, double> sorted;
+    sorted.set_column_names("key", "price");
+    std::vector<size_t> spos;
+    for (const auto& [key, p] : parts) {
+        for (size_t k = 0; k < p.size(); ++k) {
+            sorted.push_back(key, p[k]);
+            spos.push_back(k);
+        }
+    }
+    check(sorted, spos, parts);
+
+    // The mean and standard deviation of integers are doubles
+    frame<int, int> ints;
+    ints.set_column_names("key", "n");
+    for (int i = 0; i < 6; ++i) {
+        ints.push_back(0, i);
+    }
+    auto imean = ints.groupby(_0).window(win::rolling_mean(_1, 2));
+    auto istd  = ints.groupby(_0).window(win::rolling_std(_1, 2));
+    REQUIRE(imean[0] == 0.0);
+    REQUIRE(imean[1] == 0.5);
+    REQUIRE(imean[2] == 1.5);
+    REQUIRE(imean[5] == 4.5);
+    REQUIRE(istd[0] == 0.0);
+    REQUIRE(istd[3] == 0.5);
+
+    // And of mi<int>, mi<double>
+    frame<int, mi<int>> gappy;
+    gappy.set_column_names("key", "n");
+    for (mi<int> v : { mi<int>{ 1 }, mi<int>{}, mi<int>{ 4 }, mi<int>{ 3 }, mi<int>{ 8 },
+             mi<int>{ 6 } }) {
+        gappy.push_back(0, v);
+    }
+    auto gmean = gappy.groupby(_0).window(win::rolling_mean(_1, 2));
+    auto gstd  = gappy.groupby(_0).window(win::rolling_std(_1, 2));
+    auto emean = gappy.make_series<mi<double>>("m", rolling_mean(_1, 2));
+    static_assert(std::is_same_v<decltype(gmean), series<mi<double>>>);
+    REQUIRE(gmean[1] == missing);
+    REQUIRE(gmean[3] == 3.5);
+    REQUIRE(gmean[4] == 5.5);
+    REQUIRE(gmean[5] == 7.0);
+    REQUIRE(gstd[3] == 0.5);
+    REQUIRE(gstd[4] == 2.5);
+    REQUIRE(emean[3] == 3.5);
+    REQUIRE(emean[4] == 5.5);
+
+    // Running totals pass over missing values, as series::cumsum() does
+    auto gsum = gappy.groupby(_0).window(win::cumsum(_1));
+    auto gmin = gappy.groupby(_0).window(win::cummin(_1));
+    auto scum = gappy.column(_1).cumsum();
+    REQUIRE(std::equal(gsum.begin(), gsum.end(), scum.begin(), scum.end()));
+    REQUIRE(gsum[1] == missing);
+    REQUIRE(gsum[2] == 5);
+    REQUIRE(gsum[5] == 22);
+    REQUIRE(gmin[1] == missing);
+    REQUIRE(gmin[5] == 1);
+}
+
+TEST_CASE("rolling windows over gaps", "[frame]")
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    frame<int, double, mi<double>> f;
+    f.set_column_names("key", "price", "gappy");
+    const double vals[] = { 1.0, 2.0, nan, 4.0, 5.0, 6.0, 7.0 };
+    for (size_t i = 0; i < 7; ++i) {
+        f.push_back(0, vals[i], i == 2 ? mi<double>{} : mi<double>{ vals[i] });
+    }
+
+    auto grp  = f.groupby(_0);
+    auto sum  = grp.window(win::rolling_sum(_1, 2));
+    auto mean = grp.window(win::rolling_mean(_1, 2));
+    auto sd   = grp.window(win::rolling_std(_1, 2));
+    REQUIRE(sum[1] == 3.0);
+    REQUIRE(std::isnan(sum[2]));
+    REQUIRE(std::isnan(sum[3]));
+    REQUIRE(std::isnan(mean[3]));
+    REQUIRE(std::isnan(sd[3]));
+    REQUIRE(sum[4] == 9.0);
+    REQUIRE(sum[5] == 11.0);
+    REQUIRE(sum[6] == 13.0);
+    REQUIRE(mean[6] == 6.5);
+    REQUIRE(sd[4] == 0.5);
+    REQUIRE(sd[6] == 0.5);
+
+    auto msum  = grp.window(win::rolling_sum(_2, 2));
+    auto mmean = grp.window(win::rolling_mean(_2, 2));
+    auto msd   = grp.window(win::rolling_std(_2, 2));
+    REQUIRE(msum[1] == 3.0);
+    REQUIRE(msum[2] == missing);
+    REQUIRE(msum[3] == missing);
+    REQUIRE(mmean[3] == missing);
+    REQUIRE(msd[3] == missing);
+    REQUIRE(msum[4] == 9.0);
+    REQUIRE(msum[6] == 13.0);
+    REQUIRE(mmean[5] == 5.5);
+    REQUIRE(msd[5] == 0.5);
+
+    auto lo  = grp.window(win::rolling_min(_1, 3));
+    auto hi  = grp.window(win::rolling_max(_1, 3));
+    auto mlo = grp.window(win::rolling_min(_2, 2));
+    auto mhi = grp.window(win::rolling_max(_2, 2));
+    REQUIRE(lo[1] == 1.0);
+    REQUIRE(std::isnan(lo[2]));
+    REQUIRE(std::isnan(hi[3]));
+    REQUIRE(std::isnan(lo[4]));
+    REQUIRE(lo[5] == 4.0);
+    REQUIRE(hi[6] == 7.0);
+    REQUIRE(mhi[1] == 2.0);
+    REQUIRE(mlo[2] == missing);
+    REQUIRE(mhi[3] == missing);
+    REQUIRE(mlo[4] == 4.0);
+    REQUIRE(mhi[5] == 6.0);
+
+    // A window of one recovers right after the gap
+    auto one = grp.window(win::rolling_std(_2, 1));
+    REQUIRE(one[2] == missing);
+    REQUIRE(one[3] == 0.0);
+}
+
+TEST_CASE("rolling expressions", "[frame]")
+{
+    frame<int, double> f;
+    f.set_column_names("n", "price");
+    for (int i = 0; i < 500; ++i) {
+        f.push_back(i % 13, static_cast<double>((i * 7919) % 101) / 4.0);
+    }
+
+    auto f2 = f.append_column<double>("mean", rolling_mean(_1, 5));
+    auto f3 = f2.append_column<double>("dev", _1 - rolling_mean(_1, 5));
+    auto sum = f.make_series<double>("sum", rolling_sum(_1 * 2.0, 5));
+    auto sd  = f.make_series<double>("std", rolling_std(_1, 5));
+    auto lo  = f.make_series<double>("lo", rolling_min(_1, 5));
+    auto hi  = f.make_series<double>("hi", rolling_max(_1, 5));
+    auto nm  = f.make_series<double>("nmean", rolling_mean(_0, 3));
+    auto ns  = f.make_series<int>("nsum", rolling_sum(_0, 1000));
+    REQUIRE(f3.column_name(_2) == "mean");
+    REQUIRE(f3.column_name(_3) == "dev");
+
+    for (size_t i = 0; i < f.size(); ++i) {
+        const size_t from = i >= 4 ? i - 4 : 0;
+        const double n    = static_cast<double>(i - from + 1);
+        double wsum       = 0.0;
+        double wmin       = f.row(i).at(_1);
+        double wmax       = wmin;
+        for (size_t j = from; j <= i; ++j) {
+            const double v = f.row(j).at(_1);
+            wsum += v;
+            wmin = std::min(wmin, v);
+            wmax = std::max(wmax, v);
+        }
+        const double mean = wsum / n;
+        double ss         = 0.0;
+        for (size_t j = from; j <= i; ++j) {
+            const double d = f.row(j).at(_1) - mean;
+            ss += d * d;
+        }
+        REQUIRE(f3.row(i).at(_2) == Approx(mean));
+        REQUIRE(f3.row(i).at(_3) == Approx(f.row(i).at(_1) - mean).margin(1e-9));
+        REQUIRE(sum[i] == Approx(2.0 * wsum));
+        REQUIRE(sd[i] == Approx(std::sqrt(ss / n)).margin(1e-9));
+        REQUIRE(lo[i] == wmin);
+        REQUIRE(hi[i] == wmax);
+
+        const size_t nfrom = i >= 2 ? i - 2 : 0;
+        int nsum           = 0;
+        for (size_t j = nfrom; j <= i; ++j) {
+            nsum += f.row(j).at(_0);
+        }
+        REQUIRE(nm[i] == Approx(nsum / static_cast<double>(i - nfrom + 1)));
+    }
+    REQUIRE(ns[ns.size() - 1] == std::accumulate(f.column(_0).begin(), f.column(_0).end(), 0));
+
+    // The same expression can be evaluated over another frame
+    auto mean = rolling_mean(_1, 2);
+    auto g1   = f.append_column<double>("m", mean);
+    frame<int, double> f4;
+    f4.set_column_names("n", "price");
+    f4.push_back(0, 1.0);
+    f4.push_back(0, 3.0);
+    f4.push_back(0, 8.0);
+    auto g2 = f4.append_column<double>("m", mean);
+    REQUIRE(g2.row(0).at(_2) == 1.0);
+    REQUIRE(g2.row(1).at(_2) == 2.0);
+    REQUIRE(g2.row(2).at(_2) == 5.5);
+
+    // Missing values and NaNs drop out once they leave the window
+    frame<double, mi<double>> gaps;
+    gaps.set_column_names("price", "gappy");
+    const double vals[] = { 1.0, 2.0, std::numeric_limits<double>::quiet_NaN(), 4.0, 5.0, 6.0 };
+    for (size_t i = 0; i < 6; ++i) {
+        gaps.push_back(vals[i], i == 2 ? mi<double>{} : mi<double>{ vals[i] });
+    }
+    auto gsum  = gaps.make_series<mi<double>>("s", rolling_sum(_1, 2));
+    auto gmean = gaps.make_series<mi<double>>("m", rolling_mean(_1, 2));
+    auto gstd  = gaps.make_series<mi<double>>("sd", rolling_std(_1, 2));
+    auto nsum  = gaps.make_series<double>("ns", rolling_sum(_0, 2));
+    REQUIRE(gsum[1] == 3.0);
+    REQUIRE(gsum[2] == missing);
+    REQUIRE(gsum[3] == missing);
+    REQUIRE(gsum[4] == 9.0);
+    REQUIRE(gsum[5] == 11.0);
+    REQUIRE(gmean[3] == missing);
+    REQUIRE(gmean[5] == 5.5);
+    REQUIRE(gstd[5] == 0.5);
+    REQUIRE(std::isnan(nsum[3]));
+    REQUIRE(nsum[4] == 9.0);
+    REQUIRE(nsum[5] == 11.0);
+    auto gmin = gaps.make_series<mi<double>>("lo", rolling_min(_1, 3));
+    auto gmax = gaps.make_series<mi<double>>("hi", rolling_max(_1, 3));
+    auto nmin = gaps.make_series<double>("nlo", rolling_min(_0, 3));
+    REQUIRE(gmin[1] == 1.0);
+    REQUIRE(gmax[3] == missing);
+    REQUIRE(gmin[4] == missing);
+    REQUIRE(gmax[5] == 6.0);
+    REQUIRE(gmin[5] == 4.0);
+    REQUIRE(std::isnan(nmin[2]));
+    REQUIRE(std::isnan(nmin[3]));
+    REQUIRE(nmin[5] == 4.0);
+
+    REQUIRE_THROWS_AS(rolling_sum(_1, 0), std::invalid_argument);
+}
+
+TEST_CASE("exponentially weighted statistics", "[frame]")
+{
+    frame<double, mi<double>> f;
+    f.set_column_names("price", "gappy");
+    for (int i = 0; i < 200; ++i) {
+        const double v = static_cast<double>((i * 7919) % 101) / 8.0;
+        f.push_back(v, (i % 5 == 2 || i < 3) ? mi<double>{} : mi<double>{ v });
+    }
+    const double alpha = 0.3;
+
+    // With adjust, the mean and variance are weighted by (1 - alpha)^age over
+    // the values so far, gaps included in the age
+    auto check = [&](size_t i, auto value, const auto& mean, const auto& var) {
+        double sw  = 0.0;
+        double sw2 = 0.0;
+        double swx = 0.0;
+        for (size_t j = 0; j <= i; ++j) {
+            auto x = value(j);
+            if (x.has_value()) {
+                const double w = std::pow(1.0 - alpha, static_cast<double>(i - j));
+                sw += w;
+                sw2 += w * w;
+                swx += w * *x;
+            }
+        }
+        if (sw == 0.0) {
+            REQUIRE(!mean.has_value());
+            REQUIRE(!var.has_value());
+            return;
+        }
+        const double m = swx / sw;
+        double ss      = 0.0;
+        for (size_t j = 0; j <= i; ++j) {
+            auto x = value(j);
+            if (x.has_value()) {
+                const double w = std::pow(1.0 - alpha, static_cast<double>(i - j));
+                ss += w * (*x - m) * (*x - m);
+            }
+        }
+        REQUIRE(*mean == Approx(m));
+        if (sw * sw - sw2 > 1e-12) {
+            REQUIRE(*var == Approx(ss / sw * sw * sw / (sw * sw - sw2)).margin(1e-9));
+        }
+        else {
+            REQUIRE(!var.has_value());
+        }
+    };
+
+    auto f2 = f.append_column<double>("ewma", ewm_mean(_0, alpha));
+    auto gm = f.make_series<mi<double>>("gm", ewm_mean(_1, alpha));
+    auto pv = f.make_series<mi<double>>("pv", ewm_var(_0, alpha));
+    auto gv = f.make_series<mi<double>>("gv", ewm_var(_1, alpha));
+    auto sm = f.column(_1).ewm_mean(alpha);
+    auto sv = f.column(_1).ewm_var(alpha);
+    REQUIRE(sm.name() == "gappy");
+    REQUIRE(std::equal(sm.begin(), sm.end(), gm.begin(), gm.end()));
+    REQUIRE(std::equal(sv.begin(), sv.end(), gv.begin(), gv.end()));
+    for (size_t i = 0; i < f.size(); ++i) {
+        check(
+            i, [&](size_t j) { return mi<double>{ f.row(j).at(_0) }; },
+            mi<double>{ f2.row(i).at(_2) }, pv[i]);
+        check(
+            i, [&](size_t j) { return f.row(j).at(_1); }, gm[i], gv[i]);
+    }
+
+    // Without adjust, the mean is the usual recursion
+    auto rec = f.column(_0).ewm_mean(alpha, false);
+    auto ex  = f.make_series<double>("ex", ewm_mean(_0, alpha, false));
+    double y = f.row(0).at(_0);
+    for (size_t i = 0; i < f.size(); ++i) {
+        y = i == 0 ? y : (1.0 - alpha) * y + alpha * f.row(i).at(_0);
+        REQUIRE(rec[i] == Approx(y));
+        REQUIRE(ex[i] == Approx(y));
+    }
+    auto rv = f.column(_0).ewm_var(alpha, false);
+    REQUIRE(!rv[0].has_value());
+    REQUIRE(rv[1].has_value());
+
+    REQUIRE_THROWS_AS(ewm_mean(_0, 0.0), std::invalid_argument);
+    REQUIRE_THROWS_AS(f.column(_0).ewm_var(1.5), std::invalid_argument);
+}
+
+TEST_CASE("series scans", "[frame]")
+{
+    auto check_scans = [](const auto& s, size_t num_threads) {
+        using T      = typename std::decay_t<decltype(s)>::value_type;
+        auto sum  = s.cumsum(num_threads);
+        auto lo   = s.cummin(num_threads);
+        auto hi   = s.cummax(num_threads);
+        REQUIRE(sum.name() == s.name());
+        REQUIRE(sum.size() == s.size());
+        T acc_sum     = s[0];
+        T acc_lo      = s[0];
+        T acc_hi      = s[0];
+        size_t wrong  = 0;
+        double maxerr = 0.0;
+        for (size_t i = 0; i < s.size(); ++i) {
+            if (i > 0) {
+                acc_sum = acc_sum + s[i];
+                acc_lo  = std::min(acc_lo, s[i]);
+                acc_hi  = std::max(acc_hi, s[i]);
+            }
+            if constexpr (std::is_floating_point_v<T>) {
+                maxerr = std::max(maxerr, std::abs(static_cast<double>(sum[i] - acc_sum)));
+            }
+            else {
+                wrong += sum[i] != acc_sum;
+            }
+            wrong += lo[i] != acc_lo || hi[i] != acc_hi;
+        }
+        REQUIRE(wrong == 0);
+        REQUIRE(maxerr < 1e-2);
+    };
+
+    const size_t num = 150001;
+    series<double> d;
+    series<float> fl;
+    series<int> n32;
+    series<int64_t> n64;
+    d.set_name("d");
+    for (size_t i = 0; i < num; ++i) {
+        const auto v = static_cast<int>((i * 7919) % 201) - 100;
+        d.push_back(1.0 + v / 100000.0);
+        fl.push_back(static_cast<float>(v) / 4.0f);
+        n32.push_back(v);
+        n64.push_back(static_cast<int64_t>(v) * 1000000007);
+    }
+    // Products of values near one stay in range
+    for (size_t threads : { 1, 4 }) {
+        auto prod       = d.cumprod(threads);
+        double acc_prod = 1.0;
+        double maxerr   = 0.0;
+        for (size_t i = 0; i < num; ++i) {
+            acc_prod *= d[i];
+            maxerr = std::max(maxerr, std::abs(prod[i] / acc_prod - 1.0));
+        }
+        REQUIRE(maxerr < 1e-9);
+    }
+    for (size_t threads : { 1, 4 }) {
+        check_scans(d, threads);
+        check_scans(fl, threads);
+        check_scans(n32, threads);
+        check_scans(n64, threads);
+    }
+
+    // Short series, shorter than a vector
+    for (size_t len = 1; len < 20; ++len) {
+        check_scans(series<double>(d.begin(), d.begin() + len), 1);
+        check_scans(series<float>(fl.begin(), fl.begin() + len), 1);
+        check_scans(series<int>(n32.begin(), n32.begin() + len), 1);
+    }
+
+    // A NaN anywhere in a vector, or across vectors, is NaN from there on
+    auto check_nan = [](auto s, size_t at, size_t num_threads) {
+        using T      = typename decltype(s)::value_type;
+        s[at]        = std::numeric_limits<T>::quiet_NaN();
+        auto lo      = s.cummin(num_threads);
+        auto hi      = s.cummax(num_threads);
+        T acc_lo     = s[0];
+        T acc_hi     = s[0];
+        size_t wrong = 0;
+        for (size_t i = 0; i < s.size(); ++i) {
+            if (i > 0) {
+                acc_lo = std::min(acc_lo, s[i]);
+                acc_hi = std::max(acc_hi, s[i]);
+            }
+            if (i >= at) {
+                wrong += !std::isnan(lo[i]) || !std::isnan(hi[i]);
+            }
+            else {
+                wrong += lo[i] != acc_lo || hi[i] != acc_hi;
+            }
+        }
+        REQUIRE(wrong == 0);
+    };
+    for (size_t len : { 8, 16, 20, 1000 }) {
+        for (size_t at : { 0, 1, 2, 3, 4, 5, 6, 7, 9, 13 }) {
+            if (at < len) {
+                check_nan(series<double>(d.begin(), d.begin() + len), at, 1);
+                check_nan(series<float>(fl.begin(), fl.begin() + len), at, 1);
+            }
+        }
+    }
+    check_nan(d, 100001, 4);
+    check_nan(fl, 3, 4);
+
+    series<mi<int>> m{ missing, 3, 1, missing, 4, missing, 5 };
+    auto msum = m.cumsum();
+    REQUIRE(msum == series<mi<int>>{ missing, 3, 4, missing, 8, missing, 13 });
+    auto mmax = m.cummax();
+    REQUIRE(mmax == series<mi<int>>{ missing, 3, 3, missing, 4, missing, 5 });
+
+    series<double> prices{ 10.0, 11.0, 9.9, 9.9, 12.0 };
+    auto dp = prices.diff();
+    REQUIRE(std::isnan(dp[0]));
+    REQUIRE(dp[1] == Approx(1.0));
+    REQUIRE(dp[2] == Approx(-1.1));
+    REQUIRE(dp[3] == 0.0);
+    auto pc = prices.pct_change(2);
+    REQUIRE(std::isnan(pc[0]));
+    REQUIRE(std::isnan(pc[1]));
+    REQUIRE(pc[2] == Approx(-0.01));
+    REQUIRE(pc[4] == Approx(12.0 / 9.9 - 1.0));
+    REQUIRE(prices.diff(10).size() == prices.size());
+
+    series<int> counts{ 4, 6, 3 };
+    series<mi<int>> dc = counts.diff();
+    REQUIRE(dc == series<mi<int>>{ missing, 2, -3 });
+    series<double> pcc = counts.pct_change();
+    REQUIRE(pcc[1] == Approx(0.5));
+
+    auto dm = m.diff();
+    REQUIRE(dm == series<mi<int>>{ missing, missing, -2, missing, missing, missing, missing });
+    series<mi<double>> pm = m.pct_change();
+    REQUIRE(!pm[1].has_value());
+    REQUIRE(*pm[2] == Approx(-2.0 / 3.0));
+}
+
+TEST_CASE("offset column references", "[frame]")
+{
+    for (size_t len : { 0, 1, 2, 3, 4, 5, 50 }) {
+        frame<int, double, mi<double>> f;
+        f.set_column_names("n", "price", "gappy");
+        for (size_t i = 0; i < len; ++i) {
+            const double v = static_cast<double>((i * 7919) % 101);
+            f.push_back(static_cast<int>(i), v, i % 3 == 1 ? mi<double>{} : mi<double>{ v });
+        }
+        auto at = [&](size_t i, ptrdiff_t off) -> mi<double> {
+            const auto j = static_cast<ptrdiff_t>(i) + off;
+            if (j < 0 || j >= static_cast<ptrdiff_t>(len)) {
+                return missing;
+            }
+            return f.row(static_cast<size_t>(j)).at(_1);
+        };
+
+        auto diff  = f.make_series<mi<double>>("diff", _1 - _1[-1]);
+        auto ahead = f.make_series<mi<double>>("ahead", _1[-2] + _1[1] * 2.0);
+        auto plain = f.make_series<double>("plain", _1[-1]);
+        auto gaps  = f.make_series<mi<double>>("gaps", _2[-1]);
+        auto flags = f.make_series<bool>("up", _1 > _1[-1]);
+        auto dev   = f.make_series<mi<double>>("dev", _1[-1] - rolling_mean(_1, 2));
+        auto pre   = f.prepend_column<mi<double>>("prev", _1[-1]);
+        auto fn    = f.make_series<mi<double>>(
+            "fn", [ex = _1[-1]](auto& b, auto& c, auto& e) { return ex(b, c, e); });
+        for (size_t i = 0; i < len; ++i) {
+            const mi<double> prev = at(i, -1);
+            const double cur      = f.row(i).at(_1);
+            REQUIRE(diff[i] == (prev.has_value() ? mi<double>{ cur - *prev } : mi<double>{}));
+            const mi<double> back2 = at(i, -2);
+            const mi<double> next  = at(i, 1);
+            REQUIRE(ahead[i] ==
+                (back2.has_value() && next.has_value() ? mi<double>{ *back2 + *next * 2.0 }
+                                                       : mi<double>{}));
+            REQUIRE(plain[i] == (prev.has_value() ? *prev : 0.0));
+            REQUIRE(gaps[i] == (i == 0 ? mi<double>{} : f.row(i - 1).at(_2)));
+            if (prev.has_value()) {
+                REQUIRE(flags[i] == (cur > *prev));
+            }
+            REQUIRE(pre.row(i).at(_0) == prev);
+            REQUIRE(fn[i] == prev);
+
+            const double mean = i == 0 ? cur : (cur + *prev) / 2.0;
+            REQUIRE(dev[i] == (prev.has_value() ? mi<double>{ *prev - mean } : mi<double>{}));
+        }
+    }
+}
+
+TEST_CASE("lazy pipelines", "[frame]")
+{
+    frame<int, int, double> f;
+    f.set_column_names("key", "qty", "price");
+    for (int i = 0; i < 40000; ++i) {
+        f.push_back(i % 17, (i * 31) % 100, static_cast<double>((i * 7919) % 1000));
+    }
+
+    SECTION("filters, projections and derived columns")
+    {
+        auto eager = f.rows(_1 > 10)
+                         .append_column<double>("x2", _2 * 2.0)
+                         .rows(_3 < 500.0)
+                         .columns(_0, _3);
+        auto lazy = mf::lazy(f)
+                        .rows(_1 > 10)
+                        .append_column<double>("x2", _2 * 2.0)
+                        .rows(_3 < 500.0)
+                        .columns(_0, _3)
+                        .collect();
+        REQUIRE(eager.size() > 0);
+        REQUIRE(lazy == eager);
+        REQUIRE(lazy.column_name(_1) == "x2");
+
+        auto none = mf::lazy(f).rows(_1 > 1000).columns(_2).collect();
+        REQUIRE(none.size() == 0);
+        REQUIRE(none.column_name(_0) == "price");
+    }
+
+    SECTION("aggregation")
+    {
+        // sum and count fold in each batch; median needs the whole frame
+        auto eager = f.rows(_1 < 50).groupby(_0).aggregate(agg::sum(_2), agg::count());
+        auto lazy =
+            mf::lazy(f).rows(_1 < 50).groupby(_0).aggregate(agg::sum(_2), agg::count()).collect();
+        REQUIRE(lazy == eager);
+
+        auto emed = f.rows(_1 < 50).groupby(_0).aggregate(agg::median(_2));
+        auto lmed = mf::lazy(f).rows(_1 < 50).groupby(_0).aggregate(agg::median(_2)).collect();
+        REQUIRE(lmed == emed);
+
+        auto esort = f.rows(_1 < 50)
+                         .groupby(_0)
+                         .aggregate(agg::count())
+                         .sorted(_1)
+                         .rows(_1 > 1000UL);
+        auto lsort = mf::lazy(f)
+                         .rows(_1 < 50)
+                         .groupby(_0)
+                         .aggregate(agg::count())
+                         .sorted(_1)
+                         .rows(_1 > 1000UL)
+                         .collect();
+        REQUIRE(lsort == esort);
+    }
+
+    SECTION("expressions over other rows")
+    {
+        auto eager = f.rows(_1 > 20)
+                         .append_column<double>("prev", _2 - _2[-1])
+                         .append_column<double>("avg", rolling_mean(_2, 5))
+                         .rows(_0 != 3);
+        auto lazy = mf::lazy(f)
+                        .rows(_1 > 20)
+                        .append_column<double>("prev", _2 - _2[-1])
+                        .append_column<double>("avg", rolling_mean(_2, 5))
+                        .rows(_0 != 3)
+                        .collect();
+        REQUIRE(lazy == eager);
+    }
+
+    SECTION("empty frame")
+    {
+        frame<int, int, double> empty;
+        empty.set_column_names("key", "qty", "price");
+        auto res = mf::lazy(empty)
+                       .rows(_1 > 10)
+                       .append_column<double>("x2", _2 * 2.0)
+                       .groupby(_0)
+                       .aggregate(agg::sum(_3))
+                       .collect();
+        REQUIRE(res.size() == 0);
+        REQUIRE(res.column_name(_1) == "sum( x2 )");
+    }
+}
+
+TEST_CASE("column projection", "[frame]")
+{
+    frame<int, std::string, double, double, int, std::string, double> f;
+    f.set_column_names("id", "name", "price", "qty", "bucket", "note", "weight");
+    for (int i = 0; i < 40000; ++i) {
+        f.push_back(i, "n" + std::to_string(i % 97), static_cast<double>((i * 7919) % 1000),
+            static_cast<double>(i % 50), i % 11, "x", static_cast<double>(i % 7));
+    }
+
+    SECTION("rows with a projection")
+    {
+        auto proj = f.rows(_3 > 25.0 && _4 != 3, _2, _0);
+        auto full = f.rows(_3 > 25.0 && _4 != 3).columns(_2, _0);
+        REQUIRE(proj.size() > 0);
+        REQUIRE(proj == full);
+        REQUIRE(proj.column_name(_0) == "price");
+
+        auto none = f.rows(_3 > 1000.0, _1);
+        REQUIRE(none.size() == 0);
+        REQUIRE(none.column_name(_0) == "name");
+    }
+
+    SECTION("lazy pipelines read only the columns they use")
+    {
+        // "dead" is never used, so it isn't worked out
+        auto eager = f.rows(_4 > 3)
+                         .append_column<double>("dead", _2 * 3.0)
+                         .append_column<double>("y", _3 + _6)
+                         .columns(_0, _8, _1)
+                         .rows(_1 > 20.0);
+        auto lazy = mf::lazy(f)
+                        .rows(_4 > 3)
+                        .append_column<double>("dead", _2 * 3.0)
+                        .append_column<double>("y", _3 + _6)
+                        .columns(_0, _8, _1)
+                        .rows(_1 > 20.0)
+                        .collect();
+        REQUIRE(eager.size() > 0);
+        REQUIRE(lazy == eager);
+
+        auto eagg = f.columns(_6, _4, _2)
+                        .rows(_0 < 5.0)
+                        .groupby(_1)
+                        .aggregate(agg::quantile(_2, 0.9), agg::sum(_0), agg::count());
+        auto lagg = mf::lazy(f)
+                        .columns(_6, _4, _2)
+                        .rows(_0 < 5.0)
+                        .groupby(_1)
+                        .aggregate(agg::quantile(_2, 0.9), agg::sum(_0), agg::count())
+                        .collect();
+        REQUIRE(lagg == eagg);
+
+        auto esort = f.rows(_0 % 3 == 0).sorted(_3, _0).columns(_5, _0);
+        auto lsort = mf::lazy(f).rows(_0 % 3 == 0).sorted(_3, _0).columns(_5, _0).collect();
+        REQUIRE(lsort == esort);
+
+        auto ediff = f.append_column<mi<double>>("d", _2 - _2[-1]).rows(_4 == 2).columns(_7, _1);
+        auto ldiff = mf::lazy(f)
+                         .append_column<mi<double>>("d", _2 - _2[-1])
+                         .rows(_4 == 2)
+                         .columns(_7, _1)
+                         .collect();
+        REQUIRE(ldiff == ediff);
+    }
+}
+
+TEST_CASE("bloom_filter", "[frame]")
+{
+    frame<int, std::string> allow;
+    allow.set_column_names("id", "name");
+    for (int i = 0; i < 200; i += 2) {
+        allow.push_back(i, std::to_string(i));
+    }
+
+    frame<int, double> events;
+    events.set_column_names("id", "value");
+    for (int i = 0; i < 1000; ++i) {
+        events.push_back(i, i * 0.5);
+    }
+
+    SECTION("no false negatives")
+    {
+        auto bf = make_bloom_filter(allow, _0);
+        for (int i = 0; i < 200; i += 2) {
+            REQUIRE(bf.may_contain(events.row(i), _0));
+        }
+        size_t false_positives = 0;
+        for (int i = 200; i < 1000; ++i) {
+            false_positives += bf.may_contain(events.row(i), _0) ? 1 : 0;
+        }
+        REQUIRE(false_positives < 80);
+
+        bloom_filter empty;
+        REQUIRE(!empty.may_contain(events.row(0), _0));
+        empty.insert(events.row(0), _0);
+        REQUIRE(empty.may_contain(events.row(0), _0));
+        REQUIRE(empty.size_in_bytes() == 32);
+    }
+
+    SECTION("rows")
+    {
+        auto bf    = make_bloom_filter(allow, _0);
+        auto maybe = events.rows(bf.may_contain(_0));
+        dout << maybe.size() << " of " << events.size() << " rows may match\n";
+        REQUIRE(maybe.size() >= 100);
+        REQUIRE(maybe.size() < 200);
+        REQUIRE(semijoin(maybe, _0, allow, _0).size() == 100);
+    }
+
+    SECTION("innerjoin prefilter")
+    {
+        auto plain = innerjoin(events, _0, allow, _0);
+        auto res   = innerjoin(events, _0, allow, _0, join_options{ true });
+        dout << res;
+        REQUIRE(res.size() == 100);
+        REQUIRE(res.size() == plain.size());
+        REQUIRE(res.column_names() == plain.column_names());
+        // prefiltered rows come out in left row order
+        auto it = res.cbegin();
+        for (int i = 0; i < 100; ++i) {
+            REQUIRE((it + i)->at(_0) == i * 2);
+            REQUIRE((it + i)->at(_3) == std::to_string(i * 2));
+        }
+
+        auto res2 = innerjoin(events, (_0, _0), allow, (_0, _0), join_options{ true, 4.0 });
+        REQUIRE(res2.size() == 100);
+
+        // The same probe without the filter gives the same rows in the same order
+        auto ordered = innerjoin(events, _0, allow, _0, join_options{ false, 10.0, true });
+        REQUIRE(ordered == res);
+    }
+}
+
 TEST_CASE("replace_missing", "[frame]")
 {
     frame<mi<year_month_day>, mi<double>, mi<bool>> f1;